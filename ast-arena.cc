@@ -0,0 +1,63 @@
+//
+// See copyright.h for copyright notice and limitation of liability
+// and disclaimer of warranty provisions.
+//
+#include "copyright.h"
+
+//////////////////////////////////////////////////////////////////////////
+//
+//  ast-arena.cc
+//
+//  The bump allocator described in ast-arena.h.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include <vector>
+#include "ast-arena.h"
+
+static std::vector<char *> chunks;   // every chunk, for ast_arena_release
+static char *arena_ptr = NULL;       // next free byte of the last chunk
+static size_t arena_left = 0;        // bytes left in the last chunk
+
+// statistics for ast_arena_report
+static long alloc_count = 0;
+static size_t used_bytes = 0;        // bytes handed out
+static size_t reserved_bytes = 0;    // bytes in chunks now
+static size_t peak_bytes = 0;        // most bytes ever held in chunks
+
+void *ast_arena_alloc(size_t size)
+{
+  size = (size + AST_ARENA_ALIGN - 1) & ~(size_t) (AST_ARENA_ALIGN - 1);
+  if (size > arena_left) {
+    size_t chunk = size > AST_ARENA_CHUNK ? size : AST_ARENA_CHUNK;
+    arena_ptr = new char [chunk];
+    arena_left = chunk;
+    chunks.push_back(arena_ptr);
+    reserved_bytes += chunk;
+    if (reserved_bytes > peak_bytes)
+      peak_bytes = reserved_bytes;
+  }
+  char *p = arena_ptr;
+  arena_ptr += size;
+  arena_left -= size;
+  alloc_count++;
+  used_bytes += size;
+  return p;
+}
+
+void ast_arena_release()
+{
+  for (size_t i = 0; i < chunks.size(); i++)
+    delete [] chunks[i];
+  chunks.clear();
+  arena_ptr = NULL;
+  arena_left = 0;
+  reserved_bytes = 0;
+}
+
+void ast_arena_report(ostream& s)
+{
+  s << "ast arena: " << alloc_count << " allocations, " << used_bytes
+    << " bytes used, peak " << peak_bytes << " bytes in "
+    << chunks.size() << " chunks" << endl;
+}
@@ -0,0 +1,61 @@
+//
+// See copyright.h for copyright notice and limitation of liability
+// and disclaimer of warranty provisions.
+//
+#include "copyright.h"
+
+#ifndef _AST_ARENA_H_
+#define _AST_ARENA_H_
+
+//////////////////////////////////////////////////////////////////////////
+//
+//  ast-arena.h
+//
+//  The arena that holds the abstract syntax tree.  Nodes are never freed
+//  one at a time, so instead of one heap allocation per node they are
+//  carved out of large chunks with a bump pointer, which also keeps the
+//  nodes of one class close together in memory.  ast_arena_release frees
+//  all of them at once when compilation is over.
+//
+//  Every phylum class gets an operator new that allocates here (see
+//  AST_ARENA_EXTRAS in cool-tree.handcode.h), so the node constructors,
+//  the copy_ functions and CgenNode all use the arena.  The list cells
+//  are templates from tree.h, so the nil_/single_/append_ functions in
+//  cool-tree.cc place them here with ast_arena_new.
+//
+//  The arena is not locked: nodes are built by the AST readers and by
+//  the CgenClassTable constructor, all on the thread that runs cgen.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include <stddef.h>
+#include <new>
+#include "cool-io.h"
+
+#define AST_ARENA_CHUNK (1 << 20)
+#define AST_ARENA_ALIGN 8
+
+//
+// Allocate size bytes, aligned to AST_ARENA_ALIGN.
+//
+void *ast_arena_alloc(size_t size);
+
+//
+// Free everything allocated so far.  No node may be used afterwards.
+//
+void ast_arena_release();
+
+//
+// Print the number of allocations and the bytes used and reserved.
+//
+void ast_arena_report(ostream& s);
+
+//
+// Construct a T in the arena.
+//
+template <class T, class... Args> T *ast_arena_new(Args... args)
+{
+  return new (ast_arena_alloc(sizeof(T))) T(args...);
+}
+
+#endif
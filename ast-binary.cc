@@ -0,0 +1,691 @@
+//
+// See copyright.h for copyright notice and limitation of liability
+// and disclaimer of warranty provisions.
+//
+#include "copyright.h"
+
+//////////////////////////////////////////////////////////////////////////
+//
+//  ast-binary.cc
+//
+//  Writer and loader for the binary AST format described in ast-binary.h.
+//
+//  The writer is a recursive traversal like dump_with_types in
+//  dumptype.cc: every kind of node has a write_binary method that writes
+//  its header and then its components.
+//
+//  The loader maps the whole input into memory (or reads it into a buffer
+//  when the input is a pipe) and rebuilds the tree bottom up, using the
+//  same constructors and list shapes as the text parser in ast.y, so the
+//  code generator cannot tell which of the two formats it was given.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <vector>
+#include "cool-tree.h"
+#include "ast-binary.h"
+
+extern Program ast_root;   // defined by the text parser, ast-parse.cc
+
+//////////////////////////////////////////////////////////////////////////
+//
+//  Writing
+//
+//////////////////////////////////////////////////////////////////////////
+
+void AstWriter::put_byte(int b)
+{
+  str.put((char) b);
+}
+
+void AstWriter::put_int(int i)
+{
+  unsigned u = (unsigned) i;
+  char buf[4] = { (char) u, (char) (u >> 8), (char) (u >> 16), (char) (u >> 24) };
+  str.write(buf, 4);
+}
+
+void AstWriter::put_symbol(Symbol sym)
+{
+  if (by_name) {
+    put_int(sym->get_len());
+    str.write(sym->get_string(), sym->get_len());
+  } else {
+    put_int(sym->get_index());
+  }
+}
+
+void AstWriter::put_header(int kind, tree_node *node)
+{
+  put_byte(kind);
+  put_int(node->get_line_number());
+}
+
+void AstWriter::put_header(int kind, Expression_class *expr)
+{
+  put_header(kind, (tree_node *) expr);
+  if (by_name) {
+    put_byte(expr->get_type() != NULL);
+    if (expr->get_type())
+      put_symbol(expr->get_type());
+  } else {
+    put_int(expr->get_type() ? expr->get_type()->get_index() + 1 : 0);
+  }
+}
+
+template <class Elem>
+static void put_table(AstWriter& w, ostream& s, StringTable<Elem>& tbl)
+{
+  int count = 0;
+  for (int i = tbl.first(); tbl.more(i); i = tbl.next(i))
+    count++;
+  w.put_int(count);
+  for (int i = tbl.first(); tbl.more(i); i = tbl.next(i)) {
+    Elem *e = tbl.lookup(i);
+    w.put_int(e->get_len());
+    s.write(e->get_string(), e->get_len());
+    w.put_byte(0);
+  }
+}
+
+void AstWriter::put_tables()
+{
+  put_table(*this, str, idtable);
+  put_table(*this, str, stringtable);
+  put_table(*this, str, inttable);
+}
+
+void ast_binary_write(ostream& s, Program p)
+{
+  AstWriter w(s);
+  s.write(AST_BINARY_MAGIC, AST_BINARY_MAGIC_LEN);
+  w.put_int(AST_BINARY_VERSION);
+  w.put_tables();
+  p->write_binary(w);
+}
+
+void program_class::write_binary(AstWriter& w)
+{
+  w.put_header(AST_PROGRAM, this);
+  w.put_list(classes);
+}
+
+void class__class::write_binary(AstWriter& w)
+{
+  w.put_header(AST_CLASS, this);
+  w.put_symbol(name);
+  w.put_symbol(parent);
+  w.put_list(features);
+  w.put_symbol(filename);
+}
+
+void method_class::write_binary(AstWriter& w)
+{
+  w.put_header(AST_METHOD, this);
+  w.put_symbol(name);
+  w.put_list(formals);
+  w.put_symbol(return_type);
+  expr->write_binary(w);
+}
+
+void attr_class::write_binary(AstWriter& w)
+{
+  w.put_header(AST_ATTR, this);
+  w.put_symbol(name);
+  w.put_symbol(type_decl);
+  init->write_binary(w);
+}
+
+void formal_class::write_binary(AstWriter& w)
+{
+  w.put_header(AST_FORMAL, this);
+  w.put_symbol(name);
+  w.put_symbol(type_decl);
+}
+
+void branch_class::write_binary(AstWriter& w)
+{
+  w.put_header(AST_BRANCH, this);
+  w.put_symbol(name);
+  w.put_symbol(type_decl);
+  expr->write_binary(w);
+}
+
+void assign_class::write_binary(AstWriter& w)
+{
+  w.put_header(AST_ASSIGN, this);
+  w.put_symbol(name);
+  expr->write_binary(w);
+}
+
+void static_dispatch_class::write_binary(AstWriter& w)
+{
+  w.put_header(AST_STATIC_DISPATCH, this);
+  expr->write_binary(w);
+  w.put_symbol(type_name);
+  w.put_symbol(name);
+  w.put_list(actual);
+}
+
+void dispatch_class::write_binary(AstWriter& w)
+{
+  w.put_header(AST_DISPATCH, this);
+  expr->write_binary(w);
+  w.put_symbol(name);
+  w.put_list(actual);
+}
+
+void cond_class::write_binary(AstWriter& w)
+{
+  w.put_header(AST_COND, this);
+  pred->write_binary(w);
+  then_exp->write_binary(w);
+  else_exp->write_binary(w);
+}
+
+void loop_class::write_binary(AstWriter& w)
+{
+  w.put_header(AST_LOOP, this);
+  pred->write_binary(w);
+  body->write_binary(w);
+}
+
+void typcase_class::write_binary(AstWriter& w)
+{
+  w.put_header(AST_TYPCASE, this);
+  expr->write_binary(w);
+  w.put_list(cases);
+}
+
+void block_class::write_binary(AstWriter& w)
+{
+  w.put_header(AST_BLOCK, this);
+  w.put_list(body);
+}
+
+void let_class::write_binary(AstWriter& w)
+{
+  w.put_header(AST_LET, this);
+  w.put_symbol(identifier);
+  w.put_symbol(type_decl);
+  init->write_binary(w);
+  body->write_binary(w);
+}
+
+void plus_class::write_binary(AstWriter& w)
+{
+  w.put_header(AST_PLUS, this);
+  e1->write_binary(w);
+  e2->write_binary(w);
+}
+
+void sub_class::write_binary(AstWriter& w)
+{
+  w.put_header(AST_SUB, this);
+  e1->write_binary(w);
+  e2->write_binary(w);
+}
+
+void mul_class::write_binary(AstWriter& w)
+{
+  w.put_header(AST_MUL, this);
+  e1->write_binary(w);
+  e2->write_binary(w);
+}
+
+void divide_class::write_binary(AstWriter& w)
+{
+  w.put_header(AST_DIVIDE, this);
+  e1->write_binary(w);
+  e2->write_binary(w);
+}
+
+void neg_class::write_binary(AstWriter& w)
+{
+  w.put_header(AST_NEG, this);
+  e1->write_binary(w);
+}
+
+void lt_class::write_binary(AstWriter& w)
+{
+  w.put_header(AST_LT, this);
+  e1->write_binary(w);
+  e2->write_binary(w);
+}
+
+void eq_class::write_binary(AstWriter& w)
+{
+  w.put_header(AST_EQ, this);
+  e1->write_binary(w);
+  e2->write_binary(w);
+}
+
+void leq_class::write_binary(AstWriter& w)
+{
+  w.put_header(AST_LEQ, this);
+  e1->write_binary(w);
+  e2->write_binary(w);
+}
+
+void comp_class::write_binary(AstWriter& w)
+{
+  w.put_header(AST_COMP, this);
+  e1->write_binary(w);
+}
+
+void int_const_class::write_binary(AstWriter& w)
+{
+  w.put_header(AST_INT_CONST, this);
+  w.put_symbol(token);
+}
+
+void bool_const_class::write_binary(AstWriter& w)
+{
+  w.put_header(AST_BOOL_CONST, this);
+  w.put_byte(val ? 1 : 0);
+}
+
+void string_const_class::write_binary(AstWriter& w)
+{
+  w.put_header(AST_STRING_CONST, this);
+  w.put_symbol(token);
+}
+
+void new__class::write_binary(AstWriter& w)
+{
+  w.put_header(AST_NEW, this);
+  w.put_symbol(type_name);
+}
+
+void isvoid_class::write_binary(AstWriter& w)
+{
+  w.put_header(AST_ISVOID, this);
+  e1->write_binary(w);
+}
+
+void no_expr_class::write_binary(AstWriter& w)
+{
+  w.put_header(AST_NO_EXPR, this);
+}
+
+void object_class::write_binary(AstWriter& w)
+{
+  w.put_header(AST_OBJECT, this);
+  w.put_symbol(name);
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+//  Reading
+//
+//////////////////////////////////////////////////////////////////////////
+
+class AstReader {
+private:
+  const unsigned char *p;     // next byte to read
+  const unsigned char *end;   // end of the input
+  std::vector<Symbol> ids, strs, ints;   // symbols by their index in the file
+
+  void corrupt();
+  void need(int n)            { if (end - p < n) corrupt(); }
+  int get_byte()              { need(1); return *p++; }
+  int get_int();
+  template <class Elem>
+  void get_table(StringTable<Elem>& tbl, std::vector<Symbol>& syms);
+  Symbol get_symbol(std::vector<Symbol>& syms);
+  Symbol get_id()             { return get_symbol(ids); }
+  int get_header(int& kind);
+
+  Program get_program();
+  Class_ get_class();
+  Feature get_feature();
+  Formal get_formal();
+  Case get_case();
+  Expression get_expression();
+  template <class Elem>
+  list_node<Elem> *get_list(Elem (AstReader::*get_elem)(),
+                            list_node<Elem> *(*nil)(),
+                            list_node<Elem> *(*single)(Elem),
+                            list_node<Elem> *(*append)(list_node<Elem> *, list_node<Elem> *));
+  Classes get_classes()
+    { return get_list(&AstReader::get_class, nil_Classes, single_Classes, append_Classes); }
+  Features get_features()
+    { return get_list(&AstReader::get_feature, nil_Features, single_Features, append_Features); }
+  Formals get_formals()
+    { return get_list(&AstReader::get_formal, nil_Formals, single_Formals, append_Formals); }
+  Expressions get_expressions()
+    { return get_list(&AstReader::get_expression, nil_Expressions, single_Expressions,
+                      append_Expressions); }
+  Cases get_cases()
+    { return get_list(&AstReader::get_case, nil_Cases, single_Cases, append_Cases); }
+
+public:
+  AstReader(const unsigned char *start, const unsigned char *e) : p(start), end(e) { }
+  Program read();
+};
+
+void AstReader::corrupt()
+{
+  cerr << "Corrupt binary AST input" << endl;
+  exit(1);
+}
+
+int AstReader::get_int()
+{
+  need(4);
+  unsigned u = p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned) p[3] << 24);
+  p += 4;
+  return (int) u;
+}
+
+//
+// The strings are stored with a trailing '\0', so they are added to the
+// tables straight from the input buffer.
+//
+template <class Elem>
+void AstReader::get_table(StringTable<Elem>& tbl, std::vector<Symbol>& syms)
+{
+  int count = get_int();
+  // every entry takes at least a length and the '\0'
+  if (count < 0 || (size_t) count > (size_t) (end - p) / 5) corrupt();
+  syms.reserve(count);
+  for (int i = 0; i < count; i++) {
+    int len = get_int();
+    // compared before adding 1, which overflows for len = INT_MAX
+    if (len < 0 || (size_t) len >= (size_t) (end - p)) corrupt();
+    if (p[len] != '\0') corrupt();
+    syms.push_back(tbl.add_string((char *) p, len));
+    p += len + 1;
+  }
+}
+
+Symbol AstReader::get_symbol(std::vector<Symbol>& syms)
+{
+  unsigned i = (unsigned) get_int();
+  if (i >= syms.size()) corrupt();
+  return syms[i];
+}
+
+//
+// Read a node header and set node_lineno, so the node built from it gets
+// the right line number.  Returns the line number; the caller has to set
+// node_lineno again after reading the components, which overwrite it.
+//
+int AstReader::get_header(int& kind)
+{
+  kind = get_byte();
+  int line = get_int();
+  node_lineno = line;
+  return line;
+}
+
+//
+// Lists are built the way the parser builds them: nil for an empty list,
+// otherwise a single node extended by appending one single node at a time.
+//
+template <class Elem>
+list_node<Elem> *AstReader::get_list(Elem (AstReader::*get_elem)(),
+                                     list_node<Elem> *(*nil)(),
+                                     list_node<Elem> *(*single)(Elem),
+                                     list_node<Elem> *(*append)(list_node<Elem> *,
+                                                                list_node<Elem> *))
+{
+  int len = get_int();
+  if (len < 0) corrupt();
+  if (len == 0) return nil();
+  list_node<Elem> *l = single((this->*get_elem)());
+  for (int i = 1; i < len; i++)
+    l = append(l, single((this->*get_elem)()));
+  return l;
+}
+
+Program AstReader::read()
+{
+  if (get_int() != AST_BINARY_VERSION) {
+    cerr << "Unsupported binary AST version" << endl;
+    exit(1);
+  }
+  get_table(idtable, ids);
+  get_table(stringtable, strs);
+  get_table(inttable, ints);
+  Program prog = get_program();
+  if (p != end) corrupt();
+  return prog;
+}
+
+Program AstReader::get_program()
+{
+  int kind;
+  int line = get_header(kind);
+  if (kind != AST_PROGRAM) corrupt();
+  Classes classes = get_classes();
+  node_lineno = line;
+  return program(classes);
+}
+
+Class_ AstReader::get_class()
+{
+  int kind;
+  int line = get_header(kind);
+  if (kind != AST_CLASS) corrupt();
+  Symbol name = get_id();
+  Symbol parent = get_id();
+  Features features = get_features();
+  Symbol filename = get_symbol(strs);
+  node_lineno = line;
+  return class_(name, parent, features, filename);
+}
+
+Feature AstReader::get_feature()
+{
+  int kind;
+  int line = get_header(kind);
+  Symbol name = get_id();
+  if (kind == AST_METHOD) {
+    Formals formals = get_formals();
+    Symbol return_type = get_id();
+    Expression expr = get_expression();
+    node_lineno = line;
+    return method(name, formals, return_type, expr);
+  }
+  if (kind != AST_ATTR) corrupt();
+  Symbol type_decl = get_id();
+  Expression init = get_expression();
+  node_lineno = line;
+  return attr(name, type_decl, init);
+}
+
+Formal AstReader::get_formal()
+{
+  int kind;
+  get_header(kind);
+  if (kind != AST_FORMAL) corrupt();
+  Symbol name = get_id();
+  Symbol type_decl = get_id();
+  return formal(name, type_decl);
+}
+
+Case AstReader::get_case()
+{
+  int kind;
+  int line = get_header(kind);
+  if (kind != AST_BRANCH) corrupt();
+  Symbol name = get_id();
+  Symbol type_decl = get_id();
+  Expression expr = get_expression();
+  node_lineno = line;
+  return branch(name, type_decl, expr);
+}
+
+Expression AstReader::get_expression()
+{
+  int kind;
+  int line = get_header(kind);
+  int type_index = get_int();
+  Symbol type = NULL;
+  if (type_index != 0) {
+    if ((unsigned) (type_index - 1) >= ids.size()) corrupt();
+    type = ids[type_index - 1];
+  }
+
+  Expression e = NULL, e1, e2, e3;
+  Symbol s1, s2;
+  Expressions l;
+  switch (kind) {
+  case AST_ASSIGN:
+    s1 = get_id(); e1 = get_expression();
+    node_lineno = line; e = assign(s1, e1);
+    break;
+  case AST_STATIC_DISPATCH:
+    e1 = get_expression(); s1 = get_id(); s2 = get_id(); l = get_expressions();
+    node_lineno = line; e = static_dispatch(e1, s1, s2, l);
+    break;
+  case AST_DISPATCH:
+    e1 = get_expression(); s1 = get_id(); l = get_expressions();
+    node_lineno = line; e = dispatch(e1, s1, l);
+    break;
+  case AST_COND:
+    e1 = get_expression(); e2 = get_expression(); e3 = get_expression();
+    node_lineno = line; e = cond(e1, e2, e3);
+    break;
+  case AST_LOOP:
+    e1 = get_expression(); e2 = get_expression();
+    node_lineno = line; e = loop(e1, e2);
+    break;
+  case AST_TYPCASE: {
+    e1 = get_expression();
+    Cases cases = get_cases();
+    node_lineno = line; e = typcase(e1, cases);
+    break;
+  }
+  case AST_BLOCK:
+    l = get_expressions();
+    node_lineno = line; e = block(l);
+    break;
+  case AST_LET:
+    s1 = get_id(); s2 = get_id(); e1 = get_expression(); e2 = get_expression();
+    node_lineno = line; e = let(s1, s2, e1, e2);
+    break;
+  case AST_PLUS:
+    e1 = get_expression(); e2 = get_expression();
+    node_lineno = line; e = plus(e1, e2);
+    break;
+  case AST_SUB:
+    e1 = get_expression(); e2 = get_expression();
+    node_lineno = line; e = sub(e1, e2);
+    break;
+  case AST_MUL:
+    e1 = get_expression(); e2 = get_expression();
+    node_lineno = line; e = mul(e1, e2);
+    break;
+  case AST_DIVIDE:
+    e1 = get_expression(); e2 = get_expression();
+    node_lineno = line; e = divide(e1, e2);
+    break;
+  case AST_NEG:
+    e1 = get_expression();
+    node_lineno = line; e = neg(e1);
+    break;
+  case AST_LT:
+    e1 = get_expression(); e2 = get_expression();
+    node_lineno = line; e = lt(e1, e2);
+    break;
+  case AST_EQ:
+    e1 = get_expression(); e2 = get_expression();
+    node_lineno = line; e = eq(e1, e2);
+    break;
+  case AST_LEQ:
+    e1 = get_expression(); e2 = get_expression();
+    node_lineno = line; e = leq(e1, e2);
+    break;
+  case AST_COMP:
+    e1 = get_expression();
+    node_lineno = line; e = comp(e1);
+    break;
+  case AST_INT_CONST:
+    e = int_const(get_symbol(ints));
+    break;
+  case AST_BOOL_CONST:
+    e = bool_const(get_byte() != 0);
+    break;
+  case AST_STRING_CONST:
+    e = string_const(get_symbol(strs));
+    break;
+  case AST_NEW:
+    e = new_(get_id());
+    break;
+  case AST_ISVOID:
+    e1 = get_expression();
+    node_lineno = line; e = isvoid(e1);
+    break;
+  case AST_NO_EXPR:
+    e = no_expr();
+    break;
+  case AST_OBJECT:
+    e = object(get_id());
+    break;
+  default:
+    corrupt();
+  }
+  return e->set_type(type);
+}
+
+//
+// Read the whole of f, starting at its current position.  A regular file
+// is mapped; anything else (a pipe) is read into a buffer.  The memory is
+// never released: the symbol tables keep their own copies of the strings,
+// but the compiler exits soon after anyway.
+//
+static const unsigned char *slurp(FILE *f, size_t& size)
+{
+  struct stat st;
+  long pos = ftell(f);
+  if (pos >= 0 && fstat(fileno(f), &st) == 0 && S_ISREG(st.st_mode) &&
+      st.st_size > pos) {
+    void *m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(f), 0);
+    if (m != MAP_FAILED) {
+      size = st.st_size - pos;
+      return (const unsigned char *) m + pos;
+    }
+  }
+
+  std::vector<unsigned char> *buf = new std::vector<unsigned char>();
+  unsigned char chunk[65536];
+  size_t n;
+  while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0)
+    buf->insert(buf->end(), chunk, chunk + n);
+  size = buf->size();
+  return buf->data();
+}
+
+bool ast_binary_read(FILE *f)
+{
+  //
+  // A text AST never starts with the first magic byte, so one byte of
+  // lookahead decides; it is pushed back for the text parser.
+  //
+  int c = getc(f);
+  if (c != (unsigned char) AST_BINARY_MAGIC[0]) {
+    if (c != EOF)
+      ungetc(c, f);
+    return false;
+  }
+  ungetc(c, f);
+
+  size_t size;
+  const unsigned char *start = slurp(f, size);
+  if (size < AST_BINARY_MAGIC_LEN + 4 ||
+      memcmp(start, AST_BINARY_MAGIC, AST_BINARY_MAGIC_LEN) != 0) {
+    cerr << "Corrupt binary AST input" << endl;
+    exit(1);
+  }
+
+  AstReader r(start + AST_BINARY_MAGIC_LEN, start + size);
+  ast_root = r.read();
+  return true;
+}
@@ -0,0 +1,98 @@
+//
+// See copyright.h for copyright notice and limitation of liability
+// and disclaimer of warranty provisions.
+//
+#include "copyright.h"
+
+#ifndef _AST_BINARY_H_
+#define _AST_BINARY_H_
+
+//////////////////////////////////////////////////////////////////////////
+//
+//  ast-binary.h
+//
+//  A compact binary form of the typed AST, as an alternative to the text
+//  produced by dump_with_types.  Reading it needs no scanning or parsing:
+//  the loader maps the file into memory and rebuilds the cool-tree.h node
+//  graph directly.  The code generator picks the format by looking at the
+//  first bytes of its input.
+//
+//  Layout (all integers are 32-bit little endian):
+//
+//     magic      "\177COOLAST"
+//     version    AST_BINARY_VERSION
+//     idtable, stringtable, inttable, each as
+//        count, then count times:  length, bytes, '\0'
+//     the program node
+//
+//  Nodes are written in preorder.  Each node is its kind (one byte, see
+//  AstKind) and its line number, then for an Expression its type (symbol
+//  index + 1, or 0 for no type), then its components in the order of the
+//  constructor arguments.  A symbol is its index in the table its
+//  component belongs to, a list is its length followed by its elements,
+//  and a Boolean is one byte.
+//
+//  The tables are written in index order and read back in the same order,
+//  so every symbol gets the same index it had when the AST was written.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include "cool-tree.h"
+
+#define AST_BINARY_MAGIC     "\177COOLAST"
+#define AST_BINARY_MAGIC_LEN 8
+#define AST_BINARY_VERSION   1
+
+enum AstKind {
+  AST_PROGRAM, AST_CLASS, AST_METHOD, AST_ATTR, AST_FORMAL, AST_BRANCH,
+  AST_ASSIGN, AST_STATIC_DISPATCH, AST_DISPATCH, AST_COND, AST_LOOP,
+  AST_TYPCASE, AST_BLOCK, AST_LET, AST_PLUS, AST_SUB, AST_MUL, AST_DIVIDE,
+  AST_NEG, AST_LT, AST_EQ, AST_LEQ, AST_COMP, AST_INT_CONST, AST_BOOL_CONST,
+  AST_STRING_CONST, AST_NEW, AST_ISVOID, AST_NO_EXPR, AST_OBJECT
+};
+
+//
+// AstWriter is handed to write_binary on every node.  The node writes its
+// own header and components through it.
+//
+// With by_name set, symbols are written as their length and characters
+// instead of their index.  That form cannot be read back, but it does not
+// depend on the order in which the tables were filled, which makes it a
+// good thing to hash (see the class code cache in cgen.cc).
+//
+class AstWriter {
+private:
+  ostream& str;
+  bool by_name;
+public:
+  AstWriter(ostream& s, bool by_name = false) : str(s), by_name(by_name) { }
+
+  void put_byte(int b);
+  void put_int(int i);
+  void put_symbol(Symbol sym);
+  void put_header(int kind, tree_node *node);
+  void put_header(int kind, Expression_class *expr);
+  void put_tables();
+
+  template <class Elem> void put_list(list_node<Elem> *l)
+  {
+    put_int(l->len());
+    for (int i = l->first(); l->more(i); i = l->next(i))
+      l->nth(i)->write_binary(*this);
+  }
+};
+
+//
+// Write program p to s in binary form.
+//
+void ast_binary_write(ostream& s, Program p);
+
+//
+// If f starts with the binary magic, load the program it holds into
+// ast_root and return true.  Otherwise leave f as it was (so the text
+// parser can read it) and return false.
+//
+bool ast_binary_read(FILE *f);
+
+#endif
@@ -0,0 +1,168 @@
+//
+// See copyright.h for copyright notice and limitation of liability
+// and disclaimer of warranty provisions.
+//
+#include "copyright.h"
+
+//////////////////////////////////////////////////////////////////////////
+//
+//  cgen-bench
+//
+//  Measures what the in-process entry point (cgen-lib.h) saves over the
+//  pipe pipeline.  The AST in ast-file is loaded once and stands in for
+//  the Program a front end has built in memory.  Each run then hands it
+//  to the code generator in one of two ways:
+//
+//     pipe        print it with dump_with_types into a pipe to a cgen
+//                 process, which parses it back and generates code, as
+//                 `semant | cgen' does in mycoolc
+//     in process  call cgen_program on it directly
+//
+//  Both write the assembly to /dev/null.  The best wall-clock time of
+//  each is reported.
+//
+//  usage: cgen-bench [flags] ast-file [cgen-binary [runs]]
+//
+//  The flags are the usual cgen flags; they apply to the in-process runs
+//  and are passed on to the cgen process.  cgen-binary defaults to ./cgen
+//  and runs to 5.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "cool-io.h"
+#include "cool-tree.h"
+#include "ast-binary.h"
+#include "cgen-lib.h"
+
+extern int optind;            // for option processing
+extern Program ast_root;      // root of the abstract syntax tree
+FILE *ast_file;               // the AST reader reads from here
+extern int ast_yyparse(void); // entry point to the AST parser
+
+int cool_yydebug;     // not used, but needed to link with handle_flags
+char *curr_filename;
+
+void handle_flags(int argc, char *argv[]);
+
+static double now() {
+  return std::chrono::duration<double>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//
+// One run of `semant | cgen': dump the AST as text into a pipe to a cgen
+// process and wait for it to finish.
+//
+static double run_pipe(const char *cgen, char **flags, int nflags) {
+  double start = now();
+
+  int fds[2];
+  if (pipe(fds) < 0) {
+    perror("pipe");
+    exit(1);
+  }
+
+  pid_t pid = fork();
+  if (pid < 0) {
+    perror("fork");
+    exit(1);
+  }
+  if (pid == 0) {
+    int null_fd = open("/dev/null", O_WRONLY);
+    dup2(fds[0], 0);
+    dup2(null_fd, 1);
+    close(fds[0]);
+    close(fds[1]);
+    close(null_fd);
+
+    std::vector<char *> args;
+    args.push_back((char *) cgen);
+    for (int i = 0; i < nflags; i++)
+      args.push_back(flags[i]);
+    args.push_back(NULL);
+    execv(cgen, args.data());
+    perror(cgen);
+    _exit(127);
+  }
+  close(fds[0]);
+
+  std::ostringstream text;
+  ast_root->dump_with_types(text, 0);
+  std::string s = text.str();
+  for (size_t done = 0; done < s.size(); ) {
+    ssize_t n = write(fds[1], s.data() + done, s.size() - done);
+    if (n < 0) {
+      perror("write");
+      exit(1);
+    }
+    done += n;
+  }
+  close(fds[1]);
+
+  int status;
+  waitpid(pid, &status, 0);
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    cerr << cgen << " failed" << endl;
+    exit(1);
+  }
+  return now() - start;
+}
+
+//
+// One run of the code generator on the Program already in memory.
+//
+static double run_in_process() {
+  double start = now();
+  ofstream null("/dev/null");
+  cgen_program(ast_root, idtable, stringtable, inttable, null);
+  return now() - start;
+}
+
+int main(int argc, char *argv[]) {
+  handle_flags(argc, argv);
+  if (optind >= argc) {
+    cerr << "usage: " << argv[0]
+         << " [flags] ast-file [cgen-binary [runs]]" << endl;
+    exit(1);
+  }
+
+  const char *ast_filename = argv[optind];
+  const char *cgen = optind + 1 < argc ? argv[optind + 1] : "./cgen";
+  int runs = optind + 2 < argc ? atoi(argv[optind + 2]) : 5;
+
+  ast_file = fopen(ast_filename, "r");
+  if (!ast_file) {
+    cerr << "Cannot open input file " << ast_filename << endl;
+    exit(1);
+  }
+  if (!ast_binary_read(ast_file))
+    ast_yyparse();
+  fclose(ast_file);
+
+  double best_pipe = 0, best_lib = 0;
+  for (int i = 0; i < runs; i++) {
+    double t = run_pipe(cgen, argv + 1, optind - 1);
+    if (i == 0 || t < best_pipe)
+      best_pipe = t;
+    t = run_in_process();
+    if (i == 0 || t < best_lib)
+      best_lib = t;
+  }
+
+  cout << "pipe:       " << best_pipe << "s" << endl;
+  cout << "in process: " << best_lib << "s" << endl;
+  if (best_pipe > 0)
+    cout << "saved:      " << best_pipe - best_lib << "s ("
+         << 100 * (best_pipe - best_lib) / best_pipe << "%)" << endl;
+  return 0;
+}
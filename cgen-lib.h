@@ -0,0 +1,42 @@
+//
+// See copyright.h for copyright notice and limitation of liability
+// and disclaimer of warranty provisions.
+//
+#include "copyright.h"
+
+#ifndef _CGEN_LIB_H_
+#define _CGEN_LIB_H_
+
+//////////////////////////////////////////////////////////////////////////
+//
+//  cgen-lib.h
+//
+//  The code generator as a library.  The cgen binary reads the AST that
+//  the semantic analyzer prints and then calls cgen_program.  A front end
+//  that runs in the same process can build and type check the Program
+//  itself and call cgen_program directly, so the AST is never written out
+//  as text and parsed back in.
+//
+//  Link with every object of the cgen binary except cgen-phase.o (which
+//  holds main).  The caller must also define the globals cgen-phase.cc
+//  defines for the AST reader: ast_file, curr_filename and cool_yydebug.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "cool-tree.h"
+#include "stringtab.h"
+
+//
+// Generate code for program p and write the assembly to os.
+//
+// p must be a type checked Program built in this process.  Every Symbol
+// in it must have been interned in ids, strs and ints, which must be the
+// process-wide idtable, stringtable and inttable; the code generator adds
+// its own names and constants to the same tables.  The flags that
+// handle_flags sets (cgen_debug, cgen_jobs, cgen_Memmgr, ...) are read
+// as they are when cgen_program is called.
+//
+void cgen_program(Program p, IdTable& ids, StrTable& strs, IntTable& ints,
+                  ostream& os);
+
+#endif
@@ -4,9 +4,12 @@
 #include "cool-io.h"  //includes iostream
 #include "cool-tree.h"
 #include "cgen_gc.h"
+#include "ast-binary.h"
+#include "cgen-lib.h"
 
 extern int optind;            // for option processing
 extern char *out_filename;    // name of output assembly
+extern char *ast_binary_filename; // -b: write the AST here in binary form
 extern Program ast_root;             // root of the abstract syntax tree
 FILE *ast_file = stdin;       // we read the AST from standard input
 extern int ast_yyparse(void); // entry point to the AST parser
@@ -34,7 +37,21 @@ int main(int argc, char *argv[]) {
   // Don't touch the output file until we know that earlier phases of the
   // compiler have succeeded.
   //
-  ast_yyparse();
+  // The input is a binary AST if it starts with the binary magic, and
+  // the text AST printed by the semantic analyzer otherwise.
+  //
+  if (!ast_binary_read(ast_file))
+      ast_yyparse();
+
+  if (ast_binary_filename) {   // only convert the AST to binary form
+      ofstream b(ast_binary_filename);
+      if (!b) {
+	  cerr << "Cannot open output file " << ast_binary_filename << endl;
+	  exit(1);
+      }
+      ast_binary_write(b, ast_root);
+      return 0;
+  }
 
   if (out_filename) {
       ofstream s(out_filename);
@@ -42,9 +59,10 @@ int main(int argc, char *argv[]) {
 	  cerr << "Cannot open output file " << out_filename << endl;
 	  exit(1);
       }
-      ast_root->cgen(s);
+      cgen_program(ast_root, idtable, stringtable, inttable, s);
   } else {
-      ast_root->cgen(cout);
+      cgen_program(ast_root, idtable, stringtable, inttable, cout);
   }
+  ast_arena_release();       // the whole AST at once
 }
 
@@ -41,15 +41,30 @@
 #include <algorithm>
 #include <map>
 #include <stack>
+#include <atomic>
+#include <functional>
+#include <sstream>
+#include <thread>
+#include <time.h>
+#include <stdint.h>
+#include <limits.h>
 
 #include "cgen.h"
+#include "cgen-lib.h"
 #include "cgen_gc.h"
+#include "cgen_cache.h"
+#include "cgen_passes.h"
+#include "ast-binary.h"
 
 extern void emit_string_constant(ostream& str, char* s);
 extern int cgen_debug;
+extern int cgen_jobs;
+extern int cgen_inline_size;
+extern int cgen_optimize;
+extern bool disable_reg_alloc;
+extern char* cgen_cache_dir;
+extern char* cgen_passes;
 
-int labelnum = 0;
-// 全局标签计数器，用于生成唯一的跳转标签
 CgenClassTable* codegen_classtable = nullptr;
 // 全局代码生成类表指针，指向当前正在构建的类表
 
@@ -160,14 +175,110 @@ void program_class::cgen(ostream& os) {
 
 // 程序类的代码生成入口函数
 // 由编译器驱动程序调用，负责启动整个代码生成过程
+    // The assembly is collected in memory and handed to `os' in a few large
+    // writes at the end, so no emit_* call ever reaches the file directly.
+    if (cgen_passes != nullptr && !cgen_select_passes(cgen_passes)) {
+        exit(1);
+    }
+    if (disable_reg_alloc) {
+        cgen_select_passes("no-regalloc");
+    }
+
+    AsmBuf asm_buf;
+    ostream asm_os(&asm_buf);
+    clock_t start = clock();
+
     // spim wants comments to start with '#'
-    os << "# start of generated code\n";
+    asm_os << "# start of generated code\n";
 
     initialize_constants();
-    codegen_classtable = new CgenClassTable(classes, os);
+    codegen_classtable = new CgenClassTable(classes, asm_os);
     codegen_classtable->Execute();
 
-    os << "\n# end of generated code\n";
+    asm_os << "\n# end of generated code\n";
+
+    clock_t generated = clock();
+    asm_buf.WriteTo(os);
+    os.flush();
+    clock_t written = clock();
+
+    if (cgen_debug) {
+        // The text is emitted while the code is generated, so the first
+        // figure is the whole of code generation; the throughput is that
+        // of the writes from the buffer to the output.
+        double gen_secs = double(generated - start) / CLOCKS_PER_SEC;
+        double write_secs = double(written - generated) / CLOCKS_PER_SEC;
+        double mbytes = asm_buf.Size() / (1024.0 * 1024.0);
+        cout << "generated " << asm_buf.Size() << " bytes in " << gen_secs
+             << "s, written in " << write_secs << "s";
+        if (write_secs > 0) {
+            cout << " (" << mbytes / write_secs << " MB/s)";
+        }
+        cout << endl;
+        ast_arena_report(cout);
+        if (cgen_optimize) {
+            cgen_passes_report(cout);
+        }
+    }
+}
+
+// 库形式的代码生成入口（见cgen-lib.h），供同一进程中的前端直接调用
+void cgen_program(Program p, IdTable& ids, StrTable& strs, IntTable& ints,
+                  ostream& os) {
+    // The code generator interns its names and constants in the global
+    // tables, so the program's symbols must live there too.
+    assert(&ids == &idtable && &strs == &stringtable && &ints == &inttable);
+    p->cgen(os);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+//  AsmBuf
+//
+//  An in-memory stream buffer for the generated assembly. Text goes into a
+//  list of large chunks that are never reallocated, and sync() is a no-op,
+//  so the `endl' at the end of every emitted line costs nothing. WriteTo
+//  copies the chunks to the real output stream, one write per chunk.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+AsmBuf::AsmBuf() : m_full_bytes(0) {
+}
+
+AsmBuf::~AsmBuf() {
+    for (char* chunk : m_chunks) {
+        delete[] chunk;
+    }
+}
+
+void AsmBuf::NewChunk() {
+    if (!m_chunks.empty()) {
+        m_full_bytes += pptr() - pbase();
+    }
+    char* chunk = new char[ASMBUF_CHUNK];
+    m_chunks.push_back(chunk);
+    setp(chunk, chunk + ASMBUF_CHUNK);
+}
+
+AsmBuf::int_type AsmBuf::overflow(int_type c) {
+    if (traits_type::eq_int_type(c, traits_type::eof())) {
+        return traits_type::not_eof(c);
+    }
+    NewChunk();
+    *pptr() = traits_type::to_char_type(c);
+    pbump(1);
+    return c;
+}
+
+size_t AsmBuf::Size() const {
+    return m_full_bytes + (pptr() - pbase());
+}
+
+void AsmBuf::WriteTo(ostream& os) {
+    for (size_t i = 0; i < m_chunks.size(); ++i) {
+        bool last = (i + 1 == m_chunks.size());
+        os.write(m_chunks[i], last ? pptr() - pbase() : ASMBUF_CHUNK);
+    }
 }
 
 
@@ -175,109 +286,178 @@ void program_class::cgen(ostream& os) {
 //
 //  emit_* procedures
 //
-//  emit_X  writes code for operation "X" to the output stream.
-//  There is an emit_X for each opcode X, as well as emit_ functions
-//  for generating names according to the naming conventions (see emit.h)
-//  and calls to support functions defined in the trap handler.
+//  emit_X  appends an instruction for operation "X" to the instruction list
+//  of the method being generated.  There is an emit_X for each opcode X,
+//  as well as emit_ functions for generating names according to the naming
+//  conventions (see emit.h) and calls to support functions defined in the
+//  trap handler.  Nothing is formatted here; MipsFunc::Print turns the list
+//  into assembly text once the method is complete.
 //
-//  Register names and addresses are passed as strings.  See `emit.h'
-//  for symbolic names you can use to refer to the strings.
+//  Registers are passed as register numbers and addresses either as
+//  strings or as symbols.  See `emit.h' for symbolic names you can use to
+//  refer to the registers.
 //
 //////////////////////////////////////////////////////////////////////////////
 
-static void emit_load(const char* dest_reg, int offset, const char* source_reg, ostream& s) {
+static void emit_load(int dest_reg, int offset, int source_reg, MipsFunc& s) {
 
 // MIPS指令生成辅助函数：加载内存值到寄存器
 // 生成LW指令，从内存地址(source_reg+offset*4)加载值到dest_reg
-    s << LW << dest_reg << " " << offset* WORD_SIZE << "(" << source_reg << ")"
-      << endl;
+    MipsInst& i = s.Append(MIPS_LW);
+    i.rd = dest_reg;
+    i.imm = offset * WORD_SIZE;
+    i.rs = source_reg;
+}
+
+static void emit_store(int source_reg, int offset, int dest_reg, MipsFunc& s) {
+    MipsInst& i = s.Append(MIPS_SW);
+    i.rd = source_reg;
+    i.imm = offset * WORD_SIZE;
+    i.rs = dest_reg;
+}
+
+static void emit_load_imm(int dest_reg, int val, MipsFunc& s) {
+    MipsInst& i = s.Append(MIPS_LI);
+    i.rd = dest_reg;
+    i.imm = val;
+}
+
+static void emit_load_address(int dest_reg, const char* address, MipsFunc& s) {
+    MipsInst& i = s.Append(MIPS_LA);
+    i.rd = dest_reg;
+    i.addr = ADDR_NAME;
+    i.text = address;
+}
+
+static void emit_load_symbol(int dest_reg, MipsAddr kind, Symbol sym, MipsFunc& s) {
+    MipsInst& i = s.Append(MIPS_LA);
+    i.rd = dest_reg;
+    i.addr = kind;
+    i.sym = sym;
+}
+
+static void emit_load_label(int dest_reg, int label, MipsFunc& s) {
+    MipsInst& i = s.Append(MIPS_LA);
+    i.rd = dest_reg;
+    i.addr = ADDR_LABEL;
+    i.label = label;
+}
+
+static void emit_load_bool(int dest, const BoolConst& b, MipsFunc& s) {
+    MipsInst& i = s.Append(MIPS_LA);
+    i.rd = dest;
+    i.addr = ADDR_BOOL;
+    i.imm = b.get_val();
+}
+
+static void emit_load_string(int dest, StringEntry* str, MipsFunc& s) {
+    emit_load_symbol(dest, ADDR_STR, str, s);
 }
 
-static void emit_store(const char* source_reg, int offset, const char* dest_reg, ostream& s) {
-    s << SW << source_reg << " " << offset* WORD_SIZE << "(" << dest_reg << ")"
-      << endl;
+static void emit_load_int(int dest, IntEntry* i, MipsFunc& s) {
+    emit_load_symbol(dest, ADDR_INT, i, s);
 }
 
-static void emit_load_imm(const char* dest_reg, int val, ostream& s) {
-    s << LI << dest_reg << " " << val << endl;
+static void emit_rr(MipsOp op, int dest, int src1, MipsFunc& s) {
+    MipsInst& i = s.Append(op);
+    i.rd = dest;
+    i.rs = src1;
 }
 
-static void emit_load_address(const char* dest_reg, const char* address, ostream& s) {
-    s << LA << dest_reg << " " << address << endl;
+static void emit_rrr(MipsOp op, int dest, int src1, int src2, MipsFunc& s) {
+    MipsInst& i = s.Append(op);
+    i.rd = dest;
+    i.rs = src1;
+    i.rt = src2;
 }
 
-static void emit_partial_load_address(const char* dest_reg, ostream& s) {
-    s << LA << dest_reg << " ";
+static void emit_rri(MipsOp op, int dest, int src1, int imm, MipsFunc& s) {
+    MipsInst& i = s.Append(op);
+    i.rd = dest;
+    i.rs = src1;
+    i.imm = imm;
 }
 
-static void emit_load_bool(const char* dest, const BoolConst& b, ostream& s) {
-    emit_partial_load_address(dest, s);
-    b.code_ref(s);
-    s << endl;
+static void emit_move(int dest_reg, int source_reg, MipsFunc& s) {
+    emit_rr(MIPS_MOVE, dest_reg, source_reg, s);
 }
 
-static void emit_load_string(const char* dest, StringEntry* str, ostream& s) {
-    emit_partial_load_address(dest, s);
-    str->code_ref(s);
-    s << endl;
+static void emit_neg(int dest, int src1, MipsFunc& s) {
+    emit_rr(MIPS_NEG, dest, src1, s);
 }
 
-static void emit_load_int(const char* dest, IntEntry* i, ostream& s) {
-    emit_partial_load_address(dest, s);
-    i->code_ref(s);
-    s << endl;
+static void emit_add(int dest, int src1, int src2, MipsFunc& s) {
+    emit_rrr(MIPS_ADD, dest, src1, src2, s);
 }
 
-static void emit_move(const char* dest_reg, const char* source_reg, ostream& s) {
-    s << MOVE << dest_reg << " " << source_reg << endl;
+static void emit_addu(int dest, int src1, int src2, MipsFunc& s) {
+    emit_rrr(MIPS_ADDU, dest, src1, src2, s);
 }
 
-static void emit_neg(const char* dest, const char* src1, ostream& s) {
-    s << NEG << dest << " " << src1 << endl;
+static void emit_addiu(int dest, int src1, int imm, MipsFunc& s) {
+    emit_rri(MIPS_ADDIU, dest, src1, imm, s);
 }
 
-static void emit_add(const char* dest, const char* src1, const char* src2, ostream& s) {
-    s << ADD << dest << " " << src1 << " " << src2 << endl;
+static void emit_div(int dest, int src1, int src2, MipsFunc& s) {
+    emit_rrr(MIPS_DIV, dest, src1, src2, s);
 }
 
-static void emit_addu(const char* dest, const char* src1, const char* src2, ostream& s) {
-    s << ADDU << dest << " " << src1 << " " << src2 << endl;
+static void emit_mul(int dest, int src1, int src2, MipsFunc& s) {
+    emit_rrr(MIPS_MUL, dest, src1, src2, s);
 }
 
-static void emit_addiu(const char* dest, const char* src1, int imm, ostream& s) {
-    s << ADDIU << dest << " " << src1 << " " << imm << endl;
+static void emit_sub(int dest, int src1, int src2, MipsFunc& s) {
+    emit_rrr(MIPS_SUB, dest, src1, src2, s);
 }
 
-static void emit_div(const char* dest, const char* src1, const char* src2, ostream& s) {
-    s << DIV << dest << " " << src1 << " " << src2 << endl;
+static void emit_sll(int dest, int src1, int num, MipsFunc& s) {
+    emit_rri(MIPS_SLL, dest, src1, num, s);
 }
 
-static void emit_mul(const char* dest, const char* src1, const char* src2, ostream& s) {
-    s << MUL << dest << " " << src1 << " " << src2 << endl;
+static void emit_jalr(int dest, MipsFunc& s) {
+    s.Append(MIPS_JALR).rd = dest;
 }
 
-static void emit_sub(const char* dest, const char* src1, const char* src2, ostream& s) {
-    s << SUB << dest << " " << src1 << " " << src2 << endl;
+static void emit_jr(int source, MipsFunc& s) {
+    s.Append(MIPS_JR).rd = source;
 }
 
-static void emit_sll(const char* dest, const char* src1, int num, ostream& s) {
-    s << SLL << dest << " " << src1 << " " << num << endl;
+static void emit_jal(const char* address, MipsFunc& s) {
+    MipsInst& i = s.Append(MIPS_JAL);
+    i.addr = ADDR_NAME;
+    i.text = address;
 }
 
-static void emit_jalr(const char* dest, ostream& s) {
-    s << JALR << "\t" << dest << endl;
+static void emit_jal_method(Symbol classname, Symbol method, MipsFunc& s) {
+    MipsInst& i = s.Append(MIPS_JAL);
+    i.addr = ADDR_METHOD;
+    i.sym = classname;
+    i.sym2 = method;
 }
 
-static void emit_jal(const char* address, ostream& s) {
-    s << JAL << address << endl;
+static void emit_load_method(int dest_reg, Symbol classname, Symbol method,
+                             MipsFunc& s) {
+    MipsInst& i = s.Append(MIPS_LA);
+    i.rd = dest_reg;
+    i.addr = ADDR_METHOD;
+    i.sym = classname;
+    i.sym2 = method;
 }
 
-static void emit_return(ostream& s) {
-    s << RET << endl;
+static void emit_jal_init(Symbol classname, MipsFunc& s) {
+    MipsInst& i = s.Append(MIPS_JAL);
+    i.addr = ADDR_INIT;
+    i.sym = classname;
 }
 
-static void emit_gc_assign(ostream& s) {
-    s << JAL << "_GenGC_Assign" << endl;
+static void emit_return(MipsFunc& s) {
+    s.Append(MIPS_RET);
+}
+
+// The write barrier for a pointer just stored at offset words from reg.
+static void emit_gc_assign(int reg, int offset, MipsFunc& s) {
+    emit_addiu(A1, reg, 4 * offset, s);
+    emit_jal("_GenGC_Assign", s);
 }
 
 static void emit_disptable_ref(Symbol sym, ostream& s) {
@@ -300,63 +480,81 @@ static void emit_method_ref(Symbol classname, Symbol methodname, ostream& s) {
     s << classname << METHOD_SEP << methodname;
 }
 
-static void emit_label_def(int l, ostream& s) {
-    emit_label_ref(l, s);
-    s << ":" << endl;
+static void emit_label_def(int l, MipsFunc& s) {
+    s.Append(MIPS_LABEL).label = l;
+}
+
+static void emit_branch_rr(MipsOp op, int src1, int src2, int label, MipsFunc& s) {
+    MipsInst& i = s.Append(op);
+    i.rd = src1;
+    i.rs = src2;
+    i.label = label;
+}
+
+static void emit_branch_ri(MipsOp op, int src1, int imm, int label, MipsFunc& s) {
+    MipsInst& i = s.Append(op);
+    i.rd = src1;
+    i.imm = imm;
+    i.label = label;
+}
+
+static void emit_beqz(int source, int label, MipsFunc& s) {
+    MipsInst& i = s.Append(MIPS_BEQZ);
+    i.rd = source;
+    i.label = label;
 }
 
-static void emit_beqz(char* source, int label, ostream& s) {
-    s << BEQZ << source << " ";
-    emit_label_ref(label, s);
-    s << endl;
+static void emit_beq(int src1, int src2, int label, MipsFunc& s) {
+    emit_branch_rr(MIPS_BEQ, src1, src2, label, s);
 }
 
-static void emit_beq(const char* src1, const char* src2, int label, ostream& s) {
-    s << BEQ << src1 << " " << src2 << " ";
-    emit_label_ref(label, s);
-    s << endl;
+static void emit_bne(int src1, int src2, int label, MipsFunc& s) {
+    emit_branch_rr(MIPS_BNE, src1, src2, label, s);
 }
 
-static void emit_bne(const char* src1, const char* src2, int label, ostream& s) {
-    s << BNE << src1 << " " << src2 << " ";
-    emit_label_ref(label, s);
-    s << endl;
+static void emit_bleq(int src1, int src2, int label, MipsFunc& s) {
+    emit_branch_rr(MIPS_BLEQ, src1, src2, label, s);
 }
 
-static void emit_bleq(const char* src1, const char* src2, int label, ostream& s) {
-    s << BLEQ << src1 << " " << src2 << " ";
-    emit_label_ref(label, s);
-    s << endl;
+static void emit_blt(int src1, int src2, int label, MipsFunc& s) {
+    emit_branch_rr(MIPS_BLT, src1, src2, label, s);
 }
 
-static void emit_blt(const char* src1, const char* src2, int label, ostream& s) {
-    s << BLT << src1 << " " << src2 << " ";
-    emit_label_ref(label, s);
-    s << endl;
+static void emit_blti(int src1, int imm, int label, MipsFunc& s) {
+    emit_branch_ri(MIPS_BLTI, src1, imm, label, s);
 }
 
-static void emit_blti(const char* src1, int imm, int label, ostream& s) {
-    s << BLT << src1 << " " << imm << " ";
-    emit_label_ref(label, s);
-    s << endl;
+static void emit_bgti(int src1, int imm, int label, MipsFunc& s) {
+    emit_branch_ri(MIPS_BGTI, src1, imm, label, s);
 }
 
-static void emit_bgti(const char* src1, int imm, int label, ostream& s) {
-    s << BGT << src1 << " " << imm << " ";
-    emit_label_ref(label, s);
-    s << endl;
+static void emit_blei(int src1, int imm, int label, MipsFunc& s) {
+    emit_branch_ri(MIPS_BLEI, src1, imm, label, s);
 }
 
-static void emit_branch(int l, ostream& s) {
-    s << BRANCH;
-    emit_label_ref(l, s);
-    s << endl;
+static void emit_branch(int l, MipsFunc& s) {
+    s.Append(MIPS_B).label = l;
+}
+
+//
+// A line of text kept verbatim in the instruction list: an assembly
+// comment, or an empty line when text is "".  A non-NULL sym is printed
+// right after the text.
+//
+static void emit_comment(const char* text, MipsFunc& s) {
+    s.Append(MIPS_COMMENT).text = text;
+}
+
+static void emit_comment(const char* text, Symbol sym, MipsFunc& s) {
+    MipsInst& i = s.Append(MIPS_COMMENT);
+    i.text = text;
+    i.sym = sym;
 }
 
 //
 // Push a register on the stack. The stack grows towards smaller addresses.
 //
-static void emit_push(char* reg, ostream& str) {
+static void emit_push(int reg, MipsFunc& str) {
     emit_store(reg, 0, SP, str);
     emit_addiu(SP, SP, -4, str);
 }
@@ -366,7 +564,7 @@ static void emit_push(char* reg, ostream& str) {
 // Emits code to fetch the integer value of the Integer object pointed
 // to by register source into the register dest
 //
-static void emit_fetch_int(const char* dest, char* source, ostream& s) {
+static void emit_fetch_int(int dest, int source, MipsFunc& s) {
     emit_load(dest, DEFAULT_OBJFIELDS, source, s);
 }
 
@@ -374,25 +572,315 @@ static void emit_fetch_int(const char* dest, char* source, ostream& s) {
 // Emits code to store the integer value contained in register source
 // into the Integer object pointed to by dest.
 //
-static void emit_store_int(char* source, const char* dest, ostream& s) {
+static void emit_store_int(int source, int dest, MipsFunc& s) {
     emit_store(source, DEFAULT_OBJFIELDS, dest, s);
 }
 
 
-static void emit_test_collector(ostream& s) {
+static void emit_test_collector(MipsFunc& s) {
     emit_push(ACC, s);
     emit_move(ACC, SP, s); // stack end
     emit_move(A1, ZERO, s); // allocate nothing
-    s << JAL << gc_collect_names[cgen_Memmgr] << endl;
+    emit_jal(gc_collect_names[cgen_Memmgr], s);
     emit_addiu(SP, SP, 4, s);
     emit_load(ACC, 0, SP, s);
 }
 
-static void emit_gc_check(char* source, ostream& s) {
-    if (std::string(source) != std::string(A1)) {
+static void emit_gc_check(int source, MipsFunc& s) {
+    if (source != A1) {
         emit_move(A1, source, s);
     }
-    s << JAL << "_gc_check" << endl;
+    emit_jal("_gc_check", s);
+}
+
+//
+// Allocate a copy of the prototype object of class_name into ACC, as
+// Object.copy does.  With -O (pass "alloc") a small object is allocated
+// inline: $gp is bumped past the eyecatcher and the object, the
+// collector is called only when that passes the heap limit in $s7, and
+// the prototype is copied word by word.  Clobbers T1, T2, T3 and A1,
+// which Object.copy may clobber too.
+//
+#define ALLOC_INLINE_MAX_WORDS 16
+
+// Allocation sites generated inline; printed with -c.
+static std::atomic<long> inline_allocs;
+
+static void emit_new_object(Symbol class_name, MipsFunc& s) {
+    CgenNode* class_node = codegen_classtable->GetClassNode(class_name);
+    int words = DEFAULT_OBJFIELDS + class_node->GetFullAttribs().size();
+    if (!cgen_pass_enabled(PASS_ALLOC) || words > ALLOC_INLINE_MAX_WORDS) {
+        emit_load_symbol(ACC, ADDR_PROTOBJ, class_name, s);
+        emit_jal("Object.copy", s);
+        return;
+    }
+    if (!cgen_passes_measuring()) {
+        ++inline_allocs;
+    }
+    int bytes = 4 * (words + 1);
+
+    if (cgen_Memmgr_Test == GC_TEST) {
+        emit_test_collector(s);
+    }
+    emit_comment("\t# Allocate: t1 = gp + size, collect if past the heap limit", s);
+    int allocated = s.NewLabel();
+    emit_addiu(T1, HEAP_PTR, bytes, s);
+    emit_blt(T1, HEAP_LIMIT, allocated, s);
+    emit_addiu(ACC, SP, 4, s);  // end of the stack, as _MemMgr_Alloc passes it
+    emit_load_imm(A1, bytes, s);
+    emit_jal(gc_collect_names[cgen_Memmgr], s);
+    emit_addiu(T1, HEAP_PTR, bytes, s);
+    emit_label_def(allocated, s);
+
+    emit_comment("\t# eyecatcher, then copy the prototype", s);
+    emit_load_imm(T2, -1, s);
+    emit_store(T2, 0, HEAP_PTR, s);
+    emit_addiu(ACC, HEAP_PTR, 4, s);
+    emit_move(HEAP_PTR, T1, s);
+    emit_load_symbol(T2, ADDR_PROTOBJ, class_name, s);
+    for (int i = 0; i < words; ++i) {
+        emit_load(T3, i, T2, s);
+        emit_store(T3, i, ACC, s);
+    }
+    if (cgen_Memmgr_Debug == GC_DEBUG) {
+        emit_gc_check(ACC, s);
+    }
+    emit_comment("", s);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+//
+//  Printing the instruction list
+//
+//  The only place where instructions become text.  The output is exactly
+//  what the emit_* procedures used to write directly.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+static const char* mips_reg_names[32] = {
+    "$zero", "$at", "$v0", "$v1", "$a0", "$a1", "$a2", "$a3",
+    "$t0", "$t1", "$t2", "$t3", "$t4", "$t5", "$t6", "$t7",
+    "$s0", "$s1", "$s2", "$s3", "$s4", "$s5", "$s6", "$s7",
+    "$t8", "$t9", "$k0", "$k1", "$gp", "$sp", "$fp", "$ra"
+};
+
+//
+// In relocatable text (for the class code cache, see cgen_cache.h) label
+// numbers and constant references are written as markers, which
+// relocate_class_text later turns into the real names.
+//
+static void print_label(int l, bool relocatable, ostream& s) {
+    if (relocatable) {
+        s << CGEN_CACHE_RELOC << 'L' << l << ':';
+    } else {
+        emit_label_ref(l, s);
+    }
+}
+
+static void print_reloc_const(char kind, Symbol sym, ostream& s) {
+    s << CGEN_CACHE_RELOC << kind << sym->get_len() << ':';
+    s.write(sym->get_string(), sym->get_len());
+}
+
+static void print_addr(const MipsInst& i, int label_base, bool relocatable,
+                       ostream& s) {
+    switch (i.addr) {
+    case ADDR_NAME:
+        s << i.text;
+        break;
+    case ADDR_INT:
+        if (relocatable) {
+            print_reloc_const('I', i.sym, s);
+        } else {
+            ((IntEntry*)i.sym)->code_ref(s);
+        }
+        break;
+    case ADDR_STR:
+        if (relocatable) {
+            print_reloc_const('S', i.sym, s);
+        } else {
+            ((StringEntry*)i.sym)->code_ref(s);
+        }
+        break;
+    case ADDR_BOOL:
+        BoolConst(i.imm).code_ref(s);
+        break;
+    case ADDR_DISPTAB:
+        emit_disptable_ref(i.sym, s);
+        break;
+    case ADDR_PROTOBJ:
+        emit_protobj_ref(i.sym, s);
+        break;
+    case ADDR_INIT:
+        emit_init_ref(i.sym, s);
+        break;
+    case ADDR_METHOD:
+        emit_method_ref(i.sym, i.sym2, s);
+        break;
+    case ADDR_LABEL:
+        print_label(label_base + i.label, relocatable, s);
+        break;
+    }
+}
+
+static void print_inst(const MipsInst& i, int label_base, bool relocatable,
+                       ostream& s) {
+    const char* rd = mips_reg_names[i.rd];
+    const char* rs = mips_reg_names[i.rs];
+    const char* rt = mips_reg_names[i.rt];
+
+    switch (i.op) {
+    case MIPS_LW:
+        s << LW << rd << " " << i.imm << "(" << rs << ")" << endl;
+        break;
+    case MIPS_SW:
+        s << SW << rd << " " << i.imm << "(" << rs << ")" << endl;
+        break;
+    case MIPS_LI:
+        s << LI << rd << " " << i.imm << endl;
+        break;
+    case MIPS_LA:
+        s << LA << rd << " ";
+        print_addr(i, label_base, relocatable, s);
+        s << endl;
+        break;
+    case MIPS_MOVE:
+        s << MOVE << rd << " " << rs << endl;
+        break;
+    case MIPS_NEG:
+        s << NEG << rd << " " << rs << endl;
+        break;
+    case MIPS_ADD:
+        s << ADD << rd << " " << rs << " " << rt << endl;
+        break;
+    case MIPS_ADDU:
+        s << ADDU << rd << " " << rs << " " << rt << endl;
+        break;
+    case MIPS_ADDIU:
+        s << ADDIU << rd << " " << rs << " " << i.imm << endl;
+        break;
+    case MIPS_DIV:
+        s << DIV << rd << " " << rs << " " << rt << endl;
+        break;
+    case MIPS_MUL:
+        s << MUL << rd << " " << rs << " " << rt << endl;
+        break;
+    case MIPS_SUB:
+        s << SUB << rd << " " << rs << " " << rt << endl;
+        break;
+    case MIPS_SLL:
+        s << SLL << rd << " " << rs << " " << i.imm << endl;
+        break;
+    case MIPS_JALR:
+        s << JALR << "\t" << rd << endl;
+        break;
+    case MIPS_JAL:
+        s << JAL;
+        print_addr(i, label_base, relocatable, s);
+        s << endl;
+        break;
+    case MIPS_RET:
+        s << RET << endl;
+        break;
+    case MIPS_JR:
+        s << JR << rd << endl;
+        break;
+    case MIPS_BEQZ:
+        s << BEQZ << rd << " ";
+        print_label(label_base + i.label, relocatable, s);
+        s << endl;
+        break;
+    case MIPS_BEQ:
+        s << BEQ << rd << " " << rs << " ";
+        print_label(label_base + i.label, relocatable, s);
+        s << endl;
+        break;
+    case MIPS_BNE:
+        s << BNE << rd << " " << rs << " ";
+        print_label(label_base + i.label, relocatable, s);
+        s << endl;
+        break;
+    case MIPS_BLEQ:
+        s << BLEQ << rd << " " << rs << " ";
+        print_label(label_base + i.label, relocatable, s);
+        s << endl;
+        break;
+    case MIPS_BLT:
+        s << BLT << rd << " " << rs << " ";
+        print_label(label_base + i.label, relocatable, s);
+        s << endl;
+        break;
+    case MIPS_BGT:
+        s << BGT << rd << " " << rs << " ";
+        print_label(label_base + i.label, relocatable, s);
+        s << endl;
+        break;
+    case MIPS_BGE:
+        s << BGE << rd << " " << rs << " ";
+        print_label(label_base + i.label, relocatable, s);
+        s << endl;
+        break;
+    case MIPS_BLTI:
+        s << BLT << rd << " " << i.imm << " ";
+        print_label(label_base + i.label, relocatable, s);
+        s << endl;
+        break;
+    case MIPS_BGTI:
+        s << BGT << rd << " " << i.imm << " ";
+        print_label(label_base + i.label, relocatable, s);
+        s << endl;
+        break;
+    case MIPS_BLEI:
+        s << BLEQ << rd << " " << i.imm << " ";
+        print_label(label_base + i.label, relocatable, s);
+        s << endl;
+        break;
+    case MIPS_BGEI:
+        s << BGE << rd << " " << i.imm << " ";
+        print_label(label_base + i.label, relocatable, s);
+        s << endl;
+        break;
+    case MIPS_B:
+        s << BRANCH;
+        print_label(label_base + i.label, relocatable, s);
+        s << endl;
+        break;
+    case MIPS_LABEL:
+        print_label(label_base + i.label, relocatable, s);
+        s << ":" << endl;
+        break;
+    case MIPS_COMMENT:
+        s << i.text;
+        if (i.sym != nullptr) {
+            s << i.sym;
+        }
+        s << endl;
+        break;
+    }
+}
+
+void MipsFunc::Print(ostream& s, bool relocatable) const {
+    if (method_name != nullptr) {
+        emit_method_ref(class_name, method_name, s);
+    } else {
+        emit_init_ref(class_name, s);
+    }
+    s << LABEL;
+    for (const MipsInst& i : insts) {
+        print_inst(i, label_base, relocatable, s);
+    }
+    for (const MipsJumpTable& table : jump_tables) {
+        s << "\t.data\n" << ALIGN;
+        print_label(label_base + table.label, relocatable, s);
+        s << LABEL;
+        for (int target : table.targets) {
+            s << WORD;
+            print_label(label_base + target, relocatable, s);
+            s << endl;
+        }
+        s << "\t.text\n";
+    }
 }
 
 
@@ -548,6 +1036,62 @@ int Environment::AddObstacle() {
     return AddVar(No_class);
 }
 
+//
+// Temporaries and let and case variables live in the stack slots of the
+// Environment.  In a fixed frame (-O, pass "frame") a slot is a word at a
+// fixed offset below $fp and nothing moves $sp; otherwise each slot is
+// pushed when it is added and popped when it goes.  Actuals of a call
+// are always pushed, because the callee pops them; in a fixed frame they
+// lie below the frame and take no slot.
+//
+
+// Store reg in the slot added last to env.
+static void store_top_slot(int reg, MipsFunc& s, Environment& env) {
+    if (env.m_frame_base == -1) {
+        emit_push(reg, s);
+        return;
+    }
+    int base, offset;
+    env.TopSlotAddr(base, offset);
+    emit_store(reg, offset, base, s);
+}
+
+// Keep reg in a new anonymous slot, in a scope of its own.
+static void push_slot(int reg, MipsFunc& s, Environment& env) {
+    env.AddObstacle();
+    store_top_slot(reg, s, env);
+}
+
+// Load the value kept by push_slot into dest and free its slot.
+static void pop_slot(int dest, MipsFunc& s, Environment& env) {
+    int base, offset;
+    env.TopSlotAddr(base, offset);
+    env.ExitScope();
+    if (env.m_frame_base == -1) {
+        emit_addiu(SP, SP, 4, s);
+        emit_load(dest, 0, SP, s);
+    } else {
+        emit_load(dest, offset, base, s);
+    }
+}
+
+// Push ACC as an actual of a call.
+static void push_actual(MipsFunc& s, Environment& env) {
+    emit_push(ACC, s);
+    if (env.m_frame_base == -1) {
+        env.AddObstacle();
+    }
+}
+
+// The callee has popped the n actuals pushed by push_actual.
+static void actuals_popped(int n, Environment& env) {
+    if (env.m_frame_base == -1) {
+        for (int i = 0; i < n; ++i) {
+            env.ExitScope();
+        }
+    }
+}
+
 //////////////////////////////////////////////////////////////////////////////
 //
 //  CgenClassTable methods
@@ -664,12 +1208,6 @@ void CgenClassTable::code_select_gc() {
 //********************************************************
 
 void CgenClassTable::code_constants() {
-    //
-    // Add constants that are required by the code generator.
-    //
-    stringtable.add_string("");
-    inttable.add_string("0");
-
     stringtable.code_string_table(str, stringclasstag);
     inttable.code_string_table(str, intclasstag);
     code_bools(boolclasstag);
@@ -678,7 +1216,7 @@ void CgenClassTable::code_constants() {
 void CgenClassTable::code_class_nameTab() {
     str << CLASSNAMETAB << LABEL;
 
-    std::vector<CgenNode*> class_nodes = GetClassNodes();
+    const std::vector<CgenNode*>& class_nodes = GetClassNodes();
     for (CgenNode* class_node : class_nodes) {
         Symbol class_name = class_node->name;
         StringEntry* str_entry = stringtable.lookup_string(class_name->get_string());
@@ -697,7 +1235,7 @@ void CgenClassTable::code_class_nameTab() {
 void CgenClassTable::code_class_objTab() {
     str << CLASSOBJTAB << LABEL;
     // Find all class names.
-    std::vector<CgenNode*> class_nodes = GetClassNodes();
+    const std::vector<CgenNode*>& class_nodes = GetClassNodes();
     for (CgenNode* class_node : class_nodes) {
         Symbol class_name = class_node->name;
         StringEntry* str_entry = stringtable.lookup_string(class_name->get_string());
@@ -712,18 +1250,15 @@ void CgenClassTable::code_class_objTab() {
 }
 
 void CgenClassTable::code_dispatchTabs() {
-    std::vector<CgenNode*> class_nodes = GetClassNodes();
+    const std::vector<CgenNode*>& class_nodes = GetClassNodes();
 
     for (CgenNode* _class_node : class_nodes) {
         emit_disptable_ref(_class_node->name, str);
         str << LABEL;
-        std::vector<method_class*> full_methods = _class_node->GetFullMethods();
-        std::map<Symbol, Symbol> dispatch_class_tab = _class_node->GetDispatchClassTab();
-        std::map<Symbol, int> dispatch_idx_tab = _class_node->GetDispatchIdxTab();
-        for (method_class* _method : full_methods) {
-            Symbol _method_name = _method->name;
-            Symbol _class_name = dispatch_class_tab[_method_name];
-            int _idx = dispatch_idx_tab[_method_name];
+        const CgenLayout& layout = _class_node->GetLayout();
+        for (size_t _idx = 0; _idx < layout.methods.size(); ++_idx) {
+            Symbol _method_name = layout.methods[_idx]->name;
+            Symbol _class_name = layout.method_classes[_idx];
             str << "\t# method # " << _idx << endl;
             str << WORD;
             emit_method_ref(_class_name, _method_name, str);
@@ -732,61 +1267,46 @@ void CgenClassTable::code_dispatchTabs() {
     }
 }
 
-std::vector<CgenNode*> CgenClassTable::GetClassNodes() {
-    if (m_class_nodes.empty()) {
-        for (List<CgenNode> *l = nds; l; l = l->tl()) {
-            CgenNode* class_node = l->hd();
-            m_class_nodes.push_back(class_node);
-        }
-        std::reverse(m_class_nodes.begin(), m_class_nodes.end());
-        for (int i = 0; i < m_class_nodes.size(); ++i) {
-            m_class_nodes[i]->class_tag = i;
-            m_class_tags.insert(std::make_pair(m_class_nodes[i]->get_name(), i));
+void CgenClassTable::analyze_hierarchy(CgenNodeP nd) {
+    const CgenLayout& layout = nd->GetLayout();
+    nd->m_single_impl.assign(layout.methods.size(), true);
+    for (CgenNode* child : nd->GetChildren()) {
+        analyze_hierarchy(child);
+        // A subclass's dispatch table starts with its parent's slots.
+        const CgenLayout& child_layout = child->GetLayout();
+        for (int i = 0; i < (int) layout.methods.size(); ++i) {
+            if (!child->HasSingleImpl(i) ||
+                child_layout.method_classes[i] != layout.method_classes[i]) {
+                nd->m_single_impl[i] = false;
+            }
         }
     }
-
-    return m_class_nodes;
-}
-
-std::map<Symbol, int> CgenClassTable::GetClassTags() {
-    GetClassNodes();
-    return m_class_tags;
 }
 
-std::vector<CgenNode*> CgenNode::GetInheritance() {
-    if (inheritance.empty()) {
-        CgenNode* class_node = this;
-        while (class_node->name != No_class) {
-            inheritance.push_back(class_node);
-            class_node = class_node->get_parentnd();
-        }
-        std::reverse(inheritance.begin(), inheritance.end());
+const std::vector<CgenNode*>& CgenClassTable::GetClassNodes() {
+    if (m_class_nodes.empty()) {
+        number_classes(root());
     }
 
-    return inheritance;
+    return m_class_nodes;
 }
 
-std::vector<attr_class*> CgenNode::GetFullAttribs() {
-    if (m_full_attribs.empty()) {
-        std::vector<CgenNode*> inheritance = GetInheritance();
-        for (CgenNode* class_node : inheritance) {
-            Features features = class_node->features;
-            for (int j = features->first(); features->more(j); j = features->next(j)) {
-                Feature feature = features->nth(j);
-                if (!feature->IsMethod()) {
-                    m_full_attribs.push_back((attr_class*)feature);
-                }
-            }
-        }
-        for (int i = 0; i < m_full_attribs.size(); ++i) {
-            m_attrib_idx_tab[m_full_attribs[i]->name] = i;
-        }
+void CgenClassTable::number_classes(CgenNodeP nd) {
+    nd->class_tag = m_class_nodes.size();
+    m_class_nodes.push_back(nd);
+    m_class_tags.insert(std::make_pair(nd->get_name(), nd->class_tag));
+    for (CgenNode* child : nd->GetChildren()) {
+        number_classes(child);
     }
+    nd->last_tag = m_class_nodes.size() - 1;
+}
 
-    return m_full_attribs;
+const std::map<Symbol, int>& CgenClassTable::GetClassTags() {
+    GetClassNodes();
+    return m_class_tags;
 }
 
-std::vector<attr_class*> CgenNode::GetAttribs() {
+const std::vector<attr_class*>& CgenNode::GetAttribs() {
     if (m_attribs.empty()) {
         for (int j = features->first(); features->more(j); j = features->next(j)) {
             Feature feature = features->nth(j);
@@ -799,12 +1319,7 @@ std::vector<attr_class*> CgenNode::GetAttribs() {
     return m_attribs;
 }
 
-std::map<Symbol, int> CgenNode::GetAttribIdxTab() {
-    GetFullAttribs();
-    return m_attrib_idx_tab;
-}
-
-std::vector<method_class*> CgenNode::GetMethods() {
+const std::vector<method_class*>& CgenNode::GetMethods() {
     if (m_methods.empty()) {
         for (int i = features->first(); features->more(i); i = features->next(i)) {
             Feature feature = features->nth(i);
@@ -816,87 +1331,271 @@ std::vector<method_class*> CgenNode::GetMethods() {
     return m_methods;
 }
 
-std::vector<method_class*> CgenNode::GetFullMethods() {
-    if (m_full_methods.empty()) {
-        // We must update m_full_methods, m_dispatch_class_tab, m_dispatch_idx_tab.
-
-        std::vector<CgenNode*> inheritance = GetInheritance();
-        for (CgenNode* _class_node : inheritance) {
-            Symbol _class_name = _class_node->name;
-            std::vector<method_class*> _methods = _class_node->GetMethods();
-            for (method_class* _method : _methods) {
-                Symbol _method_name = _method->name;
-                if (m_dispatch_idx_tab.find(_method_name) == m_dispatch_idx_tab.end()) {
-                    // method need to be inserted.
-                    m_full_methods.push_back(_method);
-                    m_dispatch_idx_tab[_method_name] = m_full_methods.size() - 1;
-                    m_dispatch_class_tab[_method_name] = _class_name;
-                } else {
-                    int idx = m_dispatch_idx_tab[_method_name];
-                    m_full_methods[idx] = _method;
-                    m_dispatch_class_tab[_method_name] = _class_name;
-                }
+void CgenLayout::AddAttrib(attr_class* attrib) {
+    m_attrib_slots[attrib->name] = attribs.size();
+    attribs.push_back(attrib);
+}
+
+void CgenLayout::AddMethod(method_class* method, Symbol impl_class) {
+    auto it = m_method_slots.find(method->name);
+    if (it != m_method_slots.end()) {
+        // Overriding keeps the slot of the inherited method.
+        methods[it->second] = method;
+        method_classes[it->second] = impl_class;
+        return;
+    }
+    m_method_slots[method->name] = methods.size();
+    methods.push_back(method);
+    method_classes.push_back(impl_class);
+}
+
+//
+// CgenClassTable::build_layouts
+//
+// Every class starts from a copy of its parent's layout and then appends its
+// own attributes and methods, so the whole hierarchy is laid out in one
+// top-down pass.
+//
+void CgenClassTable::build_layouts(CgenNodeP nd) {
+    CgenNodeP parent = nd->get_parentnd();
+    if (parent != NULL && parent->name != No_class) {
+        nd->m_layout = parent->GetLayout();
+    }
+    for (attr_class* attrib : nd->GetAttribs()) {
+        nd->m_layout.AddAttrib(attrib);
+    }
+    for (method_class* method : nd->GetMethods()) {
+        nd->m_layout.AddMethod(method, nd->name);
+    }
+    for (List<CgenNode> *l = nd->get_children(); l; l = l->tl()) {
+        build_layouts(l->hd());
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+//  Frames
+//
+//  A method or class init is generated body first; its prologue, which
+//  depends on what the body turned out to need, is then put in front of
+//  the body and its epilogue appended.  The standard frame saves $fp, $s0
+//  and $ra and points $fp at the saved $ra.
+//
+//  With -O (pass "leaf") a body that makes no call and never moves $sp is
+//  a leaf: $ra is never overwritten and $sp stays put, so neither is
+//  saved and $fp is not set.  What the body addresses from $fp is
+//  addressed from $sp instead, and self is kept in LEAF_SELF, which a
+//  leaf may clobber, so $s0 is not touched either.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#define LEAF_SELF 12    // $t4
+
+// Functions generated as leaves; printed with -c.
+static std::atomic<long> leaf_functions;
+
+// Does the code from insts[start] on make no call and leave $sp alone?
+static bool is_leaf_body(const MipsFunc& s, int start) {
+    for (size_t i = start; i < s.insts.size(); ++i) {
+        const MipsInst& inst = s.insts[i];
+        switch (inst.op) {
+        case MIPS_JAL: case MIPS_JALR:
+            return false;
+        case MIPS_LW: case MIPS_LI: case MIPS_LA: case MIPS_MOVE:
+        case MIPS_NEG: case MIPS_ADD: case MIPS_ADDU: case MIPS_ADDIU:
+        case MIPS_DIV: case MIPS_MUL: case MIPS_SUB: case MIPS_SLL:
+            if (inst.rd == SP) {
+                return false;
             }
+            break;
+        default:
+            break;
         }
     }
-    return m_full_methods;
+    return true;
 }
 
-std::map<Symbol, Symbol> CgenNode::GetDispatchClassTab() {
-    GetFullMethods();
-    return m_dispatch_class_tab;
+//
+// Rewrite the leaf body from insts[start] on: $fp-relative addresses
+// become relative to $sp, which is fp_offset bytes below where $fp would
+// point, and self moves from $s0 to LEAF_SELF.  Returns whether the body
+// uses self.
+//
+static bool rewrite_leaf_body(MipsFunc& s, int start, int fp_offset) {
+    bool uses_self = false;
+    for (size_t i = start; i < s.insts.size(); ++i) {
+        MipsInst& inst = s.insts[i];
+        if (inst.op == MIPS_LABEL || inst.op == MIPS_COMMENT) {
+            continue;
+        }
+        if ((inst.op == MIPS_LW || inst.op == MIPS_SW) && inst.rs == FP) {
+            inst.rs = SP;
+            inst.imm += fp_offset;
+        }
+        unsigned char* regs[] = { &inst.rd, &inst.rs, &inst.rt };
+        for (unsigned char* reg : regs) {
+            if (*reg == SELF) {
+                *reg = LEAF_SELF;
+                uses_self = true;
+            }
+        }
+    }
+    return uses_self;
 }
 
-std::map<Symbol, int> CgenNode::GetDispatchIdxTab() {
-    GetFullMethods();
-    return m_dispatch_idx_tab;
-}
+//
+// Put the prologue in front of the body, insts[start] on, and append the
+// epilogue.  saved are the allocated registers the body uses and frame
+// the words of stack slots it needs below them.
+//
+static void emit_frame(MipsFunc& s, int start, const std::vector<int>& saved,
+                       int frame) {
+    int nsaved = saved.size();
+    MipsFunc prologue(s.class_name, s.method_name);
+
+    if (cgen_pass_enabled(PASS_LEAF) && is_leaf_body(s, start)) {
+        if (!cgen_passes_measuring()) {
+            ++leaf_functions;
+        }
+        // The saved registers and the slots keep their places below
+        // where $fp would point, 8 bytes under the arguments.
+        int words = nsaved + frame;
+        int size = words > 0 ? 8 + 4 * words : 0;
+        bool uses_self = rewrite_leaf_body(s, start, size - 8);
+
+        emit_comment("\t# leaf: no calls, so fp and ra stay as they are", prologue);
+        if (size > 0) {
+            emit_addiu(SP, SP, -size, prologue);
+            for (int i = 0; i < nsaved; ++i) {
+                emit_store(saved[i], i + frame, SP, prologue);
+            }
+        }
+        if (uses_self) {
+            emit_comment("\t# self is kept in t4", prologue);
+            emit_move(LEAF_SELF, ACC, prologue);
+        }
+        emit_comment("", prologue);
+        s.insts.insert(s.insts.begin() + start, prologue.insts.begin(),
+                       prologue.insts.end());
+
+        if (size > 0) {
+            emit_comment("\t# pop the frame", s);
+            for (int i = 0; i < nsaved; ++i) {
+                emit_load(saved[i], i + frame, SP, s);
+            }
+            emit_addiu(SP, SP, size, s);
+            emit_comment("", s);
+        }
+        return;
+    }
 
-void method_class::code(ostream& s, CgenNode* class_node) {
-    emit_method_ref(class_node->name, name, s);
-    s << LABEL;
-    s << "\t# push fp, s0, ra" << endl;
-    emit_addiu(SP, SP, -12, s);
-    emit_store(FP, 3, SP, s);
-    emit_store(SELF, 2, SP, s);
-    emit_store(RA, 1, SP, s);
-    s << endl;
+    emit_comment("\t# push fp, s0, ra", prologue);
+    emit_addiu(SP, SP, -12 - 4 * (nsaved + frame), prologue);
+    emit_store(FP, 3 + nsaved + frame, SP, prologue);
+    emit_store(SELF, 2 + nsaved + frame, SP, prologue);
+    emit_store(RA, 1 + nsaved + frame, SP, prologue);
+    emit_comment("", prologue);
+
+    if (nsaved > 0) {
+        emit_comment("\t# save the allocated registers", prologue);
+        for (int i = 0; i < nsaved; ++i) {
+            emit_store(saved[i], 1 + i + frame, SP, prologue);
+        }
+        emit_comment("", prologue);
+    }
     
-    s << "\t# fp now points to the return addr in stack" << endl;
-    emit_addiu(FP, SP, 4, s);
-    s << endl;
+    emit_comment("\t# fp now points to the return addr in stack", prologue);
+    emit_addiu(FP, SP, 4 + 4 * (nsaved + frame), prologue);
+    emit_comment("", prologue);
+
+    emit_comment("\t# SELF = a0", prologue);
+    emit_move(SELF, ACC, prologue);
+    emit_comment("", prologue);
+    s.insts.insert(s.insts.begin() + start, prologue.insts.begin(),
+                   prologue.insts.end());
+
+    if (nsaved > 0) {
+        emit_comment("\t# restore the allocated registers", s);
+        for (int i = 0; i < nsaved; ++i) {
+            emit_load(saved[i], 1 + i + frame, SP, s);
+        }
+        emit_comment("", s);
+    }
+
+    emit_comment("\t# pop fp, s0, ra", s);
+    emit_load(FP, 3 + nsaved + frame, SP, s);
+    emit_load(SELF, 2 + nsaved + frame, SP, s);
+    emit_load(RA, 1 + nsaved + frame, SP, s);
+    emit_addiu(SP, SP, 12 + 4 * (nsaved + frame), s);
+    emit_comment("", s);
+}
 
-    s << "\t# SELF = a0" << endl;
-    emit_move(SELF, ACC, s);
-    s << endl;
+static void find_tail_calls(Expression e, std::set<Expression>& calls);
 
-    s << "\t# evaluating expression and put it to ACC" << endl;
+void method_class::code(MipsFunc& s, CgenNode* class_node) {
     Environment env;
     env.m_class_node = class_node;
+    env.m_inline_chain.push_back(this);
     for (int i = formals->first(); formals->more(i); i = formals->next(i)) {
         env.AddParam(formals->nth(i)->GetName());
     }
-    expr->code(s, env);
-    s << endl;
 
-    s << "\t# pop fp, s0, ra" << endl;
-    emit_load(FP, 3, SP, s);
-    emit_load(SELF, 2, SP, s);
-    emit_load(RA, 1, SP, s);
-    emit_addiu(SP, SP, 12, s);
-    s << endl;
+    // The collector only updates the pointers it finds on the stack, so
+    // with a collector every value stays there.
+    RegAlloc ra;
+    if (cgen_pass_enabled(PASS_REGALLOC) && cgen_Memmgr == GC_NOGC) {
+        alloc_regs(ra);
+        env.m_regs = &ra;
+    }
+    int nsaved = ra.UsedRegs().size();
+    env.m_saved_regs = &ra.UsedRegs();
+    if (cgen_pass_enabled(PASS_TAIL)) {
+        find_tail_calls(expr, env.m_tail_calls);
+    }
+
+    // With a fixed frame every stack slot of the body is a word below the
+    // saved registers, allocated in the prologue with them.
+    if (cgen_pass_enabled(PASS_FRAME) && cgen_Memmgr == GC_NOGC) {
+        env.m_frame_base = nsaved + 1;
+    }
+    int start = s.insts.size();
+
+    for (int i = formals->first(); formals->more(i); i = formals->next(i)) {
+        Symbol name = formals->nth(i)->GetName();
+        int reg = env.RegOf(formals->nth(i), RegAlloc::VAR);
+        if (reg != -1) {
+            env.SetParamReg(name, reg);
+            emit_comment("\t# load param ", name, s);
+            emit_load(reg, env.LookUpParam(name) + 3, FP, s);
+        }
+    }
+
+    emit_comment("\t# evaluating expression and put it to ACC", s);
+    expr->code(s, env);
+    emit_comment("", s);
+
+    if (env.m_entry_label != -1) {
+        // Tail calls of the method itself start over from here, where the
+        // arguments are loaded.
+        MipsFunc entry(s.class_name, s.method_name);
+        emit_label_def(env.m_entry_label, entry);
+        s.insts.insert(s.insts.begin() + start, entry.insts.begin(),
+                       entry.insts.end());
+    }
+    emit_frame(s, start, ra.UsedRegs(),
+               env.m_frame_base != -1 ? env.m_max_slots : 0);
 
-    s << "\t# Pop arguments" << endl;
+    emit_comment("\t# Pop arguments", s);
     emit_addiu(SP, SP, GetArgNum() * 4, s);
-    s << endl;
+    emit_comment("", s);
 
-    s << "\t# return" << endl;
+    emit_comment("\t# return", s);
     emit_return(s);
-    s << endl;
+    emit_comment("", s);
 }
 
 void CgenNode::code_protObj(ostream& s) {
-    std::vector<attr_class*> attribs = GetFullAttribs();
+    const std::vector<attr_class*>& attribs = GetFullAttribs();
 
     s << WORD << "-1" << endl;
     s << get_name() << PROTOBJ_SUFFIX << LABEL;
@@ -904,7 +1603,7 @@ void CgenNode::code_protObj(ostream& s) {
     s << WORD << (DEFAULT_OBJFIELDS + attribs.size()) << "\t# size" << endl;
     s << WORD << get_name() << DISPTAB_SUFFIX << endl;
     
-    for (int i = 0; i < attribs.size(); ++i) {
+    for (size_t i = 0; i < attribs.size(); ++i) {
         if (attribs[i]->name == val) { // _val
             if (get_name() == Str) {
                 s << WORD;
@@ -941,38 +1640,28 @@ void CgenNode::code_protObj(ostream& s) {
     }
 }
 
-void CgenNode::code_init(ostream& s) {
-    s << get_name();
-    s << CLASSINIT_SUFFIX;
-    s << LABEL;
-    s << "\t# push fp, s0, ra" << endl;
-    emit_addiu(SP, SP, -12, s);
-    emit_store(FP, 3, SP, s);
-    emit_store(SELF, 2, SP, s);
-    emit_store(RA, 1, SP, s);
-    s << endl;
-    
-    s << "\t# fp now points to the return addr in stack" << endl;
-    emit_addiu(FP, SP, 4, s);
-    s << endl;
+// Defined with the write barriers below.
+static bool is_static_value(Expression e);
+static bool may_collect_boxed(Expression e);
+static bool init_may_collect(CgenNode* class_node);
+static void emit_attrib_barrier(int idx, bool elide, MipsFunc& s);
 
-    s << "\t# SELF = a0" << endl;
-    emit_move(SELF, ACC, s);
-    s << endl;
-    
-    Symbol parent_name = get_parentnd()->name;
-    if (parent_name != No_class) {
-        s << "\t# init parent" << endl;
-        s << JAL;
-        emit_init_ref(parent_name, s);
-        s << endl << endl;
-    }
+// Defined with the constant folding below.
+static bool attrib_is_default(attr_class* attrib);
 
-    std::vector<attr_class*> attribs = GetAttribs();
-    std::map<Symbol, int> attrib_idx_tab = GetAttribIdxTab();
-    for (attr_class* attrib : attribs) {
-        s << "\t# init attrib " << attrib->name << endl;
-        int idx = attrib_idx_tab[attrib->name];
+//
+// The attribute initializers of owner, in the init of an object whose
+// layout is layout.  With flat, attributes that keep the value the
+// prototype object already has are not stored.
+//
+static void code_attrib_inits(CgenNode* owner, const CgenLayout& layout,
+                              bool flat, bool& young, MipsFunc& s) {
+    for (attr_class* attrib : owner->GetAttribs()) {
+        if (flat && attrib_is_default(attrib)) {
+            continue;
+        }
+        emit_comment("\t# init attrib ", attrib->name, s);
+        int idx = layout.AttribSlot(attrib->name);
 
         if (attrib->init->IsEmpty()) {
             // We still need to deal with basic types.
@@ -988,62 +1677,409 @@ void CgenNode::code_init(ostream& s) {
             }
         } else {
             Environment env;
-            env.m_class_node = this;
+            env.m_class_node = owner;
             attrib->init->code(s, env);
+            young = young && !may_collect_boxed(attrib->init);
             
             emit_store(ACC, 3 + idx, SELF, s);
-            if (cgen_Memmgr == 1) {
-                emit_addiu(A1, SELF, 4 * (idx + 3), s);
-                emit_jal("_GenGC_Assign", s);
-            }
-            s << endl;
+            emit_attrib_barrier(idx, young || is_static_value(attrib->init), s);
+            emit_comment("", s);
         }
     }
+}
 
-    s << "\t# ret = SELF" << endl;
-    emit_move(ACC, SELF, s);
-    s << endl;
+//
+// With -O (pass "init") the init is flat: instead of calling the init of
+// the parent, it runs the initializers of all the ancestors itself, from
+// Object down, and leaves out the attributes the prototype object already
+// holds the value of.
+//
+void CgenNode::code_init(MipsFunc& s) {
+    int start = s.insts.size();
 
-    s << "\t# pop fp, s0, ra" << endl;
-    emit_load(FP, 3, SP, s);
-    emit_load(SELF, 2, SP, s);
-    emit_load(RA, 1, SP, s);
-    emit_addiu(SP, SP, 12, s);
-    s << endl;
+    // The object was allocated just before this was called, so until
+    // something collects it is young and its stores need no barrier.
+    bool young = cgen_pass_enabled(PASS_BARRIER);
 
-    s << "\t# return" << endl;
-    emit_return(s);
-    s << endl;
-}
+    if (cgen_pass_enabled(PASS_INIT)) {
+        std::vector<CgenNode*> line;
+        for (CgenNode* c = this; c->name != No_class; c = c->get_parentnd()) {
+            line.push_back(c);
+        }
+        for (auto it = line.rbegin(); it != line.rend(); ++it) {
+            code_attrib_inits(*it, m_layout, true, young, s);
+        }
+    } else {
+        Symbol parent_name = get_parentnd()->name;
+        if (parent_name != No_class) {
+            emit_comment("\t# init parent", s);
+            emit_jal_init(parent_name, s);
+            emit_comment("", s);
+        }
+        young = young && !init_may_collect(get_parentnd());
+        code_attrib_inits(this, m_layout, false, young, s);
+    }
+
+    emit_comment("\t# ret = SELF", s);
+    emit_move(ACC, SELF, s);
+    emit_comment("", s);
+
+    emit_frame(s, start, std::vector<int>(), 0);
 
-void CgenNode::code_methods(ostream& s) {
-    std::vector<method_class*> methods = GetMethods();
+    emit_comment("\t# return", s);
+    emit_return(s);
+    emit_comment("", s);
+}
+
+void CgenNode::code_methods(std::vector<MipsFunc>& funcs) {
+    const std::vector<method_class*>& methods = GetMethods();
     for (method_class* method : methods) {
-        method->code(s, this);
+        funcs.emplace_back(name, method->name);
+        cgen_generate(funcs.back(), [&](MipsFunc& f) {
+            method->code(f, this);
+        });
     }
 }
 
 void CgenClassTable::code_protObjs() {
-    std::vector<CgenNode*> class_nodes = GetClassNodes();
+    const std::vector<CgenNode*>& class_nodes = GetClassNodes();
     for (CgenNode* class_node : class_nodes) {
         class_node->code_protObj(str);
     }
 }
 
 void CgenClassTable::code_class_inits() {
-    std::vector<CgenNode*> class_nodes = GetClassNodes();
-    for (CgenNode* class_node : class_nodes) {
-        class_node->code_init(str);
+    for (const CgenClassCode& class_code : m_class_code) {
+        str << class_code.init_text;
     }
 }
 
 void CgenClassTable::code_class_methods() {
-    std::vector<CgenNode*> class_nodes = GetClassNodes();
-    for (CgenNode* class_node : class_nodes) {
-        if (!class_node->basic()) {
-            class_node->code_methods(str);
+    for (const CgenClassCode& class_code : m_class_code) {
+        str << class_code.methods_text;
+    }
+}
+
+//
+// Run fn(0) .. fn(n-1) on cgen_jobs threads.  Each index is handed out
+// exactly once; with one job everything runs on the calling thread.
+//
+static void parallel_for(int n, const std::function<void(int)>& fn) {
+    int jobs = std::min(cgen_jobs, n);
+    if (jobs <= 1) {
+        for (int i = 0; i < n; ++i) {
+            fn(i);
+        }
+        return;
+    }
+
+    std::atomic<int> next(0);
+    auto worker = [&]() {
+        for (int i = next++; i < n; i = next++) {
+            fn(i);
+        }
+    };
+    std::vector<std::thread> threads;
+    for (int t = 1; t < jobs; ++t) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+//
+// CgenClassTable::code_class
+//
+// Build the init of the class with the given tag and, for a class that is
+// not basic, its methods, in m_class_code[tag].funcs.
+//
+void CgenClassTable::code_class(int tag) {
+    CgenNode* class_node = m_class_nodes[tag];
+    std::vector<MipsFunc>& funcs = m_class_code[tag].funcs;
+    funcs.emplace_back(class_node->name, nullptr);
+    cgen_generate(funcs.back(), [&](MipsFunc& f) {
+        class_node->code_init(f);
+    });
+    if (!class_node->basic()) {
+        class_node->code_methods(funcs);
+    }
+
+    if (cgen_debug && cgen_Memmgr != GC_NOGC) {
+        std::ostringstream report;
+        for (const MipsFunc& f : funcs) {
+            if (f.barriers_kept + f.barriers_elided == 0) {
+                continue;
+            }
+            report << "  " << f.class_name;
+            if (f.method_name != nullptr) {
+                report << "." << f.method_name;
+            } else {
+                report << CLASSINIT_SUFFIX;
+            }
+            report << ": " << f.barriers_kept << " kept, "
+                   << f.barriers_elided << " elided" << endl;
+        }
+        m_class_code[tag].barrier_report = report.str();
+    }
+}
+
+//
+// CgenClassTable::fold_constants
+//
+// Fold every user class before any code is generated; see "Constant
+// folding" below.  Serial and in tag order, so that the constants it
+// adds to the tables do not depend on -j.
+//
+void CgenClassTable::fold_constants() {
+    ConstFolder cf;
+    for (CgenNode* class_node : GetClassNodes()) {
+        if (class_node->basic()) {
+            continue;
+        }
+        for (attr_class* attrib : class_node->GetAttribs()) {
+            cf.Fold(attrib->init);
+        }
+        for (method_class* method : class_node->GetMethods()) {
+            cf.Fold(method->expr);
+        }
+    }
+}
+
+//
+// CgenClassTable::generate_class_code
+//
+// Every class is independent: its init and methods only read the class
+// table and the constant tables, and label numbers are local to each
+// function.  So the classes are generated in parallel, then every
+// function gets its label base in the order the functions appear in the
+// output (all inits, then all methods, both by class tag), and finally
+// each class is printed into its own buffer, again in parallel.  The
+// output does not depend on the number of jobs.
+//
+void CgenClassTable::generate_class_code() {
+    //
+    // Add constants that are required by the code generator.
+    //
+    stringtable.add_string("");
+    inttable.add_string("0");
+
+    if (cgen_pass_enabled(PASS_FOLD)) {
+        fold_constants();
+    }
+
+    int num_classes = GetClassNodes().size();
+    m_class_code.clear();
+    m_class_code.resize(num_classes);
+
+    if (cgen_cache_dir != nullptr) {
+        generate_cached_class_code();
+        return;
+    }
+
+    parallel_for(num_classes, [&](int tag) {
+        code_class(tag);
+    });
+
+    int label_base = 0;
+    for (CgenClassCode& class_code : m_class_code) {
+        class_code.funcs[0].label_base = label_base;
+        label_base += class_code.funcs[0].NumLabels();
+    }
+    for (CgenClassCode& class_code : m_class_code) {
+        for (size_t i = 1; i < class_code.funcs.size(); ++i) {
+            class_code.funcs[i].label_base = label_base;
+            label_base += class_code.funcs[i].NumLabels();
+        }
+    }
+
+    parallel_for(num_classes, [&](int tag) {
+        CgenClassCode& class_code = m_class_code[tag];
+        std::ostringstream init_s;
+        std::ostringstream methods_s;
+        class_code.funcs[0].Print(init_s);
+        for (size_t i = 1; i < class_code.funcs.size(); ++i) {
+            class_code.funcs[i].Print(methods_s);
+        }
+        class_code.init_text = init_s.str();
+        class_code.methods_text = methods_s.str();
+        class_code.funcs.clear();
+    });
+}
+
+//
+// Turn relocatable class text back into assembly: label numbers are
+// offset by label_base, and constants are named by their table index.
+//
+static void relocate_class_text(const std::string& text, int label_base,
+                                ostream& s) {
+    size_t pos = 0;
+    size_t mark;
+    while ((mark = text.find(CGEN_CACHE_RELOC, pos)) != std::string::npos) {
+        s.write(text.data() + pos, mark - pos);
+        char kind = text[mark + 1];
+        char* end;
+        long n = strtol(text.c_str() + mark + 2, &end, 10);
+        pos = end - text.c_str() + 1; // skip the ':'
+        if (kind == 'L') {
+            emit_label_ref(label_base + n, s);
+            continue;
+        }
+        std::string chars = text.substr(pos, n);
+        pos += n;
+        if (kind == 'I') {
+            inttable.add_string(&chars[0])->code_ref(s);
+        } else {
+            stringtable.add_string(&chars[0])->code_ref(s);
+        }
+    }
+    s.write(text.data() + pos, text.size() - pos);
+}
+
+// Defined with the constant folding below.
+static bool attribs_are_constant(CgenNode* class_node);
+static bool init_is_empty(Symbol class_name);
+// Defined with the inlining below.
+static void find_inlined(Expression e, CgenNode* class_node,
+                         std::vector<method_class*>& inlined);
+
+//
+// CgenClassTable::cache_context
+//
+// The part of every class's cache key that the class itself does not
+// determine: CGEN_CACHE_VERSION, the flags that change the generated
+// code, and the tag, parent, object layout and dispatch table of every
+// class.
+//
+std::string CgenClassTable::cache_context() {
+    std::ostringstream context;
+    context << "cgen " << CGEN_CACHE_VERSION << "\n"
+            << cgen_Memmgr << " " << cgen_Memmgr_Test << " "
+            << cgen_Memmgr_Debug << " " << cgen_optimize << " "
+            << cgen_debug << " "
+            << cgen_inline_size << "\n"
+            << cgen_passes_key() << "\n";
+    for (CgenNode* class_node : m_class_nodes) {
+        const CgenLayout& layout = class_node->GetLayout();
+        context << class_node->name << " " << class_node->parent << " (";
+        for (attr_class* attrib : layout.attribs) {
+            context << " " << attrib->name << ":" << attrib->type_decl;
+        }
+        context << " ) (";
+        for (size_t i = 0; i < layout.methods.size(); ++i) {
+            context << " " << layout.method_classes[i] << "."
+                    << layout.methods[i]->name;
+        }
+        context << " )" << (attribs_are_constant(class_node) ? " pure" : "")
+                << (init_is_empty(class_node->name) ? " empty-init" : "")
+                << "\n";
+    }
+    return context.str();
+}
+
+//
+// CgenClassTable::generate_cached_class_code
+//
+// generate_class_code with -C.  A class whose key is in the cache is not
+// generated at all; its text is read back instead.  A class that misses
+// is generated as usual, printed as relocatable text with its labels
+// counted from 0, and stored.  The label bases are then assigned in the
+// same order as above and each text is relocated, so the output is the
+// same as without the cache.
+//
+void CgenClassTable::generate_cached_class_code() {
+    int num_classes = m_class_nodes.size();
+    std::string context = cache_context();
+    std::vector<CgenCacheEntry> entries(num_classes);
+    std::atomic<int> hits(0);
+
+    parallel_for(num_classes, [&](int tag) {
+        std::ostringstream ast;
+        AstWriter writer(ast, true);
+        CgenNode* class_node = m_class_nodes[tag];
+        class_node->write_binary(writer);
+        if (cgen_pass_enabled(PASS_INIT)) {
+            // A flat init contains the initializers of the ancestors.
+            for (CgenNode* c = class_node->get_parentnd();
+                 c->name != No_class; c = c->get_parentnd()) {
+                for (attr_class* attrib : c->GetAttribs()) {
+                    attrib->write_binary(writer);
+                }
+            }
+        }
+        if (cgen_pass_enabled(PASS_INLINE)) {
+            // The class's code contains the bodies of the methods it
+            // inlines, from its methods and from its init.
+            std::vector<method_class*> inlined;
+            for (method_class* method : class_node->GetMethods()) {
+                find_inlined(method->expr, class_node, inlined);
+            }
+            for (CgenNode* c = class_node; c->name != No_class;
+                 c = c->get_parentnd()) {
+                for (attr_class* attrib : c->GetAttribs()) {
+                    find_inlined(attrib->init, c, inlined);
+                }
+                if (!cgen_pass_enabled(PASS_INIT)) {
+                    break;
+                }
+            }
+            for (method_class* method : inlined) {
+                method->write_binary(writer);
+            }
+        }
+        CgenCacheHash hash;
+        hash.Add(context);
+        hash.Add(ast.str());
+        std::string key = hash.Hex();
+
+        CgenCacheEntry& entry = entries[tag];
+        if (cgen_cache_load(cgen_cache_dir, key, entry)) {
+            ++hits;
+            return;
+        }
+
+        code_class(tag);
+        std::vector<MipsFunc>& funcs = m_class_code[tag].funcs;
+        std::ostringstream init_s;
+        std::ostringstream methods_s;
+        entry.init_labels = funcs[0].NumLabels();
+        funcs[0].Print(init_s, true);
+        for (size_t i = 1; i < funcs.size(); ++i) {
+            funcs[i].label_base = entry.methods_labels;
+            entry.methods_labels += funcs[i].NumLabels();
+            funcs[i].Print(methods_s, true);
         }
+        entry.init_text = init_s.str();
+        entry.methods_text = methods_s.str();
+        funcs.clear();
+        cgen_cache_store(cgen_cache_dir, key, entry);
+    });
+
+    std::vector<int> init_bases(num_classes);
+    std::vector<int> methods_bases(num_classes);
+    int label_base = 0;
+    for (int tag = 0; tag < num_classes; ++tag) {
+        init_bases[tag] = label_base;
+        label_base += entries[tag].init_labels;
     }
+    for (int tag = 0; tag < num_classes; ++tag) {
+        methods_bases[tag] = label_base;
+        label_base += entries[tag].methods_labels;
+    }
+
+    parallel_for(num_classes, [&](int tag) {
+        std::ostringstream init_s;
+        std::ostringstream methods_s;
+        relocate_class_text(entries[tag].init_text, init_bases[tag], init_s);
+        relocate_class_text(entries[tag].methods_text, methods_bases[tag],
+                            methods_s);
+        m_class_code[tag].init_text = init_s.str();
+        m_class_code[tag].methods_text = methods_s.str();
+    });
+
+    cerr << "class code cache: " << hits << " hits, "
+         << num_classes - hits << " misses" << endl;
 }
 
 CgenClassTable::CgenClassTable(Classes classes, ostream& s) : nds(NULL) , str(s) {
@@ -1056,10 +2092,14 @@ CgenClassTable::CgenClassTable(Classes classes, ostream& s) : nds(NULL) , str(s)
     install_classes(classes);
     build_inheritance_tree();
 
-    std::map<Symbol, int> class_tags = GetClassTags();
-    stringclasstag = class_tags[Str];
-    intclasstag = class_tags[Int];
-    boolclasstag = class_tags[Bool];
+    const std::map<Symbol, int>& class_tags = GetClassTags();
+    stringclasstag = class_tags.find(Str)->second;
+    intclasstag = class_tags.find(Int)->second;
+    boolclasstag = class_tags.find(Bool)->second;
+
+    build_layouts(root());
+    analyze_hierarchy(root());
+    find_inline_candidates();
 
 }
 
@@ -1241,10 +2281,49 @@ void CgenNode::set_parentnd(CgenNodeP p) {
 
 
 
+// Dynamic dispatch sites generated with pass "devirt", and how many of
+// them call the method directly; printed with -c.
+static std::atomic<long> dispatch_sites;
+static std::atomic<long> devirtualized_sites;
+// Call sites replaced by the body of the method, with pass "inline".
+static std::atomic<long> inlined_sites;
+// Tail calls generated with pass "tail", and how many of them jump back
+// into their own method.
+static std::atomic<long> tail_calls;
+static std::atomic<long> self_tail_calls;
+
 void CgenClassTable::code() {
 
 // 类表代码生成主函数
 // 按顺序生成所有必需的代码段：全局数据、常量、类表、方法表等
+    if (cgen_debug) {
+        cout << "generating class code with " << cgen_jobs << " job(s)" << endl;
+    }
+    generate_class_code();
+    if (cgen_debug && cgen_pass_enabled(PASS_DEVIRT)) {
+        cout << "devirtualized " << devirtualized_sites << " of "
+             << dispatch_sites << " dispatch sites" << endl;
+    }
+    if (cgen_debug && cgen_pass_enabled(PASS_INLINE)) {
+        cout << "inlined " << inlined_sites << " call sites" << endl;
+    }
+    if (cgen_debug && cgen_pass_enabled(PASS_TAIL)) {
+        cout << "tail calls: " << tail_calls << ", " << self_tail_calls
+             << " of them jump back into their own method" << endl;
+    }
+    if (cgen_debug && cgen_pass_enabled(PASS_ALLOC)) {
+        cout << "inlined " << inline_allocs << " allocations" << endl;
+    }
+    if (cgen_debug && cgen_pass_enabled(PASS_LEAF)) {
+        cout << leaf_functions << " leaf functions" << endl;
+    }
+    if (cgen_debug && cgen_Memmgr != GC_NOGC) {
+        cout << "write barriers on attribute stores:" << endl;
+        for (const CgenClassCode& class_code : m_class_code) {
+            cout << class_code.barrier_report;
+        }
+    }
+
     if (cgen_debug) {
         cout << "coding global data" << endl;
     }
@@ -1294,316 +2373,2233 @@ void CgenClassTable::code() {
     if (cgen_debug) {
         cout << "coding class methods" << endl;
     }
-    code_class_methods();
-    //                   - the class methods
-    //                   - etc...
-
+    code_class_methods();
+    //                   - the class methods
+    //                   - etc...
+
+}
+
+
+CgenNodeP CgenClassTable::root() {
+    return probe(Object);
+}
+
+
+///////////////////////////////////////////////////////////////////////
+//
+// CgenNode methods
+//
+///////////////////////////////////////////////////////////////////////
+
+CgenNode::CgenNode(Class_ nd, Basicness bstatus, CgenClassTableP ct) :
+    class__class((const class__class&) *nd),
+    parentnd(NULL),
+    children(NULL),
+    basic_status(bstatus) {
+    stringtable.add_string(name->get_string());          // Add class name to string table
+}
+
+
+//******************************************************************
+//
+//   Fill in the following methods to produce code for the
+//   appropriate expression.  You may add or remove parameters
+//   as you wish, but if you do, remember to change the parameters
+//   of the declarations in `cool-tree.h'  Sample code for
+//   constant integers, strings, and booleans are provided.
+//
+//*****************************************************************
+
+//*****************************************************************
+//
+// Constant folding (-O, pass "fold")
+//
+// Before any class is generated, CgenClassTable::fold_constants walks
+// every method body and attribute initializer, one class after another
+// in tag order, and points the `folded' field of each expression whose
+// value is known at compile time to a constant node holding that value:
+// Int arithmetic and comparisons on constants, `not' of a constant,
+// `=' of two constants, isvoid of something that cannot be void,
+// length, concat and substr of constant strings, and the uses of a let
+// variable that has a constant initial value and is never assigned.  A
+// let whose variable was propagated gets its body, and an if with a
+// constant predicate the branch that is taken.  Any expression folded
+// to a constant therefore has no side effects.
+//
+// New constants are added to inttable and stringtable here, serially,
+// so the tables come out the same for every -j; the code generators,
+// which run in parallel, only look them up.  The tree itself is not
+// changed: a code generator whose node has `folded' set generates that
+// expression instead, so with the pass off (-P no-fold, or while the
+// report measures it) the plain code comes back.
+//
+// Nothing that would fail at run time is folded: an add, sub, mul or
+// neg that overflows (add, sub and neg trap), division by zero and a
+// substr out of range are left to the running program.
+//
+//*****************************************************************
+
+Expression ConstFolder::LookUp(Symbol name) const {
+    for (auto it = m_scope.rbegin(); it != m_scope.rend(); ++it) {
+        if (it->first == name) {
+            return it->second;
+        }
+    }
+    return nullptr;
+}
+
+void ConstFolder::Fold(Expression e) {
+    m_assigned.clear();
+    m_propagate = false;
+    e->fold_constants(*this);
+    m_propagate = true;
+    e->fold_constants(*this);
+}
+
+// The Int constant v, if it fits in a machine word.
+static Expression fold_int(long long v) {
+    if (v < INT32_MIN || v > INT32_MAX) {
+        return nullptr;
+    }
+    return int_const(inttable.add_int((int) v))->set_type(Int);
+}
+
+static Expression fold_bool(bool v) {
+    return bool_const(v)->set_type(Bool);
+}
+
+static Expression fold_string(std::string v) {
+    return string_const(stringtable.add_string(&v[0]))->set_type(Str);
+}
+
+// What e computes after folding: e itself or what it was folded to.
+static Expression folded_value(Expression e) {
+    while (e->folded != nullptr) {
+        e = e->folded;
+    }
+    return e;
+}
+
+static bool int_value(Expression e, long long& v) {
+    int_const_class* c = dynamic_cast<int_const_class*>(folded_value(e));
+    if (c == nullptr) {
+        return false;
+    }
+    v = strtoll(c->token->get_string(), nullptr, 10);
+    return true;
+}
+
+static bool bool_value(Expression e, bool& v) {
+    bool_const_class* c = dynamic_cast<bool_const_class*>(folded_value(e));
+    if (c == nullptr) {
+        return false;
+    }
+    v = c->val;
+    return true;
+}
+
+static bool string_value(Expression e, std::string& v) {
+    string_const_class* c = dynamic_cast<string_const_class*>(folded_value(e));
+    if (c == nullptr) {
+        return false;
+    }
+    v.assign(c->token->get_string(), c->token->get_len());
+    return true;
+}
+
+static bool is_constant(Expression e) {
+    Expression v = folded_value(e);
+    return dynamic_cast<int_const_class*>(v) != nullptr ||
+           dynamic_cast<bool_const_class*>(v) != nullptr ||
+           dynamic_cast<string_const_class*>(v) != nullptr;
+}
+
+// Do the attribute initializers of the class itself have no side
+// effects?  Part of the cache key, because isvoid (new C) is folded in
+// other classes when this holds for C and all its ancestors.
+static bool attribs_are_constant(CgenNode* class_node) {
+    for (attr_class* attrib : class_node->GetAttribs()) {
+        if (!attrib->init->IsEmpty() && !is_constant(attrib->init)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Does new C have no side effects, C_init included?
+static bool new_is_pure(Symbol class_name) {
+    if (class_name == SELF_TYPE) {
+        return false;
+    }
+    CgenNode* class_node = codegen_classtable->GetClassNode(class_name);
+    for (; class_node != nullptr && class_node->name != No_class;
+         class_node = class_node->get_parentnd()) {
+        if (!attribs_are_constant(class_node)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Does the prototype object already hold the value attrib starts with, so
+// that the init need not store it?  Only attributes without an initializer
+// qualify: an explicit "<- 0" may overwrite a value an earlier initializer
+// stored through a method call.
+static bool attrib_is_default(attr_class* attrib) {
+    return attrib->init->IsEmpty();
+}
+
+// Is the init of class_name empty with pass "init", so that new need not
+// call it?  Part of the cache key.
+static bool init_is_empty(Symbol class_name) {
+    if (!cgen_pass_enabled(PASS_INIT) || class_name == SELF_TYPE) {
+        return false;
+    }
+    CgenNode* class_node = codegen_classtable->GetClassNode(class_name);
+    for (; class_node != nullptr && class_node->name != No_class;
+         class_node = class_node->get_parentnd()) {
+        for (attr_class* attrib : class_node->GetAttribs()) {
+            if (!attrib_is_default(attrib)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// The value of a let variable declared type_decl without an initializer.
+static Expression default_value(Symbol type_decl) {
+    if (type_decl == Int) {
+        return fold_int(0);
+    } else if (type_decl == Bool) {
+        return fold_bool(false);
+    } else if (type_decl == Str) {
+        return fold_string("");
+    }
+    return nullptr;
+}
+
+//
+// The code generators of the nodes that can be folded start with one of
+// these: if the node was folded (and the pass is on), generate what it
+// was folded to instead and return true.  alloc_regs mirrors code.
+//
+static bool code_folded(Expression e, MipsFunc& s, Environment& env) {
+    if (e->folded == nullptr || !cgen_pass_enabled(PASS_FOLD)) {
+        return false;
+    }
+    e->folded->code(s, env);
+    return true;
+}
+
+static bool code_unboxed_folded(Expression e, MipsFunc& s, Environment& env) {
+    if (e->folded == nullptr || !cgen_pass_enabled(PASS_FOLD)) {
+        return false;
+    }
+    e->folded->code_unboxed(s, env);
+    return true;
+}
+
+static bool code_branch_folded(Expression e, MipsFunc& s, Environment& env,
+                               bool sense, int label) {
+    if (e->folded == nullptr || !cgen_pass_enabled(PASS_FOLD)) {
+        return false;
+    }
+    bool v;
+    if (bool_value(e, v)) {
+        if (v == sense) {
+            emit_branch(label, s);
+        }
+        return true;
+    }
+    e->folded->code_branch(s, env, sense, label);
+    return true;
+}
+
+static bool alloc_regs_folded(Expression e, RegAlloc& ra) {
+    if (e->folded == nullptr || !cgen_pass_enabled(PASS_FOLD)) {
+        return false;
+    }
+    e->folded->alloc_regs(ra);
+    return true;
+}
+
+static bool alloc_regs_unboxed_folded(Expression e, RegAlloc& ra) {
+    if (e->folded == nullptr || !cgen_pass_enabled(PASS_FOLD)) {
+        return false;
+    }
+    e->folded->alloc_regs_unboxed(ra);
+    return true;
+}
+
+static bool alloc_regs_branch_folded(Expression e, RegAlloc& ra) {
+    if (e->folded == nullptr || !cgen_pass_enabled(PASS_FOLD)) {
+        return false;
+    }
+    e->folded->alloc_regs_branch(ra);
+    return true;
+}
+
+// The expression that is generated for e.
+static Expression generated_expr(Expression e) {
+    while (e->folded != nullptr && cgen_pass_enabled(PASS_FOLD)) {
+        e = e->folded;
+    }
+    return e;
+}
+
+void assign_class::fold_constants(ConstFolder& cf) {
+    expr->fold_constants(cf);
+    cf.Assign(name);
+}
+
+void static_dispatch_class::fold_constants(ConstFolder& cf) {
+    for (int i = actual->first(); actual->more(i); i = actual->next(i)) {
+        actual->nth(i)->fold_constants(cf);
+    }
+    expr->fold_constants(cf);
+}
+
+void dispatch_class::fold_constants(ConstFolder& cf) {
+    for (int i = actual->first(); actual->more(i); i = actual->next(i)) {
+        actual->nth(i)->fold_constants(cf);
+    }
+    expr->fold_constants(cf);
+
+    // String has no subclasses, so these are its own methods.
+    folded = nullptr;
+    std::string str;
+    if (expr->type != Str || !string_value(expr, str)) {
+        return;
+    }
+    std::vector<Expression> actuals = GetActuals();
+    std::string arg;
+    long long i, l;
+    if (name == length && actuals.empty()) {
+        folded = fold_int(str.size());
+    } else if (name == concat && actuals.size() == 1 &&
+               string_value(actuals[0], arg)) {
+        folded = fold_string(str + arg);
+    } else if (name == substr && actuals.size() == 2 &&
+               int_value(actuals[0], i) && int_value(actuals[1], l) &&
+               i >= 0 && l >= 0 && i + l <= (long long) str.size()) {
+        folded = fold_string(str.substr(i, l));
+    }
+}
+
+void cond_class::fold_constants(ConstFolder& cf) {
+    pred->fold_constants(cf);
+    then_exp->fold_constants(cf);
+    else_exp->fold_constants(cf);
+    bool v;
+    folded = bool_value(pred, v) ? (v ? then_exp : else_exp) : nullptr;
+}
+
+void loop_class::fold_constants(ConstFolder& cf) {
+    pred->fold_constants(cf);
+    body->fold_constants(cf);
+}
+
+void typcase_class::fold_constants(ConstFolder& cf) {
+    expr->fold_constants(cf);
+    for (branch_class* _case : GetCases()) {
+        cf.Bind(_case->name, nullptr);
+        _case->expr->fold_constants(cf);
+        cf.Unbind();
+    }
+}
+
+void block_class::fold_constants(ConstFolder& cf) {
+    for (int i = body->first(); body->more(i); i = body->next(i)) {
+        body->nth(i)->fold_constants(cf);
+    }
+}
+
+void let_class::fold_constants(ConstFolder& cf) {
+    init->fold_constants(cf);
+    Expression value = nullptr;
+    if (init->IsEmpty()) {
+        value = default_value(type_decl);
+    } else if (is_constant(init)) {
+        value = folded_value(init);
+    }
+    bool propagate = cf.CanPropagate(identifier, value);
+
+    cf.Bind(identifier, propagate ? value : nullptr);
+    body->fold_constants(cf);
+    cf.Unbind();
+    folded = propagate ? body : nullptr;
+}
+
+void plus_class::fold_constants(ConstFolder& cf) {
+    e1->fold_constants(cf);
+    e2->fold_constants(cf);
+    long long a, b;
+    folded = int_value(e1, a) && int_value(e2, b) ? fold_int(a + b) : nullptr;
+}
+
+void sub_class::fold_constants(ConstFolder& cf) {
+    e1->fold_constants(cf);
+    e2->fold_constants(cf);
+    long long a, b;
+    folded = int_value(e1, a) && int_value(e2, b) ? fold_int(a - b) : nullptr;
+}
+
+void mul_class::fold_constants(ConstFolder& cf) {
+    e1->fold_constants(cf);
+    e2->fold_constants(cf);
+    long long a, b;
+    folded = int_value(e1, a) && int_value(e2, b) ? fold_int(a * b) : nullptr;
+}
+
+void divide_class::fold_constants(ConstFolder& cf) {
+    e1->fold_constants(cf);
+    e2->fold_constants(cf);
+    long long a, b;
+    folded = int_value(e1, a) && int_value(e2, b) && b != 0 ?
+             fold_int(a / b) : nullptr;
+}
+
+void neg_class::fold_constants(ConstFolder& cf) {
+    e1->fold_constants(cf);
+    long long a;
+    folded = int_value(e1, a) ? fold_int(-a) : nullptr;
+}
+
+void lt_class::fold_constants(ConstFolder& cf) {
+    e1->fold_constants(cf);
+    e2->fold_constants(cf);
+    long long a, b;
+    folded = int_value(e1, a) && int_value(e2, b) ? fold_bool(a < b) : nullptr;
+}
+
+void eq_class::fold_constants(ConstFolder& cf) {
+    e1->fold_constants(cf);
+    e2->fold_constants(cf);
+    // Equal constants are the same object, so this holds whether the
+    // code would compare values or pointers.
+    folded = nullptr;
+    long long i1, i2;
+    bool b1, b2;
+    std::string s1, s2;
+    if (int_value(e1, i1) && int_value(e2, i2)) {
+        folded = fold_bool(i1 == i2);
+    } else if (bool_value(e1, b1) && bool_value(e2, b2)) {
+        folded = fold_bool(b1 == b2);
+    } else if (string_value(e1, s1) && string_value(e2, s2)) {
+        folded = fold_bool(s1 == s2);
+    } else if (is_constant(e1) && is_constant(e2)) {
+        folded = fold_bool(false);
+    }
+}
+
+void leq_class::fold_constants(ConstFolder& cf) {
+    e1->fold_constants(cf);
+    e2->fold_constants(cf);
+    long long a, b;
+    folded = int_value(e1, a) && int_value(e2, b) ? fold_bool(a <= b) : nullptr;
+}
+
+void comp_class::fold_constants(ConstFolder& cf) {
+    e1->fold_constants(cf);
+    bool v;
+    folded = bool_value(e1, v) ? fold_bool(!v) : nullptr;
+}
+
+void int_const_class::fold_constants(ConstFolder& cf) {
+}
+
+void bool_const_class::fold_constants(ConstFolder& cf) {
+}
+
+void string_const_class::fold_constants(ConstFolder& cf) {
+}
+
+void new__class::fold_constants(ConstFolder& cf) {
+}
+
+void isvoid_class::fold_constants(ConstFolder& cf) {
+    e1->fold_constants(cf);
+    Expression v = folded_value(e1);
+    object_class* object = dynamic_cast<object_class*>(v);
+    new__class* _new = dynamic_cast<new__class*>(v);
+    folded = nullptr;
+    if (is_constant(v) || (object != nullptr && object->name == self) ||
+        (_new != nullptr && new_is_pure(_new->type_name))) {
+        folded = fold_bool(false);
+    }
+}
+
+void no_expr_class::fold_constants(ConstFolder& cf) {
+}
+
+void object_class::fold_constants(ConstFolder& cf) {
+    folded = cf.LookUp(name);
+}
+
+//*****************************************************************
+//
+// Register allocation
+//
+// Before the code of a method is generated, alloc_regs walks its body in
+// the order code() will evaluate it and records a live interval for
+// every value that would otherwise sit in a stack slot: let and case
+// variables (from the start of their body to its end), formals (the
+// whole method) and the left operand of a binary operation, which is
+// kept while the right one is evaluated.  Interval end points are just
+// the steps of the walk, so an interval nested in another one always
+// lies strictly inside it.  RegAlloc::Run then gives $s1-$s6 to the
+// intervals with a linear scan.
+//
+// The code generators ask the Environment for the register of each of
+// these values and fall back to the stack when there is none, so an
+// interval recorded for a value that code() ends up not needing only
+// costs a register for a while.
+//
+// The benefits below estimate what a register saves, counting each
+// instruction and each memory access as one, every time the value is
+// defined; each read or write of a variable saves one more load or
+// store.  Saving and restoring the register costs REG_SAVE_COST per call.
+//
+//*****************************************************************
+
+#define REG_SAVE_COST       4
+#define REG_OPERAND_BENEFIT 4   // push and pop become two moves
+#define REG_RESULT_BENEFIT  6   // see code_boxed_result
+#define REG_VAR_BENEFIT     3   // push and pop become one move
+#define REG_FORMAL_BENEFIT  (-2) // the formal is loaded in the prologue
+
+int RegAlloc::Open(tree_node* node, Kind kind, int benefit) {
+    Interval i;
+    i.node = node;
+    i.kind = kind;
+    i.start = ++m_pos;
+    i.end = i.start;
+    i.benefit = benefit * Frequency();
+    i.excluded = false;
+    i.reg = -1;
+    m_intervals.push_back(i);
+    return m_intervals.size() - 1;
+}
+
+void RegAlloc::Close(int id) {
+    m_intervals[id].end = ++m_pos;
+}
+
+int RegAlloc::Frequency() const {
+    int freq = 1;
+    for (int i = 0; i < m_loop_depth && i < 3; ++i) {
+        freq *= 10;
+    }
+    return freq;
+}
+
+void RegAlloc::Use(Symbol name) {
+    for (auto it = m_scope.rbegin(); it != m_scope.rend(); ++it) {
+        if (it->first == name) {
+            m_intervals[it->second].benefit += Frequency();
+            return;
+        }
+    }
+}
+
+void RegAlloc::Scan() {
+    std::vector<int> active;    // intervals holding a register, by end
+    int free_regs = (1 << NUM_ALLOC_REGS) - 1;
+
+    for (int id = 0; id < (int) m_intervals.size(); ++id) {
+        Interval& cur = m_intervals[id];
+        cur.reg = -1;
+        if (cur.excluded || cur.benefit <= 0) {
+            continue;
+        }
+
+        // Expire the intervals that ended before this one starts.
+        while (!active.empty() && m_intervals[active.front()].end < cur.start) {
+            free_regs |= 1 << (m_intervals[active.front()].reg - S1);
+            active.erase(active.begin());
+        }
+
+        if (free_regs == 0) {
+            // Spill the interval that ends last: that is either cur or
+            // the last active one, which then goes back to the stack.
+            int last = active.back();
+            if (m_intervals[last].end < cur.end) {
+                continue;
+            }
+            cur.reg = m_intervals[last].reg;
+            m_intervals[last].reg = -1;
+            active.pop_back();
+        } else {
+            int r = 0;
+            while (!(free_regs & (1 << r))) {
+                ++r;
+            }
+            free_regs &= ~(1 << r);
+            cur.reg = S1 + r;
+        }
+
+        auto pos = active.begin();
+        while (pos != active.end() && m_intervals[*pos].end < cur.end) {
+            ++pos;
+        }
+        active.insert(pos, id);
+    }
+}
+
+void RegAlloc::Run() {
+    // A register has to be saved and restored once per call, so it is
+    // given up if the intervals it got save less than that, and the scan
+    // is repeated without them.
+    int benefit[NUM_ALLOC_REGS];
+    bool dropped;
+    do {
+        Scan();
+        std::fill(benefit, benefit + NUM_ALLOC_REGS, 0);
+        for (const Interval& i : m_intervals) {
+            if (i.reg != -1) {
+                benefit[i.reg - S1] += i.benefit;
+            }
+        }
+        dropped = false;
+        for (Interval& i : m_intervals) {
+            if (i.reg != -1 && benefit[i.reg - S1] <= REG_SAVE_COST) {
+                i.excluded = true;
+                dropped = true;
+            }
+        }
+    } while (dropped);
+
+    for (const Interval& i : m_intervals) {
+        if (i.reg != -1) {
+            m_reg[i.kind][i.node] = i.reg;
+        }
+    }
+    for (int r = 0; r < NUM_ALLOC_REGS; ++r) {
+        if (benefit[r] > 0) {
+            m_used.push_back(S1 + r);
+        }
+    }
+}
+
+void method_class::alloc_regs(RegAlloc& ra) {
+    std::vector<int> ids;
+    for (int i = formals->first(); formals->more(i); i = formals->next(i)) {
+        ids.push_back(ra.Open(formals->nth(i), RegAlloc::VAR,
+                              REG_FORMAL_BENEFIT));
+        ra.Bind(formals->nth(i)->GetName(), ids.back());
+    }
+    expr->alloc_regs(ra);
+    for (int id : ids) {
+        ra.Unbind();
+        ra.Close(id);
+    }
+    ra.Run();
+}
+
+// e1 is kept while e2 is evaluated; see save_operand.
+static void alloc_regs_operands(Expression node, Expression e1, Expression e2,
+                                RegAlloc& ra) {
+    e1->alloc_regs(ra);
+    int id = ra.Open(node, RegAlloc::OPERAND, REG_OPERAND_BENEFIT);
+    e2->alloc_regs(ra);
+    ra.Close(id);
+}
+
+// The same for code_unboxed_operands, which keeps nothing if e2 is a leaf.
+static void alloc_regs_unboxed_operands(Expression node, Expression e1,
+                                        Expression e2, RegAlloc& ra) {
+    e1->alloc_regs_unboxed(ra);
+    if (generated_expr(e2)->IsLeaf()) {
+        e2->alloc_regs_unboxed(ra);
+        return;
+    }
+    int id = ra.Open(node, RegAlloc::OPERAND, REG_OPERAND_BENEFIT);
+    e2->alloc_regs_unboxed(ra);
+    ra.Close(id);
+}
+
+// The same for code_boxed_result: the unboxed value is kept while the
+// result object is allocated.
+static void alloc_regs_boxed_result(Expression node, RegAlloc& ra) {
+    node->alloc_regs_unboxed(ra);
+    ra.Close(ra.Open(node, RegAlloc::RESULT, REG_RESULT_BENEFIT));
+}
+
+void Expression_class::alloc_regs_unboxed(RegAlloc& ra) {
+    if (alloc_regs_unboxed_folded(this, ra)) {
+        return;
+    }
+    alloc_regs(ra);
+}
+
+void Expression_class::alloc_regs_branch(RegAlloc& ra) {
+    if (alloc_regs_branch_folded(this, ra)) {
+        return;
+    }
+    alloc_regs(ra);
+}
+
+void assign_class::alloc_regs(RegAlloc& ra) {
+    expr->alloc_regs(ra);
+    ra.Use(name);
+}
+
+void static_dispatch_class::alloc_regs(RegAlloc& ra) {
+    for (int i = actual->first(); actual->more(i); i = actual->next(i)) {
+        actual->nth(i)->alloc_regs(ra);
+    }
+    expr->alloc_regs(ra);
+}
+
+void dispatch_class::alloc_regs(RegAlloc& ra) {
+    if (alloc_regs_folded(this, ra)) {
+        return;
+    }
+    for (int i = actual->first(); actual->more(i); i = actual->next(i)) {
+        actual->nth(i)->alloc_regs(ra);
+    }
+    expr->alloc_regs(ra);
+}
+
+void cond_class::alloc_regs(RegAlloc& ra) {
+    if (alloc_regs_folded(this, ra)) {
+        return;
+    }
+    if (cgen_pass_enabled(PASS_BRANCH)) {
+        pred->alloc_regs_branch(ra);
+    } else {
+        pred->alloc_regs(ra);
+    }
+    then_exp->alloc_regs(ra);
+    else_exp->alloc_regs(ra);
+}
+
+void loop_class::alloc_regs(RegAlloc& ra) {
+    ra.EnterLoop();
+    if (cgen_pass_enabled(PASS_BRANCH)) {
+        body->alloc_regs(ra);
+        pred->alloc_regs_branch(ra);
+    } else {
+        pred->alloc_regs(ra);
+        body->alloc_regs(ra);
+    }
+    ra.ExitLoop();
+}
+
+void typcase_class::alloc_regs(RegAlloc& ra) {
+    expr->alloc_regs(ra);
+    for (branch_class* _case : GetCases()) {
+        int id = ra.Open(_case, RegAlloc::VAR, REG_VAR_BENEFIT);
+        ra.Bind(_case->name, id);
+        _case->expr->alloc_regs(ra);
+        ra.Unbind();
+        ra.Close(id);
+    }
+}
+
+void block_class::alloc_regs(RegAlloc& ra) {
+    for (int i = body->first(); body->more(i); i = body->next(i)) {
+        body->nth(i)->alloc_regs(ra);
+    }
+}
+
+void let_class::alloc_regs(RegAlloc& ra) {
+    if (alloc_regs_folded(this, ra)) {
+        return;
+    }
+    init->alloc_regs(ra);
+    int id = ra.Open(this, RegAlloc::VAR, REG_VAR_BENEFIT);
+    ra.Bind(identifier, id);
+    body->alloc_regs(ra);
+    ra.Unbind();
+    ra.Close(id);
+}
+
+void plus_class::alloc_regs(RegAlloc& ra) {
+    if (alloc_regs_folded(this, ra)) {
+        return;
+    }
+    if (cgen_pass_enabled(PASS_UNBOX)) {
+        alloc_regs_boxed_result(this, ra);
+    } else {
+        alloc_regs_operands(this, e1, e2, ra);
+    }
+}
+
+void sub_class::alloc_regs(RegAlloc& ra) {
+    if (alloc_regs_folded(this, ra)) {
+        return;
+    }
+    if (cgen_pass_enabled(PASS_UNBOX)) {
+        alloc_regs_boxed_result(this, ra);
+    } else {
+        alloc_regs_operands(this, e1, e2, ra);
+    }
+}
+
+void mul_class::alloc_regs(RegAlloc& ra) {
+    if (alloc_regs_folded(this, ra)) {
+        return;
+    }
+    if (cgen_pass_enabled(PASS_UNBOX)) {
+        alloc_regs_boxed_result(this, ra);
+    } else {
+        alloc_regs_operands(this, e1, e2, ra);
+    }
+}
+
+void divide_class::alloc_regs(RegAlloc& ra) {
+    if (alloc_regs_folded(this, ra)) {
+        return;
+    }
+    if (cgen_pass_enabled(PASS_UNBOX)) {
+        alloc_regs_boxed_result(this, ra);
+    } else {
+        alloc_regs_operands(this, e1, e2, ra);
+    }
+}
+
+void neg_class::alloc_regs(RegAlloc& ra) {
+    if (alloc_regs_folded(this, ra)) {
+        return;
+    }
+    if (cgen_pass_enabled(PASS_UNBOX)) {
+        alloc_regs_boxed_result(this, ra);
+    } else {
+        e1->alloc_regs(ra);
+    }
+}
+
+void plus_class::alloc_regs_unboxed(RegAlloc& ra) {
+    if (alloc_regs_unboxed_folded(this, ra)) {
+        return;
+    }
+    alloc_regs_unboxed_operands(this, e1, e2, ra);
+}
+
+void sub_class::alloc_regs_unboxed(RegAlloc& ra) {
+    if (alloc_regs_unboxed_folded(this, ra)) {
+        return;
+    }
+    alloc_regs_unboxed_operands(this, e1, e2, ra);
+}
+
+void mul_class::alloc_regs_unboxed(RegAlloc& ra) {
+    if (alloc_regs_unboxed_folded(this, ra)) {
+        return;
+    }
+    alloc_regs_unboxed_operands(this, e1, e2, ra);
+}
+
+void divide_class::alloc_regs_unboxed(RegAlloc& ra) {
+    if (alloc_regs_unboxed_folded(this, ra)) {
+        return;
+    }
+    alloc_regs_unboxed_operands(this, e1, e2, ra);
+}
+
+void neg_class::alloc_regs_unboxed(RegAlloc& ra) {
+    if (alloc_regs_unboxed_folded(this, ra)) {
+        return;
+    }
+    e1->alloc_regs_unboxed(ra);
+}
+
+void lt_class::alloc_regs(RegAlloc& ra) {
+    if (alloc_regs_folded(this, ra)) {
+        return;
+    }
+    if (cgen_pass_enabled(PASS_UNBOX)) {
+        alloc_regs_unboxed_operands(this, e1, e2, ra);
+    } else {
+        alloc_regs_operands(this, e1, e2, ra);
+    }
+}
+
+void eq_class::alloc_regs(RegAlloc& ra) {
+    if (alloc_regs_folded(this, ra)) {
+        return;
+    }
+    if (cgen_pass_enabled(PASS_UNBOX) && e1->type == Int && e2->type == Int) {
+        alloc_regs_unboxed_operands(this, e1, e2, ra);
+    } else {
+        alloc_regs_operands(this, e1, e2, ra);
+    }
+}
+
+void leq_class::alloc_regs(RegAlloc& ra) {
+    if (alloc_regs_folded(this, ra)) {
+        return;
+    }
+    if (cgen_pass_enabled(PASS_UNBOX)) {
+        alloc_regs_unboxed_operands(this, e1, e2, ra);
+    } else {
+        alloc_regs_operands(this, e1, e2, ra);
+    }
+}
+
+void comp_class::alloc_regs(RegAlloc& ra) {
+    if (alloc_regs_folded(this, ra)) {
+        return;
+    }
+    e1->alloc_regs(ra);
+}
+
+void comp_class::alloc_regs_branch(RegAlloc& ra) {
+    if (alloc_regs_branch_folded(this, ra)) {
+        return;
+    }
+    e1->alloc_regs_branch(ra);
+}
+
+void int_const_class::alloc_regs(RegAlloc& ra) {
+}
+
+void bool_const_class::alloc_regs(RegAlloc& ra) {
+}
+
+void string_const_class::alloc_regs(RegAlloc& ra) {
+}
+
+void new__class::alloc_regs(RegAlloc& ra) {
+}
+
+void isvoid_class::alloc_regs(RegAlloc& ra) {
+    if (alloc_regs_folded(this, ra)) {
+        return;
+    }
+    e1->alloc_regs(ra);
+}
+
+void no_expr_class::alloc_regs(RegAlloc& ra) {
+}
+
+void object_class::alloc_regs(RegAlloc& ra) {
+    if (alloc_regs_folded(this, ra)) {
+        return;
+    }
+    ra.Use(name);
+}
+
+//
+// Keep the value in ACC, the left operand of node, while the right one
+// is evaluated: in the register allocated for it, or on the stack.
+//
+static void save_operand(Expression node, MipsFunc& s, Environment& env) {
+    int reg = env.RegOf(node, RegAlloc::OPERAND);
+    if (reg != -1) {
+        emit_move(reg, ACC, s);
+        return;
+    }
+    push_slot(ACC, s, env);
+}
+
+//
+// Get the value kept by save_operand into dest.
+//
+static void restore_operand(Expression node, int dest, MipsFunc& s,
+                            Environment& env) {
+    int reg = env.RegOf(node, RegAlloc::OPERAND);
+    if (reg != -1) {
+        emit_move(dest, reg, s);
+        return;
+    }
+    pop_slot(dest, s, env);
+}
+
+//*****************************************************************
+//
+// Unboxed Int arithmetic (-O, pass "unbox")
+//
+// An Int-typed expression can be evaluated with code_unboxed, which
+// leaves the raw machine word in ACC instead of a pointer to an Int
+// object.  The arithmetic nodes evaluate their operands that way, so the
+// intermediate values of an arithmetic tree are never allocated; only
+// the value of the whole tree is boxed, by code(), because code() is what
+// every place a value escapes uses: assignment, arguments, the method
+// result, let and attribute initializers, and any use as an Object.
+//
+// With the garbage collector on, a raw word must never be on the stack
+// while a collection can run, because the collector scans the stack for
+// pointers.  So the left operand is only kept raw while the right one is
+// evaluated if the right one cannot collect; otherwise it is kept boxed.
+//
+//*****************************************************************
+
+void Expression_class::code_unboxed(MipsFunc& s, Environment& env) {
+    if (code_unboxed_folded(this, s, env)) {
+        return;
+    }
+    code(s, env);
+    emit_fetch_int(ACC, ACC, s);
+}
+
+void int_const_class::code_unboxed(MipsFunc& s, Environment& env) {
+    emit_load_imm(ACC, (int) strtol(token->get_string(), nullptr, 10), s);
+}
+
+// May evaluating e with code_unboxed start a collection?
+static bool may_collect_unboxed(Expression e) {
+    return cgen_Memmgr != GC_NOGC && generated_expr(e)->MayCollect();
+}
+
+bool plus_class::MayCollect() {
+    return e1->MayCollect() || e2->MayCollect();
+}
+
+bool sub_class::MayCollect() {
+    return e1->MayCollect() || e2->MayCollect();
+}
+
+bool mul_class::MayCollect() {
+    return e1->MayCollect() || e2->MayCollect();
+}
+
+bool divide_class::MayCollect() {
+    return e1->MayCollect() || e2->MayCollect();
+}
+
+bool neg_class::MayCollect() {
+    return e1->MayCollect();
+}
+
+//
+// Evaluate e1 and e2 unboxed: e1 ends up in T1 and e2 in ACC.  e1 is
+// saved on the stack while e2 is evaluated, unless e2 is a leaf.
+//
+static void code_unboxed_operands(Expression node, Expression e1,
+                                  Expression e2, MipsFunc& s,
+                                  Environment& env) {
+    if (generated_expr(e2)->IsLeaf()) {
+        emit_comment("\t# e2 is a leaf: keep e1 in t1 while it is evaluated.", s);
+        e1->code_unboxed(s, env);
+        emit_move(T1, ACC, s);
+        e2->code_unboxed(s, env);
+        return;
+    }
+
+    bool raw = !may_collect_unboxed(e2);
+    emit_comment("\t# First eval e1 and push.", s);
+    if (raw) {
+        e1->code_unboxed(s, env);
+    } else {
+        e1->code(s, env);
+    }
+    save_operand(node, s, env);
+    emit_comment("", s);
+
+    emit_comment("\t# Then eval e2.", s);
+    e2->code_unboxed(s, env);
+    emit_comment("", s);
+
+    emit_comment("\t# Pop e1 to t1.", s);
+    restore_operand(node, T1, s, env);
+    if (!raw) {
+        emit_fetch_int(T1, T1, s);
+    }
+    emit_comment("", s);
+}
+
+//
+// code() of an arithmetic expression: allocate the Int for the result
+// first, then compute the value unboxed and store it in the new object.
+//
+static void code_boxed_result(Expression e, MipsFunc& s, Environment& env) {
+    int reg = env.RegOf(e, RegAlloc::RESULT);
+    if (reg != -1) {
+        // Nothing moves the raw value out of a register, so it can be
+        // computed first and kept there while the object is allocated.
+        emit_comment("\t# Eval it unboxed, then allocate the result.", s);
+        e->code_unboxed(s, env);
+        emit_move(reg, ACC, s);
+        emit_new_object(Int, s);
+        emit_store(reg, DEFAULT_OBJFIELDS, ACC, s);
+        emit_comment("", s);
+        return;
+    }
+
+    emit_comment("\t# Allocate the result, then eval it unboxed.", s);
+    emit_new_object(Int, s);
+    push_slot(ACC, s, env);
+    emit_comment("", s);
+
+    e->code_unboxed(s, env);
+
+    emit_comment("\t# Pop the result object and store the int in it.", s);
+    pop_slot(T1, s, env);
+    emit_store(ACC, DEFAULT_OBJFIELDS, T1, s);
+    emit_move(ACC, T1, s);
+    emit_comment("", s);
+}
+
+//
+// Compare e1 and e2 unboxed with the branch op: ACC = bool(e1 op e2).
+//
+static void code_unboxed_compare(MipsOp op, Expression node, Expression e1,
+                                 Expression e2, MipsFunc& s, Environment& env) {
+    code_unboxed_operands(node, e1, e2, s, env);
+    emit_move(T2, ACC, s);
+
+    emit_comment("\t# Pretend that the comparison holds", s);
+    emit_load_bool(ACC, BoolConst(1), s);
+    int finish = s.NewLabel();
+    emit_branch_rr(op, T1, T2, finish, s);
+
+    emit_load_bool(ACC, BoolConst(0), s);
+    emit_label_def(finish, s);
+}
+
+void plus_class::code_unboxed(MipsFunc& s, Environment& env) {
+    if (code_unboxed_folded(this, s, env)) {
+        return;
+    }
+    emit_comment("\t# Int operation : Add (unboxed)", s);
+    code_unboxed_operands(this, e1, e2, s, env);
+    emit_add(ACC, T1, ACC, s);
+}
+
+void sub_class::code_unboxed(MipsFunc& s, Environment& env) {
+    if (code_unboxed_folded(this, s, env)) {
+        return;
+    }
+    emit_comment("\t# Int operation : Sub (unboxed)", s);
+    code_unboxed_operands(this, e1, e2, s, env);
+    emit_sub(ACC, T1, ACC, s);
+}
+
+void mul_class::code_unboxed(MipsFunc& s, Environment& env) {
+    if (code_unboxed_folded(this, s, env)) {
+        return;
+    }
+    emit_comment("\t# Int operation : Mul (unboxed)", s);
+    code_unboxed_operands(this, e1, e2, s, env);
+    emit_mul(ACC, T1, ACC, s);
+}
+
+void divide_class::code_unboxed(MipsFunc& s, Environment& env) {
+    if (code_unboxed_folded(this, s, env)) {
+        return;
+    }
+    emit_comment("\t# Int operation : Div (unboxed)", s);
+    code_unboxed_operands(this, e1, e2, s, env);
+    emit_div(ACC, T1, ACC, s);
+}
+
+void neg_class::code_unboxed(MipsFunc& s, Environment& env) {
+    if (code_unboxed_folded(this, s, env)) {
+        return;
+    }
+    emit_comment("\t# Neg (unboxed)", s);
+    e1->code_unboxed(s, env);
+    emit_neg(ACC, ACC, s);
+}
+
+//*****************************************************************
+//
+// Branching on conditions (-O, pass "branch")
+//
+// The predicate of an if or a while is generated with code_branch,
+// which jumps to a label when the predicate has a given value and falls
+// through otherwise.  Comparisons, not and isvoid branch on the compared
+// values themselves, so the Bool object they would load is never built
+// and never tested.  Anything else is evaluated with code() and its Bool
+// tested as before.  The register intervals are the same as for code(),
+// except that not passes code_branch on to its operand.
+//
+//*****************************************************************
+
+void Expression_class::code_branch(MipsFunc& s, Environment& env, bool sense,
+                                   int label) {
+    if (code_branch_folded(this, s, env, sense, label)) {
+        return;
+    }
+    code(s, env);
+    emit_fetch_int(T1, ACC, s);
+    emit_branch_rr(sense ? MIPS_BNE : MIPS_BEQ, T1, ZERO, label, s);
+}
+
+//
+// Jump to label if (e1 op e2) == sense, op being a compare branch and
+// inverse its negation.  With unboxed, the operands are evaluated as
+// code_unboxed_operands does; otherwise as objects, and with fetch their
+// value fields are compared instead of the pointers.
+//
+static void code_compare_branch(MipsOp op, MipsOp inverse, bool unboxed,
+                                bool fetch, Expression node, Expression e1,
+                                Expression e2, bool sense, int label,
+                                MipsFunc& s, Environment& env) {
+    if (unboxed) {
+        code_unboxed_operands(node, e1, e2, s, env);
+    } else {
+        emit_comment("\t# First eval e1 and push.", s);
+        e1->code(s, env);
+        save_operand(node, s, env);
+        emit_comment("", s);
+
+        emit_comment("\t# Then eval e2.", s);
+        e2->code(s, env);
+        emit_comment("", s);
+
+        emit_comment("\t# Pop e1 to t1.", s);
+        restore_operand(node, T1, s, env);
+        if (fetch) {
+            emit_fetch_int(T1, T1, s);
+            emit_fetch_int(ACC, ACC, s);
+        }
+        emit_comment("", s);
+    }
+    emit_branch_rr(sense ? op : inverse, T1, ACC, label, s);
+}
+
+void lt_class::code_branch(MipsFunc& s, Environment& env, bool sense,
+                           int label) {
+    if (code_branch_folded(this, s, env, sense, label)) {
+        return;
+    }
+    emit_comment("\t# Branch on less than", s);
+    code_compare_branch(MIPS_BLT, MIPS_BGE, cgen_pass_enabled(PASS_UNBOX), true,
+                        this, e1, e2, sense, label, s, env);
+}
+
+void leq_class::code_branch(MipsFunc& s, Environment& env, bool sense,
+                            int label) {
+    if (code_branch_folded(this, s, env, sense, label)) {
+        return;
+    }
+    emit_comment("\t# Branch on less or equal", s);
+    code_compare_branch(MIPS_BLEQ, MIPS_BGT, cgen_pass_enabled(PASS_UNBOX), true,
+                        this, e1, e2, sense, label, s, env);
+}
+
+void eq_class::code_branch(MipsFunc& s, Environment& env, bool sense,
+                           int label) {
+    if (code_branch_folded(this, s, env, sense, label)) {
+        return;
+    }
+    if (e1->type == Int && e2->type == Int) {
+        emit_comment("\t# Branch on Int equality", s);
+        code_compare_branch(MIPS_BEQ, MIPS_BNE, cgen_pass_enabled(PASS_UNBOX),
+                            true, this, e1, e2, sense, label, s, env);
+    } else if (e1->type == Bool && e2->type == Bool) {
+        emit_comment("\t# Branch on Bool equality", s);
+        code_compare_branch(MIPS_BEQ, MIPS_BNE, false, true,
+                            this, e1, e2, sense, label, s, env);
+    } else if (e1->type == Str || e2->type == Str) {
+        // Strings are compared by equality_test.
+        Expression_class::code_branch(s, env, sense, label);
+    } else {
+        emit_comment("\t# Branch on pointer equality", s);
+        code_compare_branch(MIPS_BEQ, MIPS_BNE, false, false,
+                            this, e1, e2, sense, label, s, env);
+    }
+}
+
+void comp_class::code_branch(MipsFunc& s, Environment& env, bool sense,
+                             int label) {
+    if (code_branch_folded(this, s, env, sense, label)) {
+        return;
+    }
+    e1->code_branch(s, env, !sense, label);
+}
+
+void isvoid_class::code_branch(MipsFunc& s, Environment& env, bool sense,
+                               int label) {
+    if (code_branch_folded(this, s, env, sense, label)) {
+        return;
+    }
+    e1->code(s, env);
+    emit_comment("\t# Branch on acc == void", s);
+    emit_branch_rr(sense ? MIPS_BEQ : MIPS_BNE, ACC, ZERO, label, s);
+}
+
+//*****************************************************************
+//
+// Inlining (-O, pass "inline")
+//
+// A call whose target is known, because it is a static dispatch or
+// because no subclass overrides the method (see analyze_hierarchy), is
+// replaced by the body of the method if the body has at most
+// cgen_inline_size nodes (-i, 12 by default).  Methods of the basic
+// classes are implemented in the runtime and are never inlined.
+//
+// The call site pushes the actuals and checks the receiver as before.
+// The body is then generated with an Environment of its own, the one
+// method_class::code would give it except that the formals are the
+// pushed actuals, seen as let variables, and that nothing is kept in a
+// register.  Unless the receiver is self, $s0 is saved on the stack and
+// the receiver takes its place until the body is done.  Finally the
+// actuals are popped, as the callee would.
+//
+// An inlined body may contain calls that are inlined in turn, down to
+// INLINE_MAX_DEPTH methods; a method is never inlined into itself, so a
+// recursive call is always a call.
+//
+// The bodies are inlined into classes other than their own, so with -C
+// the bodies a class may inline (see find_inlined) are part of its
+// cache key.
+//
+//*****************************************************************
+
+#define INLINE_MAX_DEPTH 4
+
+int assign_class::Size() {
+    return 1 + expr->Size();
+}
+
+// The number of nodes of the expressions in l.
+static int list_size(Expressions l) {
+    int size = 0;
+    for (int i = l->first(); l->more(i); i = l->next(i)) {
+        size += l->nth(i)->Size();
+    }
+    return size;
+}
+
+int static_dispatch_class::Size() {
+    return 1 + expr->Size() + list_size(actual);
+}
+
+int dispatch_class::Size() {
+    return 1 + expr->Size() + list_size(actual);
+}
+
+int cond_class::Size() {
+    return 1 + pred->Size() + then_exp->Size() + else_exp->Size();
+}
+
+int loop_class::Size() {
+    return 1 + pred->Size() + body->Size();
+}
+
+int typcase_class::Size() {
+    int size = 1 + expr->Size();
+    for (branch_class* _case : GetCases()) {
+        size += _case->expr->Size();
+    }
+    return size;
+}
+
+int block_class::Size() {
+    return 1 + list_size(body);
+}
+
+int let_class::Size() {
+    return 1 + init->Size() + body->Size();
+}
+
+int plus_class::Size() {
+    return 1 + e1->Size() + e2->Size();
+}
+
+int sub_class::Size() {
+    return 1 + e1->Size() + e2->Size();
+}
+
+int mul_class::Size() {
+    return 1 + e1->Size() + e2->Size();
+}
+
+int divide_class::Size() {
+    return 1 + e1->Size() + e2->Size();
+}
+
+int neg_class::Size() {
+    return 1 + e1->Size();
+}
+
+int lt_class::Size() {
+    return 1 + e1->Size() + e2->Size();
+}
+
+int eq_class::Size() {
+    return 1 + e1->Size() + e2->Size();
+}
+
+int leq_class::Size() {
+    return 1 + e1->Size() + e2->Size();
+}
+
+int comp_class::Size() {
+    return 1 + e1->Size();
+}
+
+int int_const_class::Size() {
+    return 1;
+}
+
+int bool_const_class::Size() {
+    return 1;
+}
+
+int string_const_class::Size() {
+    return 1;
+}
+
+int new__class::Size() {
+    return 1;
+}
+
+int isvoid_class::Size() {
+    return 1 + e1->Size();
+}
+
+int no_expr_class::Size() {
+    return 0;
+}
+
+int object_class::Size() {
+    return 1;
+}
+
+void CgenClassTable::find_inline_candidates() {
+    for (CgenNode* class_node : GetClassNodes()) {
+        if (class_node->basic()) {
+            continue;
+        }
+        for (method_class* method : class_node->GetMethods()) {
+            if (method->expr->Size() <= cgen_inline_size) {
+                m_inline_bodies.insert(method);
+            }
+        }
+    }
+}
+
+// Add method, as implemented by impl_class, to inlined if a call of it
+// may be replaced by its body, together with what that body inlines.
+static void add_inlined(method_class* method, Symbol impl_class,
+                        std::vector<method_class*>& inlined) {
+    if (!codegen_classtable->CanInline(method) ||
+        std::find(inlined.begin(), inlined.end(), method) != inlined.end()) {
+        return;
+    }
+    inlined.push_back(method);
+    find_inlined(method->expr, codegen_classtable->GetClassNode(impl_class),
+                 inlined);
+}
+
+static void find_inlined_list(Expressions l, CgenNode* class_node,
+                              std::vector<method_class*>& inlined) {
+    for (int i = l->first(); l->more(i); i = l->next(i)) {
+        find_inlined(l->nth(i), class_node, inlined);
+    }
+}
+
+//
+// Add to inlined, in the order they are found, the methods whose bodies
+// may be generated in place of a call in e, generated as code of
+// class_node, and the methods those bodies inline in turn.  This is
+// used for the cache key of a class; it ignores INLINE_MAX_DEPTH,
+// recursion and tail calls, so it may name more bodies than are
+// actually inlined, never fewer.
+//
+static void find_inlined(Expression e, CgenNode* class_node,
+                         std::vector<method_class*>& inlined) {
+    if (static_dispatch_class* d = dynamic_cast<static_dispatch_class*>(e)) {
+        find_inlined(d->expr, class_node, inlined);
+        find_inlined_list(d->actual, class_node, inlined);
+        const CgenLayout& layout =
+            codegen_classtable->GetClassNode(d->type_name)->GetLayout();
+        int idx = layout.MethodSlot(d->name);
+        add_inlined(layout.methods[idx], layout.method_classes[idx], inlined);
+    } else if (dispatch_class* d = dynamic_cast<dispatch_class*>(e)) {
+        find_inlined(d->expr, class_node, inlined);
+        find_inlined_list(d->actual, class_node, inlined);
+        Symbol class_name = d->expr->get_type() == SELF_TYPE ?
+                            class_node->name : d->expr->get_type();
+        CgenNode* target = codegen_classtable->GetClassNode(class_name);
+        const CgenLayout& layout = target->GetLayout();
+        int idx = layout.MethodSlot(d->name);
+        if (target->HasSingleImpl(idx)) {
+            add_inlined(layout.methods[idx], layout.method_classes[idx],
+                        inlined);
+        }
+    } else if (assign_class* a = dynamic_cast<assign_class*>(e)) {
+        find_inlined(a->expr, class_node, inlined);
+    } else if (cond_class* c = dynamic_cast<cond_class*>(e)) {
+        find_inlined(c->pred, class_node, inlined);
+        find_inlined(c->then_exp, class_node, inlined);
+        find_inlined(c->else_exp, class_node, inlined);
+    } else if (loop_class* l = dynamic_cast<loop_class*>(e)) {
+        find_inlined(l->pred, class_node, inlined);
+        find_inlined(l->body, class_node, inlined);
+    } else if (typcase_class* c = dynamic_cast<typcase_class*>(e)) {
+        find_inlined(c->expr, class_node, inlined);
+        for (branch_class* branch : c->GetCases()) {
+            find_inlined(branch->expr, class_node, inlined);
+        }
+    } else if (block_class* b = dynamic_cast<block_class*>(e)) {
+        find_inlined_list(b->body, class_node, inlined);
+    } else if (let_class* l = dynamic_cast<let_class*>(e)) {
+        find_inlined(l->init, class_node, inlined);
+        find_inlined(l->body, class_node, inlined);
+    } else if (plus_class* a = dynamic_cast<plus_class*>(e)) {
+        find_inlined(a->e1, class_node, inlined);
+        find_inlined(a->e2, class_node, inlined);
+    } else if (sub_class* a = dynamic_cast<sub_class*>(e)) {
+        find_inlined(a->e1, class_node, inlined);
+        find_inlined(a->e2, class_node, inlined);
+    } else if (mul_class* a = dynamic_cast<mul_class*>(e)) {
+        find_inlined(a->e1, class_node, inlined);
+        find_inlined(a->e2, class_node, inlined);
+    } else if (divide_class* a = dynamic_cast<divide_class*>(e)) {
+        find_inlined(a->e1, class_node, inlined);
+        find_inlined(a->e2, class_node, inlined);
+    } else if (lt_class* a = dynamic_cast<lt_class*>(e)) {
+        find_inlined(a->e1, class_node, inlined);
+        find_inlined(a->e2, class_node, inlined);
+    } else if (eq_class* a = dynamic_cast<eq_class*>(e)) {
+        find_inlined(a->e1, class_node, inlined);
+        find_inlined(a->e2, class_node, inlined);
+    } else if (leq_class* a = dynamic_cast<leq_class*>(e)) {
+        find_inlined(a->e1, class_node, inlined);
+        find_inlined(a->e2, class_node, inlined);
+    } else if (neg_class* a = dynamic_cast<neg_class*>(e)) {
+        find_inlined(a->e1, class_node, inlined);
+    } else if (comp_class* a = dynamic_cast<comp_class*>(e)) {
+        find_inlined(a->e1, class_node, inlined);
+    } else if (isvoid_class* a = dynamic_cast<isvoid_class*>(e)) {
+        find_inlined(a->e1, class_node, inlined);
+    }
+}
+
+// Code that aborts unless the receiver of a dispatch, in ACC, is an object.
+static void emit_void_check(MipsFunc& s) {
+    emit_comment("\t# if obj = void: abort", s);
+    int not_void = s.NewLabel();
+    emit_bne(ACC, ZERO, not_void, s);
+    emit_load_address(ACC, "str_const0", s);
+    emit_load_imm(T1, 1, s);
+    emit_jal("_dispatch_abort", s);
+
+    emit_label_def(not_void, s);
+}
+
+// Is call, to method, whose target is known, to be replaced by its body?
+// Not if it is a tail call and the body ends in a call: in an inlined
+// body that would no longer be a tail call.
+static bool can_inline(method_class* method, Expression call,
+                       Environment& env) {
+    const std::vector<method_class*>& chain = env.m_inline_chain;
+    if (!cgen_pass_enabled(PASS_INLINE) ||
+        !codegen_classtable->CanInline(method) ||
+        chain.size() >= INLINE_MAX_DEPTH ||
+        std::find(chain.begin(), chain.end(), method) != chain.end()) {
+        return false;
+    }
+    std::set<Expression> body_tail_calls;
+    if (env.m_tail_calls.count(call) != 0) {
+        find_tail_calls(method->expr, body_tail_calls);
+    }
+    return body_tail_calls.empty();
+}
+
+//
+// Generate the call of method, as implemented by impl_class, on receiver
+// with actuals as the body of the method.  The actuals are kept in stack
+// slots of env, which become the formals of the body.
+//
+static void code_inlined(method_class* method, Symbol impl_class,
+                         Expression receiver,
+                         const std::vector<Expression>& actuals,
+                         MipsFunc& s, Environment& env) {
+    if (!cgen_passes_measuring()) {
+        ++inlined_sites;
+    }
+
+    emit_comment("\t# Inlined call. First eval and save the params.", s);
+    for (Expression actual : actuals) {
+        actual->code(s, env);
+        push_slot(ACC, s, env);
+    }
+
+    emit_comment("\t# eval the obj in dispatch.", s);
+    receiver->code(s, env);
+    emit_void_check(s);
+
+    Environment inner;
+    inner.m_class_node = codegen_classtable->GetClassNode(impl_class);
+    inner.m_inline_chain = env.m_inline_chain;
+    inner.m_inline_chain.push_back(method);
+    inner.ShareFrame(env, actuals.size());
+    inner.EnterScope();
+    Formals formals = method->formals;
+    for (int i = formals->first(); formals->more(i); i = formals->next(i)) {
+        inner.AddVar(formals->nth(i)->GetName());
+    }
+    int words = actuals.size();
+
+    object_class* object = dynamic_cast<object_class*>(receiver);
+    bool same_self = object != nullptr && object->name == self;
+    int self_base, self_offset;
+    if (!same_self) {
+        emit_comment("\t# save self; the receiver is self in the body", s);
+        push_slot(SELF, s, inner);
+        inner.TopSlotAddr(self_base, self_offset);
+        emit_move(SELF, ACC, s);
+        ++words;
+    }
+
+    emit_comment("\t# inlined body of ", method->name, s);
+    method->expr->code(s, inner);
+    emit_comment("", s);
+
+    if (!same_self) {
+        emit_comment("\t# restore self", s);
+        emit_load(SELF, self_offset, self_base, s);
+    }
+    if (env.m_frame_base == -1 && words > 0) {
+        emit_comment("\t# pop the arguments", s);
+        emit_addiu(SP, SP, 4 * words, s);
+    }
+    emit_comment("", s);
+
+    env.m_max_slots = std::max(env.m_max_slots, inner.m_max_slots);
+    for (size_t i = 0; i < actuals.size(); ++i) {
+        env.ExitScope();
+    }
+}
+
+//*****************************************************************
+//
+// Tail calls (-O, pass "tail")
+//
+// A call whose value is the value of the method, found by following the
+// last expression of blocks, both arms of ifs, let bodies and case
+// branches from the method body, does not return to it.  It leaves the
+// frame of the method before it jumps to the callee: the saved
+// registers, $s0, $ra and $fp are restored, and the actuals are moved up
+// over the arguments of the method, so the callee pops them and returns
+// straight to our caller.  A call of the method itself on self does not
+// even leave the frame: the actuals become the arguments and it jumps
+// back to the start of the body.  Either way a deep recursion runs in
+// constant stack.
+//
+// Inlined bodies have no tail calls of their own.
+//
+//*****************************************************************
+
+static void find_tail_calls(Expression e, std::set<Expression>& calls) {
+    if (block_class* b = dynamic_cast<block_class*>(e)) {
+        find_tail_calls(b->body->nth(b->body->len() - 1), calls);
+        return;
+    }
+    if (typcase_class* c = dynamic_cast<typcase_class*>(e)) {
+        for (branch_class* branch : c->GetCases()) {
+            find_tail_calls(branch->expr, calls);
+        }
+        return;
+    }
+    // The other nodes generate what they were folded to.
+    e = generated_expr(e);
+    if (dynamic_cast<dispatch_class*>(e) != nullptr ||
+        dynamic_cast<static_dispatch_class*>(e) != nullptr) {
+        calls.insert(e);
+    } else if (cond_class* c = dynamic_cast<cond_class*>(e)) {
+        find_tail_calls(c->then_exp, calls);
+        find_tail_calls(c->else_exp, calls);
+    } else if (let_class* l = dynamic_cast<let_class*>(e)) {
+        find_tail_calls(l->body, calls);
+    }
 }
 
-
-CgenNodeP CgenClassTable::root() {
-    return probe(Object);
+// Is the call of method on receiver a tail call of the method being
+// generated back to itself?
+static bool is_self_tail_call(method_class* method, Expression receiver,
+                              Environment& env) {
+    object_class* object = dynamic_cast<object_class*>(receiver);
+    return object != nullptr && object->name == self &&
+           method == env.m_inline_chain.front();
 }
 
-
-///////////////////////////////////////////////////////////////////////
 //
-// CgenNode methods
+// The tail call of method with nargs actuals, pushed last, on the
+// receiver in ACC.  The callee is the method itself if self_call, or
+// else its address is in T1.
 //
-///////////////////////////////////////////////////////////////////////
+static void emit_tail_call(int nargs, bool self_call, MipsFunc& s,
+                           Environment& env) {
+    if (!cgen_passes_measuring()) {
+        ++tail_calls;
+        self_tail_calls += self_call;
+    }
+    int nparams = env.NumParams();
 
-CgenNode::CgenNode(Class_ nd, Basicness bstatus, CgenClassTableP ct) :
-    class__class((const class__class&) *nd),
-    parentnd(NULL),
-    children(NULL),
-    basic_status(bstatus) {
-    stringtable.add_string(name->get_string());          // Add class name to string table
-}
+    if (self_call) {
+        emit_comment("\t# Tail call of this method: the actuals become the arguments", s);
+        for (int k = 0; k < nargs; ++k) {
+            emit_load(T1, nargs - k, SP, s);
+            emit_store(T1, 2 + nparams - k, FP, s);
+        }
+        int words = env.m_frame_base == -1 ? env.StackSlots() : nargs;
+        if (words > 0) {
+            emit_addiu(SP, SP, 4 * words, s);
+        }
+        if (env.m_entry_label == -1) {
+            env.m_entry_label = s.NewLabel();
+        }
+        emit_branch(env.m_entry_label, s);
+        emit_comment("", s);
+        actuals_popped(nargs, env);
+        return;
+    }
 
+    emit_comment("\t# Tail call: leave the frame first", s);
+    const std::vector<int>& saved = *env.m_saved_regs;
+    int nsaved = saved.size();
+    for (int i = 0; i < nsaved; ++i) {
+        emit_load(saved[i], i - nsaved, FP, s);
+    }
+    emit_load(RA, 0, FP, s);
+    emit_load(SELF, 1, FP, s);
+    emit_move(T3, FP, s);
+    emit_load(FP, 2, T3, s);
+    emit_comment("\t# move the actuals over the arguments of this method", s);
+    for (int k = 0; k < nargs; ++k) {
+        emit_load(T2, nargs - k, SP, s);
+        emit_store(T2, 2 + nparams - k, T3, s);
+    }
+    emit_addiu(SP, T3, 8 + 4 * (nparams - nargs), s);
+    emit_jr(T1, s);
+    emit_comment("", s);
+    actuals_popped(nargs, env);
+}
 
-//******************************************************************
+//*****************************************************************
 //
-//   Fill in the following methods to produce code for the
-//   appropriate expression.  You may add or remove parameters
-//   as you wish, but if you do, remember to change the parameters
-//   of the declarations in `cool-tree.h'  Sample code for
-//   constant integers, strings, and booleans are provided.
+// Write barriers (-g; pass "barrier" with -O)
+//
+// The generational collector finds the pointers from old objects to
+// young ones in a table that _GenGC_Assign adds the address of a field
+// to.  The stack is scanned at every collection, so reading a variable
+// and storing into a let variable or a parameter need no barrier; only
+// a store into an attribute gets one.  With the pass on, it is left out
+// when the stored value is not in the heap at all (a constant, a Bool
+// from a comparison, not or isvoid, or void), and, in a class's init,
+// while the object is still young: it was allocated just before the
+// init ran, and no collection has happened since as long as the parent
+// inits and the initializers so far could not allocate.
+//
+// Each function counts the barriers it kept and left out; -c with -g
+// prints them for every function that has attribute stores.
 //
 //*****************************************************************
 
-void assign_class::code(ostream& s, Environment env) {
+// Is the value of e, as code() leaves it in ACC, outside the heap?
+static bool is_static_value(Expression e) {
+    Expression g = generated_expr(e);
+    return dynamic_cast<int_const_class*>(g) != nullptr ||
+           dynamic_cast<bool_const_class*>(g) != nullptr ||
+           dynamic_cast<string_const_class*>(g) != nullptr ||
+           dynamic_cast<no_expr_class*>(g) != nullptr ||
+           dynamic_cast<lt_class*>(g) != nullptr ||
+           dynamic_cast<leq_class*>(g) != nullptr ||
+           dynamic_cast<eq_class*>(g) != nullptr ||
+           dynamic_cast<comp_class*>(g) != nullptr ||
+           dynamic_cast<isvoid_class*>(g) != nullptr;
+}
+
+// May evaluating e with code() start a collection?  Only constants,
+// variables and comparisons of them are known not to.
+static bool may_collect_boxed(Expression e) {
+    Expression g = generated_expr(e);
+    if (dynamic_cast<int_const_class*>(g) != nullptr ||
+        dynamic_cast<bool_const_class*>(g) != nullptr ||
+        dynamic_cast<string_const_class*>(g) != nullptr ||
+        dynamic_cast<no_expr_class*>(g) != nullptr ||
+        dynamic_cast<object_class*>(g) != nullptr) {
+        return false;
+    }
+    if (lt_class* c = dynamic_cast<lt_class*>(g)) {
+        return may_collect_boxed(c->e1) || may_collect_boxed(c->e2);
+    }
+    if (leq_class* c = dynamic_cast<leq_class*>(g)) {
+        return may_collect_boxed(c->e1) || may_collect_boxed(c->e2);
+    }
+    if (eq_class* c = dynamic_cast<eq_class*>(g)) {
+        return may_collect_boxed(c->e1) || may_collect_boxed(c->e2);
+    }
+    if (comp_class* c = dynamic_cast<comp_class*>(g)) {
+        return may_collect_boxed(c->e1);
+    }
+    if (isvoid_class* c = dynamic_cast<isvoid_class*>(g)) {
+        return may_collect_boxed(c->e1);
+    }
+    return true;
+}
+
+// May the init of the class start a collection?  The inits of the basic
+// classes do nothing.  A class's own init keeps no barrier, and so cannot
+// collect, when its parent's init and its initializers cannot.
+static bool init_may_collect(CgenNode* class_node) {
+    if (class_node->basic()) {
+        return false;
+    }
+    if (init_may_collect(class_node->get_parentnd())) {
+        return true;
+    }
+    for (attr_class* attrib : class_node->GetAttribs()) {
+        if (may_collect_boxed(attrib->init)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// The barrier after ACC was stored into attribute idx of self, unless
+// elide says it is not needed.
+static void emit_attrib_barrier(int idx, bool elide, MipsFunc& s) {
+    if (cgen_Memmgr == GC_NOGC) {
+        return;
+    }
+    if (elide && cgen_pass_enabled(PASS_BARRIER)) {
+        ++s.barriers_elided;
+        return;
+    }
+    ++s.barriers_kept;
+    emit_gc_assign(SELF, idx + 3, s);
+}
+
+void assign_class::code(MipsFunc& s, Environment& env) {
 
 // 赋值表达式的代码生成
 // 处理COOL中的变量赋值操作，支持局部变量、参数和属性
-    s << "\t# Assign. First eval the expr." << endl;
+    emit_comment("\t# Assign. First eval the expr.", s);
     expr->code(s, env);
 
-    s << "\t# Now find the lvalue." << endl;
+    emit_comment("\t# Now find the lvalue.", s);
     int idx;
 
-    if ((idx = env.LookUpVar(name)) != -1) {
-        s << "\t# It is a let variable." << endl;
-        emit_store(ACC, idx + 1, SP, s);
-        if (cgen_Memmgr == 1) {
-            emit_addiu(A1, SP, 4 * (idx + 1), s);
-            emit_jal("_GenGC_Assign", s);
-        }
+    if ((idx = env.LookUpVarReg(name)) != -1) {
+        emit_comment("\t# It is a let variable in a register.", s);
+        emit_move(idx, ACC, s);
+    } else if ((idx = env.LookUpVar(name)) != -1) {
+        emit_comment("\t# It is a let variable.", s);
+        int base, offset;
+        env.SlotAddr(idx, base, offset);
+        emit_store(ACC, offset, base, s);
+    } else if ((idx = env.LookUpParamReg(name)) != -1) {
+        emit_comment("\t# It is a param in a register.", s);
+        emit_move(idx, ACC, s);
     } else if ((idx = env.LookUpParam(name)) != -1){
-        s << "\t# It is a param." << endl;
+        emit_comment("\t# It is a param.", s);
         emit_store(ACC, idx + 3, FP, s);
-        if (cgen_Memmgr == 1) {
-            emit_addiu(A1, FP, 4 * (idx + 3), s);
-            emit_jal("_GenGC_Assign", s);
-        }
     }
     else if ((idx = env.LookUpAttrib(name)) != -1) {
-        s << "\t# It is an attribute." << endl;
+        emit_comment("\t# It is an attribute.", s);
         emit_store(ACC, idx + 3, SELF, s);
-        if (cgen_Memmgr == 1) {
-            emit_addiu(A1, SELF, 4 * (idx + 3), s);
-            emit_jal("_GenGC_Assign", s);
-        }
-
+        emit_attrib_barrier(idx, is_static_value(expr), s);
     } else {
-        s << "Error! assign to what?" << endl;
+        emit_comment("Error! assign to what?", s);
     }
 }
 
-void static_dispatch_class::code(ostream& s, Environment env) {
-    s << "\t# Static dispatch. First eval and save the params." << endl;
-
+void static_dispatch_class::code(MipsFunc& s, Environment& env) {
     std::vector<Expression> actuals = GetActuals();
-    Environment new_env = env;
+    Symbol _class_name = type_name;
+    CgenNode* _class_node = codegen_classtable->GetClassNode(type_name);
+    const CgenLayout& layout = _class_node->GetLayout();
+    int idx = layout.MethodSlot(name);
+    if (can_inline(layout.methods[idx], this, env)) {
+        code_inlined(layout.methods[idx], layout.method_classes[idx], expr,
+                     actuals, s, env);
+        return;
+    }
+
+    emit_comment("\t# Static dispatch. First eval and save the params.", s);
     for (Expression expr : actuals) {
         expr->code(s, env);
-        emit_push(ACC, s);
-        env.EnterScope();
-        env.AddObstacle();
+        push_actual(s, env);
     }
 
-    s << "\t# eval the obj in dispatch." << endl;
+    emit_comment("\t# eval the obj in dispatch.", s);
     expr->code(s, env);
+    emit_void_check(s);
 
-    s << "\t# if obj = void: abort" << endl;
-    emit_bne(ACC, ZERO, labelnum, s);
-    s << LA << ACC << " str_const0" << endl;
-    emit_load_imm(T1, 1, s);
-    emit_jal("_dispatch_abort", s);
-
-    emit_label_def(labelnum, s);
-    ++labelnum;
+    bool tail = env.m_tail_calls.count(this) != 0;
+    if (tail && is_self_tail_call(layout.methods[idx], expr, env)) {
+        emit_tail_call(actuals.size(), true, s, env);
+        return;
+    }
+    if (tail && cgen_pass_enabled(PASS_DEVIRT)) {
+        emit_load_method(T1, layout.method_classes[idx], name, s);
+        emit_tail_call(actuals.size(), false, s, env);
+        return;
+    }
+    if (cgen_pass_enabled(PASS_DEVIRT)) {
+        emit_comment("\t# The method is known: call it directly.", s);
+        emit_jal_method(layout.method_classes[idx], name, s);
+        emit_comment("", s);
+        actuals_popped(actuals.size(), env);
+        return;
+    }
 
-    Symbol _class_name = type_name;
-    CgenNode* _class_node = codegen_classtable->GetClassNode(type_name);
-    s << "\t# Now we locate the method in the dispatch table." << endl;
-    s << "\t# t1 = " << type_name << ".dispTab" << endl;
+    emit_comment("\t# Now we locate the method in the dispatch table.", s);
+    emit_comment(s.Intern(std::string("\t# t1 = ") + type_name->get_string() + ".dispTab"), s);
 
-    std::string addr = type_name->get_string();
-    addr += DISPTAB_SUFFIX;
-    emit_load_address(T1, addr.c_str(), s);
+    emit_load_symbol(T1, ADDR_DISPTAB, type_name, s);
 
-    s << endl;
+    emit_comment("", s);
 
-    int idx = _class_node->GetDispatchIdxTab()[name];
-    s << "\t# t1 = dispTab[offset]" << endl;
+    emit_comment("\t# t1 = dispTab[offset]", s);
     emit_load(T1, idx, T1, s);
-    s << endl;
+    emit_comment("", s);
 
-    s << "\t# jumpto " << name << endl;
+    if (tail) {
+        emit_tail_call(actuals.size(), false, s, env);
+        return;
+    }
+    emit_comment("\t# jumpto ", name, s);
     emit_jalr(T1, s);
-    s << endl;
+    emit_comment("", s);
 
+    actuals_popped(actuals.size(), env);
 }
 
-void dispatch_class::code(ostream& s, Environment env) {
-    s << "\t# Dispatch. First eval and save the params." << endl;
+void dispatch_class::code(MipsFunc& s, Environment& env) {
+    if (code_folded(this, s, env)) {
+        return;
+    }
     std::vector<Expression> actuals = GetActuals();
 
+    // Get current class name;
+    Symbol _class_name = env.m_class_node->name;
+    if (expr->get_type() != SELF_TYPE) {
+        _class_name = expr->get_type();
+    }
+
+    CgenNode* _class_node = codegen_classtable->GetClassNode(_class_name);
+    const CgenLayout& layout = _class_node->GetLayout();
+    int idx = layout.MethodSlot(name);
+    bool direct = _class_node->HasSingleImpl(idx);
+    if (cgen_pass_enabled(PASS_DEVIRT) && !cgen_passes_measuring()) {
+        ++dispatch_sites;
+        devirtualized_sites += direct;
+    }
+    if (direct && can_inline(layout.methods[idx], this, env)) {
+        code_inlined(layout.methods[idx], layout.method_classes[idx], expr,
+                     actuals, s, env);
+        return;
+    }
+
+    emit_comment("\t# Dispatch. First eval and save the params.", s);
     for (Expression expr : actuals) {
         expr->code(s, env);
-        emit_push(ACC, s);
-        env.AddObstacle();
+        push_actual(s, env);
     }
 
-    s << "\t# eval the obj in dispatch." << endl;
+    emit_comment("\t# eval the obj in dispatch.", s);
     expr->code(s, env);
+    emit_void_check(s);
 
-    s << "\t# if obj = void: abort" << endl;
-    emit_bne(ACC, ZERO, labelnum, s);
-    s << LA << ACC << " str_const0" << endl;
-    emit_load_imm(T1, 1, s);
-    emit_jal("_dispatch_abort", s);
-
-    emit_label_def(labelnum, s);
-    ++labelnum;
-
-    // Get current class name;
-    Symbol _class_name = env.m_class_node->name;
-    if (expr->get_type() != SELF_TYPE) {
-        _class_name = expr->get_type();
+    bool tail = env.m_tail_calls.count(this) != 0;
+    if (tail && direct) {
+        if (is_self_tail_call(layout.methods[idx], expr, env)) {
+            emit_tail_call(actuals.size(), true, s, env);
+            return;
+        }
+        if (cgen_pass_enabled(PASS_DEVIRT)) {
+            emit_load_method(T1, layout.method_classes[idx], name, s);
+            emit_tail_call(actuals.size(), false, s, env);
+            return;
+        }
+    }
+    if (cgen_pass_enabled(PASS_DEVIRT)) {
+        if (direct) {
+            emit_comment("\t# No subclass overrides the method: call it directly.", s);
+            emit_jal_method(layout.method_classes[idx], name, s);
+            emit_comment("", s);
+            actuals_popped(actuals.size(), env);
+            return;
+        }
     }
 
-    CgenNode* _class_node = codegen_classtable->GetClassNode(_class_name);
-    s << "\t# Now we locate the method in the dispatch table." << endl;
-    s << "\t# t1 = self.dispTab" << endl;
+    emit_comment("\t# Now we locate the method in the dispatch table.", s);
+    emit_comment("\t# t1 = self.dispTab", s);
     emit_load(T1, 2, ACC, s);
-    s << endl;
+    emit_comment("", s);
 
-    int idx = _class_node->GetDispatchIdxTab()[name];
-    s << "\t# t1 = dispTab[offset]" << endl;
+    emit_comment("\t# t1 = dispTab[offset]", s);
     emit_load(T1, idx, T1, s);
-    s << endl;
+    emit_comment("", s);
 
-    s << "\t# jumpto " << name << endl;
+    if (tail) {
+        emit_tail_call(actuals.size(), false, s, env);
+        return;
+    }
+    emit_comment("\t# jumpto ", name, s);
     emit_jalr(T1, s);
-    s << endl;
+    emit_comment("", s);
 
+    actuals_popped(actuals.size(), env);
 }
 
-void cond_class::code(ostream& s, Environment env) {
-    s << "\t# If statement. First eval condition." << endl;
-    pred->code(s, env);
-
-    s << "\t# extract the bool content from acc to t1" << endl;
-    emit_fetch_int(T1, ACC, s);
-    s << endl;
-
-    int labelnum_false = labelnum++;
-    int labelnum_finish = labelnum++;
-    // labelnum : false.
-    // labelnum + 1: finish
-    s << "\t# if t1 == 0 goto false" << endl;
-    emit_beq(T1, ZERO, labelnum_false, s);
-    s << endl;
+void cond_class::code(MipsFunc& s, Environment& env) {
+    if (code_folded(this, s, env)) {
+        return;
+    }
+    int labelnum_false;
+    int labelnum_finish;
+    if (cgen_pass_enabled(PASS_BRANCH)) {
+        labelnum_false = s.NewLabel();
+        labelnum_finish = s.NewLabel();
+        emit_comment("\t# If statement. Goto false unless the condition holds.", s);
+        pred->code_branch(s, env, false, labelnum_false);
+        emit_comment("", s);
+    } else {
+        emit_comment("\t# If statement. First eval condition.", s);
+        pred->code(s, env);
+
+        emit_comment("\t# extract the bool content from acc to t1", s);
+        emit_fetch_int(T1, ACC, s);
+        emit_comment("", s);
+
+        labelnum_false = s.NewLabel();
+        labelnum_finish = s.NewLabel();
+        emit_comment("\t# if t1 == 0 goto false", s);
+        emit_beq(T1, ZERO, labelnum_false, s);
+        emit_comment("", s);
+    }
 
     then_exp->code(s, env);
 
-    s << "\t# jumpt finish" << endl;
+    emit_comment("\t# jumpt finish", s);
     emit_branch(labelnum_finish, s);
-    s << endl;
+    emit_comment("", s);
 
-    s << "# False:" << endl;
+    emit_comment("# False:", s);
     emit_label_def(labelnum_false, s);
 
     else_exp->code(s, env);
 
-    s << "# Finish:" << endl;
+    emit_comment("# Finish:", s);
     emit_label_def(labelnum_finish, s);
 
 }
 
-void loop_class::code(ostream& s, Environment env) {
-    int start = labelnum;
-    int finish = labelnum + 1;
-    labelnum += 2;
+void loop_class::code(MipsFunc& s, Environment& env) {
+    if (cgen_pass_enabled(PASS_BRANCH)) {
+        int start = s.NewLabel();
+        int test = s.NewLabel();
+
+        // Test the condition at the bottom, so that an iteration takes
+        // one branch instead of two.
+        emit_comment("\t# While loop. Jumpto the condition first.", s);
+        emit_branch(test, s);
+
+        emit_comment("\t# start:", s);
+        emit_label_def(start, s);
+        body->code(s, env);
+
+        emit_comment("\t# If pred jumpto start", s);
+        emit_label_def(test, s);
+        pred->code_branch(s, env, true, start);
+        emit_comment("", s);
+
+        emit_comment("\t# ACC = void", s);
+        emit_move(ACC, ZERO, s);
+        return;
+    }
 
-    s << "\t# While loop" << endl;
-    s << "\t# start:" << endl;
+    int start = s.NewLabel();
+    int finish = s.NewLabel();
+
+    emit_comment("\t# While loop", s);
+    emit_comment("\t# start:", s);
     emit_label_def(start, s);
 
-    s << "\t# ACC = pred" << endl;
+    emit_comment("\t# ACC = pred", s);
     pred->code(s, env);
 
-    s << "\t# extract int inside bool" << endl;
+    emit_comment("\t# extract int inside bool", s);
     emit_fetch_int(T1, ACC, s);
-    s << endl;
+    emit_comment("", s);
 
-    s << "\t# if pred == false jumpto finish" << endl;
+    emit_comment("\t# if pred == false jumpto finish", s);
     emit_beq(T1, ZERO, finish, s);
-    s << endl;
+    emit_comment("", s);
 
     body->code(s, env);
 
-    s << "\t# Jumpto start" << endl;
+    emit_comment("\t# Jumpto start", s);
     emit_branch(start, s);
 
-    s << "\t# Finish:" << endl;
+    emit_comment("\t# Finish:", s);
     emit_label_def(finish, s);
     
-    s << "\t# ACC = void" << endl;
+    emit_comment("\t# ACC = void", s);
     emit_move(ACC, ZERO, s);
 
 }
 
-void typcase_class::code(ostream& s, Environment env) {
-    std::map<Symbol, int> _class_tags = codegen_classtable->GetClassTags();
-    std::vector<CgenNode*> _class_nodes = codegen_classtable->GetClassNodes();
+//
+// Pass "case": class tags are numbered in preorder, so the classes that
+// conform to C are exactly the tags C.class_tag..C.last_tag, and each
+// branch is a test of the tag in T1 against one range.  A tag is in the
+// ranges of all the branch classes it conforms to, which lie on one
+// path of the tree; case picks the deepest of them, so the branches are
+// tested deepest first.  With many branches over a small range of tags
+// the tag indexes a jump table instead.  Control falls through to the
+// code for no match.
+//
+#define CASE_TABLE_MIN_BRANCHES 6
+#define CASE_TABLE_MAX_SPAN     4   // table entries per branch
+
+static int class_depth(CgenNode* class_node) {
+    int depth = 0;
+    for (; class_node->get_parentnd() != nullptr &&
+           class_node->get_parentnd()->name != No_class;
+         class_node = class_node->get_parentnd()) {
+        ++depth;
+    }
+    return depth;
+}
+
+static void code_case_tests(const std::vector<branch_class*>& cases,
+                            int labelbeg, MipsFunc& s) {
+    std::vector<CgenNode*> classes;
+    std::vector<int> order;
+    int lo = INT_MAX;
+    int hi = -1;
+    for (int i = 0; i < (int) cases.size(); ++i) {
+        CgenNode* class_node = codegen_classtable->GetClassNode(cases[i]->type_decl);
+        classes.push_back(class_node);
+        order.push_back(i);
+        lo = std::min(lo, class_node->class_tag);
+        hi = std::max(hi, class_node->last_tag);
+    }
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+        return class_depth(classes[a]) > class_depth(classes[b]);
+    });
+
+    int no_match = s.NewLabel();
+    int span = hi - lo + 1;
+    if ((int) cases.size() >= CASE_TABLE_MIN_BRANCHES &&
+        span <= CASE_TABLE_MAX_SPAN * (int) cases.size()) {
+        // The least specific branches first, so that the entries of the
+        // more specific ones overwrite theirs.
+        std::vector<int> targets(span, no_match);
+        for (auto it = order.rbegin(); it != order.rend(); ++it) {
+            for (int tag = classes[*it]->class_tag;
+                 tag <= classes[*it]->last_tag; ++tag) {
+                targets[tag - lo] = labelbeg + *it;
+            }
+        }
+        int table = s.AddJumpTable(targets);
+
+        emit_comment(s.Intern("\t# jump table for tags " + std::to_string(lo) +
+                              ".." + std::to_string(hi)), s);
+        emit_blti(T1, lo, no_match, s);
+        emit_bgti(T1, hi, no_match, s);
+        emit_sll(T2, T1, 2, s);
+        emit_load_label(T3, table, s);
+        emit_addu(T2, T2, T3, s);
+        emit_load(T2, -lo, T2, s);
+        emit_jr(T2, s);
+    } else {
+        int max_tag = codegen_classtable->GetClassNodes().size() - 1;
+        for (int i : order) {
+            CgenNode* class_node = classes[i];
+            emit_comment(s.Intern("\t# tag in " + std::to_string(class_node->class_tag) +
+                                  ".." + std::to_string(class_node->last_tag) +
+                                  " : goto case " + std::to_string(i)), s);
+            if (class_node->class_tag == 0 && class_node->last_tag == max_tag) {
+                emit_branch(labelbeg + i, s);
+                break;
+            }
+            int next = s.NewLabel();
+            if (class_node->class_tag > 0) {
+                emit_blti(T1, class_node->class_tag, next, s);
+            }
+            emit_blei(T1, class_node->last_tag, labelbeg + i, s);
+            emit_label_def(next, s);
+        }
+    }
+    emit_label_def(no_match, s);
+}
+
+void typcase_class::code(MipsFunc& s, Environment& env) {
+    const std::map<Symbol, int>& _class_tags = codegen_classtable->GetClassTags();
+    const std::vector<CgenNode*>& _class_nodes = codegen_classtable->GetClassNodes();
     
-    s << "\t# case expr" << endl;
-    s << "\t# First eval e0" << endl;
+    emit_comment("\t# case expr", s);
+    emit_comment("\t# First eval e0", s);
     expr->code(s, env);
 
-    s << "\t# If e0 = void, abort" << endl;
-    emit_bne(ACC, ZERO, labelnum, s);
+    emit_comment("\t# If e0 = void, abort", s);
+    int not_void = s.NewLabel();
+    emit_bne(ACC, ZERO, not_void, s);
     emit_load_address(ACC, "str_const0", s);
     emit_load_imm(T1, 1, s);
     emit_jal("_case_abort2", s);
 
-    emit_label_def(labelnum, s);
-    ++labelnum;
+    emit_label_def(not_void, s);
 
-    s << "\t# T1 = type(acc)" << endl;
+    emit_comment("\t# T1 = type(acc)", s);
     emit_load(T1, 0, ACC, s);
 
     std::vector<branch_class*> _cases = GetCases();
-    int labelbeg = labelnum;
-    int finish = labelnum + _cases.size();
+    int labelbeg = s.NewLabel(_cases.size());
+    int finish = s.NewLabel();
     int caseidx = 0;
-    labelnum += _cases.size() + 1;
-
-    auto GetChildrenTagsSet = [&](std::vector<int> __curr_tags) {
-        std::vector<int> __children_tags; // for return.
-        for (int __curr_tag : __curr_tags) { // find children of this class.
-            CgenNode* __curr_node = _class_nodes[__curr_tag];
-            std::vector<CgenNode*> __children_nodes = __curr_node->GetChildren();
-            for (CgenNode* __children_node : __children_nodes) {
-                int __children_tag = _class_tags[__children_node->name];
-                if (std::find(__children_tags.begin(), __children_tags.end(), __children_tag) == __children_tags.end()) {
-                    __children_tags.push_back(__children_tag);
+
+    if (cgen_pass_enabled(PASS_CASE)) {
+        code_case_tests(_cases, labelbeg, s);
+    } else {
+        auto GetChildrenTagsSet = [&](std::vector<int> __curr_tags) {
+            std::vector<int> __children_tags; // for return.
+            for (int __curr_tag : __curr_tags) { // find children of this class.
+                CgenNode* __curr_node = _class_nodes[__curr_tag];
+                std::vector<CgenNode*> __children_nodes = __curr_node->GetChildren();
+                for (CgenNode* __children_node : __children_nodes) {
+                    int __children_tag = __children_node->class_tag;
+                    if (std::find(__children_tags.begin(), __children_tags.end(), __children_tag) == __children_tags.end()) {
+                        __children_tags.push_back(__children_tag);
+                    }
                 }
             }
-        }
-        return __children_tags;
-    };
+            return __children_tags;
+        };
 
-    auto HasFinished = [&](std::vector<std::vector<int> > __cases_tags) {
-        for (std::vector<int> __case_tags : __cases_tags) {
-            if (!__case_tags.empty()) {
-                return false;
+        auto HasFinished = [&](std::vector<std::vector<int> > __cases_tags) {
+            for (std::vector<int> __case_tags : __cases_tags) {
+                if (!__case_tags.empty()) {
+                    return false;
+                }
             }
+            return true;
+        };
+
+        // Generate first round cases_tags.
+        std::vector<std::vector<int> > cases_tags;
+        for (branch_class* _case : _cases) {
+            Symbol _type_decl = _case->type_decl;
+            int _class_tag = _class_tags.find(_type_decl)->second;
+            std::vector<int> case_tags = { _class_tag };
+            cases_tags.push_back(case_tags);
         }
-        return true;
-    };
 
-    // Generate first round cases_tags.
-    std::vector<std::vector<int> > cases_tags;
-    for (branch_class* _case : _cases) {
-        Symbol _type_decl = _case->type_decl;
-        int _class_tag = _class_tags[_type_decl];
-        std::vector<int> case_tags = { _class_tag };
-        cases_tags.push_back(case_tags);
-    }
-
-    while (!HasFinished(cases_tags)) {
-        // Print cases_tags.
-        for (int caseidx = 0; caseidx < cases_tags.size(); ++caseidx) {
-            std::vector<int> case_tags = cases_tags[caseidx];
-            for (int case_tag : case_tags) {
-                s << "\t# tag = " << case_tag << " : goto case " << caseidx << endl;
-                emit_load_imm(T2, case_tag, s);
-                emit_beq(T1, T2, labelbeg + caseidx, s);
-                s << endl;
-            }
+        while (!HasFinished(cases_tags)) {
+            // Print cases_tags.
+            for (size_t caseidx = 0; caseidx < cases_tags.size(); ++caseidx) {
+                std::vector<int> case_tags = cases_tags[caseidx];
+                for (int case_tag : case_tags) {
+                    emit_comment(s.Intern("\t# tag = " + std::to_string(case_tag) + " : goto case " + std::to_string(caseidx)), s);
+                    emit_load_imm(T2, case_tag, s);
+                    emit_beq(T1, T2, labelbeg + caseidx, s);
+                    emit_comment("", s);
+                }
             
-        }
-        s << "\t# ----------------" << endl;
+            }
+            emit_comment("\t# ----------------", s);
 
-        for (int i = 0; i < cases_tags.size(); ++i) {
-            cases_tags[i] = GetChildrenTagsSet(cases_tags[i]);
+            for (size_t i = 0; i < cases_tags.size(); ++i) {
+                cases_tags[i] = GetChildrenTagsSet(cases_tags[i]);
+            }
         }
     }
 
-    s << "\t# No match" << endl;
+    emit_comment("\t# No match", s);
     emit_jal("_case_abort", s);
     emit_branch(finish, s);
     
@@ -1612,33 +4608,45 @@ void typcase_class::code(ostream& s, Environment env) {
         Symbol _type_decl = _case->type_decl;
         Expression _expr = _case->expr;
 
-        s << "# eval expr " << caseidx << endl;
+        emit_comment(s.Intern("# eval expr " + std::to_string(caseidx)), s);
         emit_label_def(labelbeg + caseidx, s);
+        int reg = env.RegOf(_case, RegAlloc::VAR);
         env.EnterScope();
-        env.AddVar(_name);
-        emit_push(ACC, s);
-        _expr->code(s, env);
-        emit_addiu(SP, SP, 4, s);
+        env.AddVar(_name, reg);
+        if (reg != -1) {
+            emit_move(reg, ACC, s);
+            _expr->code(s, env);
+        } else {
+            store_top_slot(ACC, s, env);
+            _expr->code(s, env);
+            if (env.m_frame_base == -1) {
+                emit_addiu(SP, SP, 4, s);
+            }
+        }
+        env.ExitScope();
 
-        s << "\t# Jumpto finish" << endl;
+        emit_comment("\t# Jumpto finish", s);
         emit_branch(finish, s);
         ++caseidx;
     }
 
-    s << "#finish:" << endl;
+    emit_comment("#finish:", s);
     emit_label_def(finish, s);
-    s << endl;
+    emit_comment("", s);
 }
 
-void block_class::code(ostream& s, Environment env) {
+void block_class::code(MipsFunc& s, Environment& env) {
     for (int i = body->first(); body->more(i); i = body->next(i)) {
         body->nth(i)->code(s, env);
     }
 }
 
-void let_class::code(ostream& s, Environment env) {
-    s << "\t# Let expr" << endl;
-    s << "\t# First eval init" << endl;
+void let_class::code(MipsFunc& s, Environment& env) {
+    if (code_folded(this, s, env)) {
+        return;
+    }
+    emit_comment("\t# Let expr", s);
+    emit_comment("\t# First eval init", s);
     init->code(s, env);
 
     if (init->IsEmpty()) {
@@ -1652,211 +4660,266 @@ void let_class::code(ostream& s, Environment env) {
         }
     }
 
-    s << "\t# push" << endl;
-    emit_push(ACC, s);
-    s << endl;
+    int reg = env.RegOf(this, RegAlloc::VAR);
+    if (reg != -1) {
+        emit_comment("\t# keep it in a register", s);
+        emit_move(reg, ACC, s);
+        emit_comment("", s);
+
+        env.EnterScope();
+        env.AddVar(identifier, reg);
+        body->code(s, env);
+        env.ExitScope();
+        return;
+    }
 
+    emit_comment("\t# push", s);
     env.EnterScope();
     env.AddVar(identifier);
+    store_top_slot(ACC, s, env);
+    emit_comment("", s);
 
     body->code(s, env);
+    env.ExitScope();
 
-    s << "\t# pop" << endl;
-    emit_addiu(SP, SP, 4, s);
-    s << endl;
+    if (env.m_frame_base == -1) {
+        emit_comment("\t# pop", s);
+        emit_addiu(SP, SP, 4, s);
+        emit_comment("", s);
+    }
 }
 
-void plus_class::code(ostream& s, Environment env) {
+void plus_class::code(MipsFunc& s, Environment& env) {
 
 // 加法运算表达式的代码生成
 // 实现两个整数对象相加的MIPS汇编代码
-    s << "\t# Int operation : Add" << endl;
-    s << "\t# First eval e1 and push." << endl;
+    if (code_folded(this, s, env)) {
+        return;
+    }
+    if (cgen_pass_enabled(PASS_UNBOX)) {
+        code_boxed_result(this, s, env);
+        return;
+    }
+
+    emit_comment("\t# Int operation : Add", s);
+    emit_comment("\t# First eval e1 and push.", s);
     e1->code(s, env);
-    emit_push(ACC, s);
-    env.AddObstacle();
-    s << endl;
+    save_operand(this, s, env);
+    emit_comment("", s);
 
-    s << "\t# Then eval e2 and make a copy for result." << endl;
+    emit_comment("\t# Then eval e2 and make a copy for result.", s);
     e2->code(s, env);
     emit_jal("Object.copy", s);
-    s << endl;
+    emit_comment("", s);
 
-    s << "\t# Let's pop e1 to t1, move e2 to t2" << endl;
-    emit_addiu(SP, SP, 4, s);
-    emit_load(T1, 0, SP, s);
+    emit_comment("\t# Let's pop e1 to t1, move e2 to t2", s);
+    restore_operand(this, T1, s, env);
     emit_move(T2, ACC, s);
-    s << endl;
+    emit_comment("", s);
 
-    s << "\t# Extract the int inside the object." << endl;
+    emit_comment("\t# Extract the int inside the object.", s);
     emit_load(T1, 3, T1, s);
     emit_load(T2, 3, T2, s);
-    s << endl;
+    emit_comment("", s);
 
-    s << "\t# Modify the int inside t2." << endl;
+    emit_comment("\t# Modify the int inside t2.", s);
     emit_add(T3, T1, T2, s);
     emit_store(T3, 3, ACC, s);
-    s << endl;
+    emit_comment("", s);
 
 }
 
-void sub_class::code(ostream& s, Environment env) {
-    s << "\t# Int operation : Sub" << endl;
-    s << "\t# First eval e1 and push." << endl;
+void sub_class::code(MipsFunc& s, Environment& env) {
+    if (code_folded(this, s, env)) {
+        return;
+    }
+    if (cgen_pass_enabled(PASS_UNBOX)) {
+        code_boxed_result(this, s, env);
+        return;
+    }
+    emit_comment("\t# Int operation : Sub", s);
+    emit_comment("\t# First eval e1 and push.", s);
     e1->code(s, env);
-    emit_push(ACC, s);
-    env.AddObstacle();
-    s << endl;
+    save_operand(this, s, env);
+    emit_comment("", s);
 
-    s << "\t# Then eval e2 and make a copy for result." << endl;
+    emit_comment("\t# Then eval e2 and make a copy for result.", s);
     e2->code(s, env);
     emit_jal("Object.copy", s);
-    s << endl;
+    emit_comment("", s);
 
-    s << "\t# Let's pop e1 to t1, move e2 to t2" << endl;
-    emit_addiu(SP, SP, 4, s);
-    emit_load(T1, 0, SP, s);
+    emit_comment("\t# Let's pop e1 to t1, move e2 to t2", s);
+    restore_operand(this, T1, s, env);
     emit_move(T2, ACC, s);
-    s << endl;
+    emit_comment("", s);
 
-    s << "\t# Extract the int inside the object." << endl;
+    emit_comment("\t# Extract the int inside the object.", s);
     emit_load(T1, 3, T1, s);
     emit_load(T2, 3, T2, s);
-    s << endl;
+    emit_comment("", s);
 
-    s << "\t# Modify the int inside t2." << endl;
+    emit_comment("\t# Modify the int inside t2.", s);
     emit_sub(T3, T1, T2, s);
     emit_store(T3, 3, ACC, s);
-    s << endl;
+    emit_comment("", s);
 
 }
 
-void mul_class::code(ostream& s, Environment env) {
-    s << "\t# Int operation : Mul" << endl;
-    s << "\t# First eval e1 and push." << endl;
+void mul_class::code(MipsFunc& s, Environment& env) {
+    if (code_folded(this, s, env)) {
+        return;
+    }
+    if (cgen_pass_enabled(PASS_UNBOX)) {
+        code_boxed_result(this, s, env);
+        return;
+    }
+    emit_comment("\t# Int operation : Mul", s);
+    emit_comment("\t# First eval e1 and push.", s);
     e1->code(s, env);
-    emit_push(ACC, s);
-    env.AddObstacle();
-    s << endl;
+    save_operand(this, s, env);
+    emit_comment("", s);
 
-    s << "\t# Then eval e2 and make a copy for result." << endl;
+    emit_comment("\t# Then eval e2 and make a copy for result.", s);
     e2->code(s, env);
     emit_jal("Object.copy", s);
-    s << endl;
+    emit_comment("", s);
 
-    s << "\t# Let's pop e1 to t1, move e2 to t2" << endl;
-    emit_addiu(SP, SP, 4, s);
-    emit_load(T1, 0, SP, s);
+    emit_comment("\t# Let's pop e1 to t1, move e2 to t2", s);
+    restore_operand(this, T1, s, env);
     emit_move(T2, ACC, s);
-    s << endl;
+    emit_comment("", s);
 
-    s << "\t# Extract the int inside the object." << endl;
+    emit_comment("\t# Extract the int inside the object.", s);
     emit_load(T1, 3, T1, s);
     emit_load(T2, 3, T2, s);
-    s << endl;
+    emit_comment("", s);
 
-    s << "\t# Modify the int inside t2." << endl;
+    emit_comment("\t# Modify the int inside t2.", s);
     emit_mul(T3, T1, T2, s);
     emit_store(T3, 3, ACC, s);
-    s << endl;
+    emit_comment("", s);
 }
 
-void divide_class::code(ostream& s, Environment env) {
-    s << "\t# Int operation : Div" << endl;
-    s << "\t# First eval e1 and push." << endl;
+void divide_class::code(MipsFunc& s, Environment& env) {
+    if (code_folded(this, s, env)) {
+        return;
+    }
+    if (cgen_pass_enabled(PASS_UNBOX)) {
+        code_boxed_result(this, s, env);
+        return;
+    }
+    emit_comment("\t# Int operation : Div", s);
+    emit_comment("\t# First eval e1 and push.", s);
     e1->code(s, env);
-    emit_push(ACC, s);
-    env.AddObstacle();
-    s << endl;
+    save_operand(this, s, env);
+    emit_comment("", s);
 
-    s << "\t# Then eval e2 and make a copy for result." << endl;
+    emit_comment("\t# Then eval e2 and make a copy for result.", s);
     e2->code(s, env);
     emit_jal("Object.copy", s);
-    s << endl;
+    emit_comment("", s);
 
-    s << "\t# Let's pop e1 to t1, move e2 to t2" << endl;
-    emit_addiu(SP, SP, 4, s);
-    emit_load(T1, 0, SP, s);
+    emit_comment("\t# Let's pop e1 to t1, move e2 to t2", s);
+    restore_operand(this, T1, s, env);
     emit_move(T2, ACC, s);
-    s << endl;
+    emit_comment("", s);
 
-    s << "\t# Extract the int inside the object." << endl;
+    emit_comment("\t# Extract the int inside the object.", s);
     emit_load(T1, 3, T1, s);
     emit_load(T2, 3, T2, s);
-    s << endl;
+    emit_comment("", s);
 
-    s << "\t# Modify the int inside t2." << endl;
+    emit_comment("\t# Modify the int inside t2.", s);
     emit_div(T3, T1, T2, s);
     emit_store(T3, 3, ACC, s);
-    s << endl;
+    emit_comment("", s);
 
 }
 
-void neg_class::code(ostream& s, Environment env) {
-    s << "\t# Neg" << endl;
-    s << "\t# Eval e1 and make a copy for result" << endl;
+void neg_class::code(MipsFunc& s, Environment& env) {
+    if (code_folded(this, s, env)) {
+        return;
+    }
+    if (cgen_pass_enabled(PASS_UNBOX)) {
+        code_boxed_result(this, s, env);
+        return;
+    }
+    emit_comment("\t# Neg", s);
+    emit_comment("\t# Eval e1 and make a copy for result", s);
     e1->code(s, env);
     emit_jal("Object.copy", s);
-    s << endl;
+    emit_comment("", s);
 
     emit_load(T1, 3, ACC, s);
     emit_neg(T1, T1, s);
     emit_store(T1, 3, ACC, s);
-    s << endl;
+    emit_comment("", s);
 
 }
 
-void lt_class::code(ostream& s, Environment env) {
-    s << "\t# Int operation : Less than" << endl;
-    s << "\t# First eval e1 and push." << endl;
+void lt_class::code(MipsFunc& s, Environment& env) {
+    if (code_folded(this, s, env)) {
+        return;
+    }
+    if (cgen_pass_enabled(PASS_UNBOX)) {
+        emit_comment("\t# Int operation : Less than (unboxed)", s);
+        code_unboxed_compare(MIPS_BLT, this, e1, e2, s, env);
+        return;
+    }
+    emit_comment("\t# Int operation : Less than", s);
+    emit_comment("\t# First eval e1 and push.", s);
     e1->code(s, env);
-    emit_push(ACC, s);
-    env.AddObstacle();
-    s << endl;
+    save_operand(this, s, env);
+    emit_comment("", s);
 
-    s << "\t# Then eval e2." << endl;
+    emit_comment("\t# Then eval e2.", s);
     e2->code(s, env);
-    s << endl;
+    emit_comment("", s);
 
-    s << "\t# Let's pop e1 to t1, move e2 to t2" << endl;
-    emit_addiu(SP, SP, 4, s);
-    emit_load(T1, 0, SP, s);
+    emit_comment("\t# Let's pop e1 to t1, move e2 to t2", s);
+    restore_operand(this, T1, s, env);
     emit_move(T2, ACC, s);
-    s << endl;
+    emit_comment("", s);
 
-    s << "\t# Extract the int inside the object." << endl;
+    emit_comment("\t# Extract the int inside the object.", s);
     emit_load(T1, 3, T1, s);
     emit_load(T2, 3, T2, s);
-    s << endl;
+    emit_comment("", s);
 
-    s << "\t# Pretend that t1 < t2" << endl;
+    emit_comment("\t# Pretend that t1 < t2", s);
     emit_load_bool(ACC, BoolConst(1), s);
-    s << "\t# If t1 < t2 jumpto finish" << endl;
-    emit_blt(T1, T2, labelnum, s);
+    emit_comment("\t# If t1 < t2 jumpto finish", s);
+    int finish = s.NewLabel();
+    emit_blt(T1, T2, finish, s);
 
     emit_load_bool(ACC, BoolConst(0), s);
-    emit_label_def(labelnum, s);
+    emit_label_def(finish, s);
 
-    ++labelnum;
 }
 
-void eq_class::code(ostream& s, Environment env) {
-    s << "\t# equal" << endl;
-    s << "\t# First eval e1 and push." << endl;
+void eq_class::code(MipsFunc& s, Environment& env) {
+    if (code_folded(this, s, env)) {
+        return;
+    }
+    if (cgen_pass_enabled(PASS_UNBOX) && e1->type == Int && e2->type == Int) {
+        emit_comment("\t# Int operation : Equal (unboxed)", s);
+        code_unboxed_compare(MIPS_BEQ, this, e1, e2, s, env);
+        return;
+    }
+    emit_comment("\t# equal", s);
+    emit_comment("\t# First eval e1 and push.", s);
     e1->code(s, env);
-    emit_push(ACC, s);
-    env.AddObstacle();
-    s << endl;
+    save_operand(this, s, env);
+    emit_comment("", s);
 
-    s << "\t# Then eval e2." << endl;
+    emit_comment("\t# Then eval e2.", s);
     e2->code(s, env);
-    s << endl;
+    emit_comment("", s);
 
-    s << "\t# Let's pop e1 to t1, move e2 to t2" << endl;
-    emit_addiu(SP, SP, 4, s);
-    emit_load(T1, 0, SP, s);
+    emit_comment("\t# Let's pop e1 to t1, move e2 to t2", s);
+    restore_operand(this, T1, s, env);
     emit_move(T2, ACC, s);
-    s << endl;
+    emit_comment("", s);
 
     if (e1->type == Int || e1->type == Str || e1->type == Bool)
         if (e2->type == Int || e2->type == Str || e2->type == Bool) {
@@ -1866,194 +4929,204 @@ void eq_class::code(ostream& s, Environment env) {
             return;
         }
 
-    s << "\t# Pretend that t1 = t2" << endl;
+    emit_comment("\t# Pretend that t1 = t2", s);
     emit_load_bool(ACC, BoolConst(1), s);
-    s << "\t# Compare the two pointers." << endl;
-    emit_beq(T1, T2, labelnum, s);
+    emit_comment("\t# Compare the two pointers.", s);
+    int finish = s.NewLabel();
+    emit_beq(T1, T2, finish, s);
     emit_load_bool(ACC, BoolConst(0), s);
-    emit_label_def(labelnum, s);
-    ++labelnum;
+    emit_label_def(finish, s);
 }
 
-void leq_class::code(ostream& s, Environment env) {
-    s << "\t# Int operation : Less or equal" << endl;
-    s << "\t# First eval e1 and push." << endl;
+void leq_class::code(MipsFunc& s, Environment& env) {
+    if (code_folded(this, s, env)) {
+        return;
+    }
+    if (cgen_pass_enabled(PASS_UNBOX)) {
+        emit_comment("\t# Int operation : Less or equal (unboxed)", s);
+        code_unboxed_compare(MIPS_BLEQ, this, e1, e2, s, env);
+        return;
+    }
+    emit_comment("\t# Int operation : Less or equal", s);
+    emit_comment("\t# First eval e1 and push.", s);
     e1->code(s, env);
-    emit_push(ACC, s);
-    env.AddObstacle();
-    s << endl;
+    save_operand(this, s, env);
+    emit_comment("", s);
 
-    s << "\t# Then eval e2." << endl;
+    emit_comment("\t# Then eval e2.", s);
     e2->code(s, env);
-    s << endl;
+    emit_comment("", s);
 
-    s << "\t# Let's pop e1 to t1, move e2 to t2" << endl;
-    emit_addiu(SP, SP, 4, s);
-    emit_load(T1, 0, SP, s);
+    emit_comment("\t# Let's pop e1 to t1, move e2 to t2", s);
+    restore_operand(this, T1, s, env);
     emit_move(T2, ACC, s);
-    s << endl;
+    emit_comment("", s);
 
-    s << "\t# Extract the int inside the object." << endl;
+    emit_comment("\t# Extract the int inside the object.", s);
     emit_load(T1, 3, T1, s);
     emit_load(T2, 3, T2, s);
-    s << endl;
+    emit_comment("", s);
 
-    s << "\t# Pretend that t1 < t2" << endl;
+    emit_comment("\t# Pretend that t1 < t2", s);
     emit_load_bool(ACC, BoolConst(1), s);
-    s << "\t# If t1 < t2 jumpto finish" << endl;
-    emit_bleq(T1, T2, labelnum, s);
+    emit_comment("\t# If t1 < t2 jumpto finish", s);
+    int finish = s.NewLabel();
+    emit_bleq(T1, T2, finish, s);
 
     emit_load_bool(ACC, BoolConst(0), s);
-    emit_label_def(labelnum, s);
+    emit_label_def(finish, s);
 
-    ++labelnum;
 }
 
-void comp_class::code(ostream& s, Environment env) {
-    s << "\t# the 'not' operator" << endl;
-    s << "\t# First eval the bool" << endl;
+void comp_class::code(MipsFunc& s, Environment& env) {
+    if (code_folded(this, s, env)) {
+        return;
+    }
+    emit_comment("\t# the 'not' operator", s);
+    emit_comment("\t# First eval the bool", s);
     e1->code(s, env);
 
-    s << "\t# Extract the int inside the bool" << endl;
+    emit_comment("\t# Extract the int inside the bool", s);
     emit_load(T1, 3, ACC, s);
 
-    s << "\t# Pretend ACC = false, then we need to construct true" << endl;
+    emit_comment("\t# Pretend ACC = false, then we need to construct true", s);
     emit_load_bool(ACC, BoolConst(1), s);
 
-    s << "\t# If ACC = false, jumpto finish" << endl;
-    emit_beq(T1, ZERO, labelnum, s);
+    emit_comment("\t# If ACC = false, jumpto finish", s);
+    int finish = s.NewLabel();
+    emit_beq(T1, ZERO, finish, s);
 
-    s << "\t# Load false" << endl;
+    emit_comment("\t# Load false", s);
     emit_load_bool(ACC, BoolConst(0), s);
 
-    s << "\t# finish:" << endl;
-    emit_label_def(labelnum, s);
+    emit_comment("\t# finish:", s);
+    emit_label_def(finish, s);
 
-    ++labelnum;
 
 }
 
-void int_const_class::code(ostream& s, Environment env) {
+void int_const_class::code(MipsFunc& s, Environment& env) {
     //
     // Need to be sure we have an IntEntry *, not an arbitrary Symbol
     //
     emit_load_int(ACC, inttable.lookup_string(token->get_string()), s);
 }
 
-void string_const_class::code(ostream& s, Environment env) {
+void string_const_class::code(MipsFunc& s, Environment& env) {
     emit_load_string(ACC, stringtable.lookup_string(token->get_string()), s);
 }
 
-void bool_const_class::code(ostream& s, Environment env) {
+void bool_const_class::code(MipsFunc& s, Environment& env) {
     emit_load_bool(ACC, BoolConst(val), s);
 }
 
-void new__class::code(ostream& s, Environment env) {
+void new__class::code(MipsFunc& s, Environment& env) {
     if (type_name == SELF_TYPE) {
         emit_load_address(T1, "class_objTab", s);
 
-        s << "\t# Find class tag." << endl;
+        emit_comment("\t# Find class tag.", s);
         emit_load(T2, 0, SELF, s);
-        s << endl;
+        emit_comment("", s);
 
-        s << "\t# Mult 3: Get protObj." << endl;
+        emit_comment("\t# Mult 3: Get protObj.", s);
         emit_sll(T2, T2, 3, s);
-        s << endl;
+        emit_comment("", s);
 
         emit_addu(T1, T1, T2, s);
 
-        s << "\t# Push." << endl;
+        emit_comment("\t# Push.", s);
         emit_push(T1, s);
-        s << endl;
+        emit_comment("", s);
 
-        s << "\t# Load protObj to ACC." << endl;
+        emit_comment("\t# Load protObj to ACC.", s);
         emit_load(ACC, 0, T1, s);
-        s << endl;
+        emit_comment("", s);
 
         emit_jal("Object.copy", s);
 
-        s << "\t# Pop protObj addr." << endl;
+        emit_comment("\t# Pop protObj addr.", s);
         emit_load(T1, 1, SP, s);
         emit_addiu(SP, SP, 4, s);
-        s << endl;
+        emit_comment("", s);
 
-        s << "\t# Get init addr." << endl;
+        emit_comment("\t# Get init addr.", s);
         emit_load(T1, 1, T1, s);
-        s << endl;
+        emit_comment("", s);
 
-        s << "\t# Goto init." << endl;
+        emit_comment("\t# Goto init.", s);
         emit_jalr(T1, s);
-        s << endl;
+        emit_comment("", s);
 
         return;
     }
 
-    std::string dest = type_name->get_string();
-    dest += PROTOBJ_SUFFIX;
-    emit_load_address(ACC, dest.c_str(), s);
-    emit_jal("Object.copy", s);
-    dest = type_name->get_string();
-    dest += CLASSINIT_SUFFIX;
-    emit_jal(dest.c_str(), s);
+    emit_new_object(type_name, s);
+    if (init_is_empty(type_name)) {
+        emit_comment("\t# The init would not change the copy: not called.", s);
+        return;
+    }
+    emit_jal_init(type_name, s);
 }
 
-void isvoid_class::code(ostream& s, Environment env) {
+void isvoid_class::code(MipsFunc& s, Environment& env) {
+    if (code_folded(this, s, env)) {
+        return;
+    }
     e1->code(s, env);
 
-    s << "\t# t1 = acc" << endl;
+    emit_comment("\t# t1 = acc", s);
     emit_move(T1, ACC, s);
 
-    s << "\t# First pretend t1 = void: acc = bool(1)" << endl;
+    emit_comment("\t# First pretend t1 = void: acc = bool(1)", s);
     emit_load_bool(ACC, BoolConst(1), s);
 
-    s << "\t# if t1 = void: jumpto finish" << endl;
-    emit_beq(T1, ZERO, labelnum, s);
-    s << endl;
+    emit_comment("\t# if t1 = void: jumpto finish", s);
+    int finish = s.NewLabel();
+    emit_beq(T1, ZERO, finish, s);
+    emit_comment("", s);
 
-    s << "\t# acc != void" << endl;
+    emit_comment("\t# acc != void", s);
     emit_load_bool(ACC, BoolConst(0), s);
 
-    s << "# finish:" << endl;
-    emit_label_def(labelnum, s);
+    emit_comment("# finish:", s);
+    emit_label_def(finish, s);
 
-    ++labelnum;
 }
 
-void no_expr_class::code(ostream& s, Environment env) {
+void no_expr_class::code(MipsFunc& s, Environment& env) {
     emit_move(ACC, ZERO, s);
 }
 
-void object_class::code(ostream& s, Environment env) {
-    s << "\t# Object:" << endl;
+void object_class::code(MipsFunc& s, Environment& env) {
+    if (code_folded(this, s, env)) {
+        return;
+    }
+    emit_comment("\t# Object:", s);
     int idx;
 
-    if ((idx = env.LookUpVar(name)) != -1) {
-        s << "\t# It is a let variable." << endl;
-        emit_load(ACC, idx + 1, SP, s);
-        if (cgen_Memmgr == 1) {
-            emit_addiu(A1, SP, 4 * (idx + 1), s);
-            emit_jal("_GenGC_Assign", s);
-        }
+    if ((idx = env.LookUpVarReg(name)) != -1) {
+        emit_comment("\t# It is a let variable in a register.", s);
+        emit_move(ACC, idx, s);
+    } else if ((idx = env.LookUpVar(name)) != -1) {
+        emit_comment("\t# It is a let variable.", s);
+        int base, offset;
+        env.SlotAddr(idx, base, offset);
+        emit_load(ACC, offset, base, s);
+    } else if ((idx = env.LookUpParamReg(name)) != -1) {
+        emit_comment("\t# It is a param in a register.", s);
+        emit_move(ACC, idx, s);
     } else if ((idx = env.LookUpParam(name)) != -1) {
-        s << "\t# It is a param." << endl;
+        emit_comment("\t# It is a param.", s);
         emit_load(ACC, idx + 3, FP, s);
-        if (cgen_Memmgr == 1) {
-            emit_addiu(A1, FP, 4 * (idx + 3), s);
-            emit_jal("_GenGC_Assign", s);
-        }
     } else if ((idx = env.LookUpAttrib(name)) != -1) {
-        s << "\t# It is an attribute." << endl;
+        emit_comment("\t# It is an attribute.", s);
         emit_load(ACC, idx + 3, SELF, s);
-        if (cgen_Memmgr == 1) {
-            emit_addiu(A1, SELF, 4 * (idx + 3), s);
-            emit_jal("_GenGC_Assign", s);
-        }
     } else if (name == self) {
-        s << "\t# It is self." << endl;
+        emit_comment("\t# It is self.", s);
         emit_move(ACC, SELF, s);
     } else {
-        s << "Error! object class" << endl;
+        emit_comment("Error! object class", s);
     }
 
-    s << endl;
+    emit_comment("", s);
 }
@@ -1,8 +1,15 @@
 #include <assert.h>
 #include <stdio.h>
+#include <string.h>
 #include <stack>
+#include <memory>
+#include <string>
 #include <vector>
 #include <list>
+#include <map>
+#include <set>
+#include <streambuf>
+#include <unordered_map>
 #include "emit.h"
 #include "cool-tree.h"
 #include "symtab.h"
@@ -28,6 +35,132 @@ class CgenNode;
 // 定义CgenNode的指针类型
 typedef CgenNode *CgenNodeP;
 
+// MIPS指令的操作码。除真实指令外还有标签和注释两种伪指令，
+// 注释也保存在指令序列中，打印出的汇编与直接输出时完全相同。
+enum MipsOp {
+    MIPS_LW, MIPS_SW, MIPS_LI, MIPS_LA, MIPS_MOVE, MIPS_NEG,
+    MIPS_ADD, MIPS_ADDU, MIPS_ADDIU, MIPS_DIV, MIPS_MUL, MIPS_SUB, MIPS_SLL,
+    MIPS_JALR, MIPS_JAL, MIPS_RET, MIPS_JR,
+    MIPS_BEQZ, MIPS_BEQ, MIPS_BNE, MIPS_BLEQ, MIPS_BLT, MIPS_BGT, MIPS_BGE,
+    MIPS_BLTI, MIPS_BGTI, MIPS_BLEI, MIPS_BGEI,
+    MIPS_B,
+    MIPS_LABEL,   // 标签定义 label<label>:
+    MIPS_COMMENT  // 原样输出的一行文本（text后接sym，可为空行）
+};
+
+// la和jal指令中符号地址的种类
+enum MipsAddr {
+    ADDR_NONE,
+    ADDR_NAME,     // text中的全局名字，如"Object.copy"
+    ADDR_INT,      // sym为IntEntry
+    ADDR_STR,      // sym为StringEntry
+    ADDR_BOOL,     // imm为布尔值
+    ADDR_DISPTAB,  // sym类的分发表
+    ADDR_PROTOBJ,  // sym类的原型对象
+    ADDR_INIT,     // sym类的初始化函数
+    ADDR_METHOD,   // sym类的sym2方法
+    ADDR_LABEL     // 本函数的标签label（跳转表）
+};
+
+// 一条内存中的MIPS指令，寄存器使用emit.h中的寄存器编号
+struct MipsInst {
+    unsigned char op = MIPS_COMMENT; // MipsOp
+    unsigned char addr = ADDR_NONE;  // MipsAddr
+    // 按汇编中出现的顺序排列的寄存器操作数（sw的rd为被存储的寄存器）
+    unsigned char rd = 0;
+    unsigned char rs = 0;
+    unsigned char rt = 0;
+    int imm = 0;                     // 立即数，lw/sw中为字节偏移
+    int label = 0;                   // 分支目标或标签定义的编号
+    const char* text = nullptr;      // ADDR_NAME的名字或注释文本
+    Symbol sym = nullptr;            // 符号地址或注释中的符号
+    Symbol sym2 = nullptr;           // ADDR_METHOD的方法名
+};
+
+// 跳转表，打印在函数代码之后的数据段中：标签label处依次为targets中
+// 各标签的地址
+struct MipsJumpTable {
+    int label;
+    std::vector<int> targets;
+};
+
+// 一个方法（或类初始化函数）的指令序列。
+// 表达式代码生成只向其中追加指令，由Print统一输出为汇编文本。
+// 标签编号在函数内从0开始，打印时加上label_base，
+// 因此各函数可以独立（并行）生成，最终标签仍全局唯一。
+class MipsFunc {
+public:
+    // method_name为NULL表示class_name类的初始化函数
+    MipsFunc(Symbol class_name, Symbol method_name)
+        : class_name(class_name), method_name(method_name),
+          label_base(0), barriers_kept(0), barriers_elided(0),
+          m_num_labels(0) {}
+
+    // 分配count个连续的新标签，返回第一个的编号
+    int NewLabel(int count = 1) {
+        int label = m_num_labels;
+        m_num_labels += count;
+        return label;
+    }
+
+    // 本函数已分配的标签数
+    int NumLabels() const {
+        return m_num_labels;
+    }
+
+    // 追加一条指令并返回它，由调用者填写操作数
+    MipsInst& Append(MipsOp op) {
+        insts.emplace_back();
+        insts.back().op = op;
+        return insts.back();
+    }
+
+    // 新建一个跳转表，返回它的标签
+    int AddJumpTable(const std::vector<int>& targets) {
+        int label = NewLabel();
+        jump_tables.push_back(MipsJumpTable{ label, targets });
+        return label;
+    }
+
+    // 保存一段动态生成的注释文本，返回的指针在本对象存活期间有效
+    // （对象被移动后仍然有效）
+    const char* Intern(const std::string& text) {
+        char* copy = new char[text.size() + 1];
+        memcpy(copy, text.c_str(), text.size() + 1);
+        m_strings.emplace_back(copy);
+        return copy;
+    }
+
+    // 输出入口标签和全部指令；relocatable时标签和常量引用输出为
+    // 可重定位的标记（供代码缓存使用，见cgen_cache.h）
+    void Print(ostream& s, bool relocatable = false) const;
+
+    Symbol class_name;
+    Symbol method_name;
+    std::vector<MipsInst> insts;
+    std::vector<MipsJumpTable> jump_tables;
+    int label_base; // 打印时加到本函数所有标签编号上的偏移
+    // 开启GC时向属性存储指针后保留的和省去的写屏障个数（见遍"barrier"）
+    int barriers_kept;
+    int barriers_elided;
+
+private:
+    int m_num_labels;
+    std::vector<std::unique_ptr<char[]> > m_strings;
+};
+
+// 一个类生成的全部代码。各类的代码可以在不同线程中生成，
+// 最后按类标签顺序拼接，输出与线程数无关。
+struct CgenClassCode {
+    // funcs[0]为类的初始化函数，其后为本类定义的方法（基本类没有）
+    std::vector<MipsFunc> funcs;
+    // 打印好的初始化函数和方法的汇编文本
+    std::string init_text;
+    std::string methods_text;
+    // -c且开启GC时每个函数保留和省去的写屏障个数，每个函数一行
+    std::string barrier_report;
+};
+
 // 代码生成类表，继承自符号表（键为Symbol，值为CgenNode）
 class CgenClassTable : public SymbolTable<Symbol,CgenNode> {
 private:
@@ -36,7 +169,7 @@ private:
     int stringclasstag; // String类的标签ID
     int intclasstag;    // Int类的标签ID
     int boolclasstag;   // Bool类的标签ID
-    // 存储所有类节点的向量，按某种顺序（如DFS顺序）排列
+    // 存储所有类节点的向量，按继承树的先序（DFS顺序）排列，下标即类标签
     std::vector<CgenNode*> m_class_nodes;
     // 映射：类名(Symbol) -> 类标签(整数ID)
     std::map<Symbol, int> m_class_tags;
@@ -64,6 +197,19 @@ private:
     void code_class_inits();
     // 生成所有类的方法的实际代码
     void code_class_methods();
+    // 为每个类生成初始化函数和方法的代码（-j N时多线程），
+    // 结果保存在m_class_code中，由code_class_inits/code_class_methods输出
+    void generate_class_code();
+    // 生成标签为tag的类的初始化函数和方法，放入m_class_code[tag].funcs
+    void code_class(int tag);
+    // 代码生成之前按类标签顺序折叠所有用户类的常量（-O，遍"fold"）
+    void fold_constants();
+    // 使用-C时的generate_class_code：未改变的类直接从磁盘缓存读取代码
+    void generate_cached_class_code();
+    // 缓存键中与各类自身无关的部分：编译器版本、代码生成选项、全部类的布局
+    std::string cache_context();
+    // 按类标签索引的各类生成代码
+    std::vector<CgenClassCode> m_class_code;
 
 // 以下方法用于从类列表构建继承图
     // 安装基本类（Object, IO, Int, Bool, String）到类表中
@@ -76,6 +222,18 @@ private:
     void build_inheritance_tree();
     // 设置指定节点的父子关系
     void set_relations(CgenNodeP nd);
+    // 继承树建立后，自顶向下为每个类计算一次对象布局和分发表布局
+    void build_layouts(CgenNodeP nd);
+    // 按先序为nd的子树中的类分配标签，子类按声明顺序，
+    // 所以每个类的子树占据一段连续的标签class_tag..last_tag
+    void number_classes(CgenNodeP nd);
+    // 类层次分析：自底向上计算nd的子树中各类的m_single_impl
+    void analyze_hierarchy(CgenNodeP nd);
+    // 找出可以内联的方法（-O，遍"inline"）：用户类中方法体的节点数
+    // 不超过cgen_inline_size的方法，放入m_inline_bodies
+    void find_inline_candidates();
+    // 可以内联的方法，构造后只读
+    std::set<method_class*> m_inline_bodies;
 
 public:
     // 构造函数，传入类列表和输出流
@@ -89,19 +247,57 @@ public:
     void code();
     // 获取继承树的根节点（通常是Object类）
     CgenNodeP root();
-    // 获取所有类节点的向量
-    std::vector<CgenNode*> GetClassNodes();
+    // 获取所有类节点的向量（下标即类标签）
+    const std::vector<CgenNode*>& GetClassNodes();
+    // 方法体是否小到可以在调用处内联
+    bool CanInline(method_class* method) const {
+        return m_inline_bodies.count(method) != 0;
+    }
     // 获取类名到类标签的映射
-    std::map<Symbol, int> GetClassTags();
+    const std::map<Symbol, int>& GetClassTags();
     // 根据类名获取对应的类节点
     CgenNode* GetClassNode(Symbol class_name) {
         // 确保m_class_nodes和m_class_tags已填充
         GetClassNodes();
         // 通过类标签作为索引在m_class_nodes中查找
-        return m_class_nodes[m_class_tags[class_name]];
+        return m_class_nodes[m_class_tags.find(class_name)->second];
     }
 };
 
+// 类的布局信息：对象中的属性槽和分发表中的方法槽。
+// 由CgenClassTable在继承树建立后一次性构建，之后只读，
+// 代码生成时通过常量引用访问，不产生任何拷贝。
+class CgenLayout {
+public:
+    // 按对象布局顺序排列的全部属性（包括继承的），下标即属性槽
+    std::vector<attr_class*> attribs;
+    // 按分发表顺序排列的全部方法（包括继承的），下标即方法槽
+    std::vector<method_class*> methods;
+    // 与methods一一对应：实际提供该方法实现的类名
+    std::vector<Symbol> method_classes;
+
+    // 属性名 -> 属性槽，不存在时返回-1
+    int AttribSlot(Symbol name) const {
+        auto it = m_attrib_slots.find(name);
+        return it == m_attrib_slots.end() ? -1 : it->second;
+    }
+
+    // 方法名 -> 方法槽，不存在时返回-1
+    int MethodSlot(Symbol name) const {
+        auto it = m_method_slots.find(name);
+        return it == m_method_slots.end() ? -1 : it->second;
+    }
+
+    // 追加一个属性槽
+    void AddAttrib(attr_class* attrib);
+    // 由impl_class实现方法：覆盖已有方法槽，或追加一个新槽
+    void AddMethod(method_class* method, Symbol impl_class);
+
+private:
+    std::unordered_map<Symbol, int> m_attrib_slots;
+    std::unordered_map<Symbol, int> m_method_slots;
+};
+
 // 代码生成类节点，继承自class__class（Cool语言的类AST节点）
 class CgenNode : public class__class {
 private:
@@ -150,44 +346,73 @@ public:
     // 生成该类的原型对象代码
     void code_protObj(ostream& s);
     // 生成该类的初始化方法代码
-    void code_init(ostream& s);
-    // 生成该类所有方法的代码
-    void code_methods(ostream& s);
+    void code_init(MipsFunc& s);
+    // 生成该类所有方法的代码，每个方法追加一个MipsFunc到funcs
+    void code_methods(std::vector<MipsFunc>& funcs);
 
     // 获取该类直接定义的方法列表（缓存）
-    std::vector<method_class*> GetMethods();
+    const std::vector<method_class*>& GetMethods();
     std::vector<method_class*> m_methods; // 缓存：本类方法
 
-    // 获取该类完整的（包括继承的）方法列表（缓存），按覆盖顺序排列
-    std::vector<method_class*> GetFullMethods();
-    std::vector<method_class*> m_full_methods; // 缓存：完整方法表（用于分发表）
-
-    // 获取分发表中方法名到定义该方法的类名的映射（缓存）
-    std::map<Symbol, Symbol> GetDispatchClassTab();
-    std::map<Symbol, Symbol> m_dispatch_class_tab; // 缓存：方法名->定义类名
-
-    // 获取分发表中方法名到索引的映射（缓存）
-    std::map<Symbol, int> GetDispatchIdxTab();
-    std::map<Symbol, int> m_dispatch_idx_tab; // 缓存：方法名->分发表索引
-
     // 获取该类直接定义的属性列表（缓存）
-    std::vector<attr_class*> GetAttribs();
+    const std::vector<attr_class*>& GetAttribs();
     std::vector<attr_class*> m_attribs; // 缓存：本类属性
 
-    // 获取该类完整的（包括继承的）属性列表（缓存），按继承顺序排列
-    std::vector<attr_class*> GetFullAttribs();
-    std::vector<attr_class*> m_full_attribs; // 缓存：完整属性列表（用于对象布局）
+    // 获取该类的布局（完整属性表和分发表），由CgenClassTable预先计算
+    const CgenLayout& GetLayout() {
+        return m_layout;
+    }
+    CgenLayout m_layout;
 
-    // 获取属性名到其在对象布局中索引的映射（缓存）
-    std::map<Symbol, int> GetAttribIdxTab();
-    std::map<Symbol, int> m_attrib_idx_tab; // 缓存：属性名->对象属性槽索引
+    // 获取该类完整的（包括继承的）方法列表，按分发表顺序排列
+    const std::vector<method_class*>& GetFullMethods() {
+        return m_layout.methods;
+    }
 
-    // 获取从根类（Object）到当前类的继承链节点列表（缓存）
-    std::vector<CgenNode*> GetInheritance();
-    std::vector<CgenNode*> inheritance; // 缓存：继承链
+    // 获取该类完整的（包括继承的）属性列表，按对象布局顺序排列
+    const std::vector<attr_class*>& GetFullAttribs() {
+        return m_layout.attribs;
+    }
 
     // 该类的唯一标签ID
     int class_tag;
+    // 该类子树（自身和全部子类）中最大的标签，子树的标签为class_tag..last_tag
+    int last_tag;
+
+    // 类层次分析的结果：分发表的第slot个方法在该类的整个子树中是否只有
+    // 一个实现（没有子类覆盖它），是则对静态类型为该类的调用可以直接jal
+    bool HasSingleImpl(int slot) const {
+        return m_single_impl[slot];
+    }
+    std::vector<bool> m_single_impl;
+};
+
+// 汇编输出缓冲区的块大小（字节）
+#define ASMBUF_CHUNK (1 << 20)
+
+// 汇编输出缓冲区：生成的代码先写入内存中的大块缓冲区，
+// 代码生成结束后再以少量的大块写入输出文件。不做隐式刷新。
+class AsmBuf : public std::streambuf {
+public:
+    AsmBuf();
+    ~AsmBuf();
+    // 已缓冲的字节数
+    size_t Size() const;
+    // 把全部缓冲内容写入os，每块一次写操作
+    void WriteTo(ostream& os);
+
+protected:
+    // 当前块写满时分配新块
+    int_type overflow(int_type c);
+    // endl触发的刷新不做任何事
+    int sync() {
+        return 0;
+    }
+
+private:
+    void NewChunk();
+    std::vector<char*> m_chunks; // 已分配的块，最后一块为当前写入块
+    size_t m_full_bytes;         // 除当前块外所有块中的字节数
 };
 
 // 布尔常量类，用于生成布尔常量的代码
@@ -202,27 +427,131 @@ public:
     void code_def(ostream&, int boolclasstag);
     // 生成布尔常量的引用代码（用于代码中的字面量）
     void code_ref(ostream&) const;
+    // 获取布尔值
+    int get_val() const {
+        return val;
+    }
+};
+
+// 线性扫描寄存器分配（-O，遍"regalloc"，-r关闭；开启GC时也不使用，
+// 见method_class::code）。
+// 生成一个方法的代码之前，alloc_regs按求值顺序遍历方法体，为let/case变量、
+// 形参和二元运算中暂存的左操作数各记录一个活跃区间，端点是遍历时的计数；
+// Run按起点顺序把$s1-$s6分配给这些区间，寄存器不够时溢出结束最晚的区间；
+// 一个寄存器上各区间的收益加起来抵不过保存和恢复它的代价时整个放弃，
+// 溢出和放弃的区间仍放在栈上。用到的$s寄存器由方法在序言中保存、
+// 尾声中恢复（被调用者保存），运行时例程也不修改它们，
+// 所以寄存器中的值在jal/jalr前后保持不变，调用者不需要另外保存。
+class RegAlloc {
+public:
+    // 区间的种类。同一节点可以有多个区间，如-O时算术运算的暂存操作数和结果
+    enum Kind {
+        VAR,      // let/case变量或形参（节点为let、branch或formal）
+        OPERAND,  // 求右操作数时暂存的左操作数
+        RESULT,   // 分配结果对象时暂存的未装箱结果
+        NUM_KINDS
+    };
+
+    // 为node开始一个区间，benefit为放在寄存器中省下的代价（不算使用）
+    int Open(tree_node* node, Kind kind, int benefit);
+    // 结束区间id
+    void Close(int id);
+
+    // 变量名作用域：Bind使名字指向区间id，Unbind撤销最近的Bind
+    void Bind(Symbol name, int id) { m_scope.push_back(std::make_pair(name, id)); }
+    void Unbind() { m_scope.pop_back(); }
+    // 读写名字为name的变量，每次省下一次访存
+    void Use(Symbol name);
+    void EnterLoop() { ++m_loop_depth; }
+    void ExitLoop() { --m_loop_depth; }
+
+    // 线性扫描，所有区间都结束后调用
+    void Run();
+
+    // 分配给node的kind区间的寄存器，不在寄存器中返回-1
+    int RegOf(tree_node* node, Kind kind) const {
+        auto it = m_reg[kind].find(node);
+        return it == m_reg[kind].end() ? -1 : it->second;
+    }
+    // 分配出去的寄存器，从小到大
+    const std::vector<int>& UsedRegs() const { return m_used; }
+
+private:
+    struct Interval {
+        tree_node* node;
+        Kind kind;
+        int start, end;
+        int benefit;    // 按循环嵌套加权
+        bool excluded;  // 所在的寄存器被放弃过
+        int reg;
+    };
+
+    // 当前位置的执行频度估计：每层循环乘10
+    int Frequency() const;
+    // 对未排除的区间做一遍线性扫描
+    void Scan();
+
+    int m_pos = 0;
+    int m_loop_depth = 0;
+    std::vector<Interval> m_intervals;       // 按起点排列
+    std::vector<std::pair<Symbol, int> > m_scope;
+    std::unordered_map<const tree_node*, int> m_reg[NUM_KINDS];
+    std::vector<int> m_used;
+};
+
+// 常量折叠（-O，遍"fold"）。代码生成之前按类标签顺序串行地遍历每个方法体
+// 和属性初始化表达式，把值在编译时已知的表达式的folded设为对应的常量节点
+// （条件已知的if、变量被传播掉的let则设为实际执行的子表达式）。
+// 折叠出的新常量在这里加入inttable/stringtable，所以常量表的内容和顺序
+// 与-j无关；代码生成时只需查表。AST本身不被修改，关闭该遍即生成原来的代码。
+class ConstFolder {
+public:
+    // 折叠一个方法体或属性初始化表达式。先遍历一次找出被赋值的变量名，
+    // 再遍历一次，这次把从未被赋值、初值为常量的let变量传播到它的使用处
+    void Fold(Expression e);
+
+    // 以下供fold_constants使用
+    // 变量名作用域：value为变量的常量值，不是常量时为NULL
+    void Bind(Symbol name, Expression value) { m_scope.push_back(std::make_pair(name, value)); }
+    void Unbind() { m_scope.pop_back(); }
+    // 名字为name的变量的常量值，不是常量（或不是let/case变量）时为NULL
+    Expression LookUp(Symbol name) const;
+    // 记录对name的赋值
+    void Assign(Symbol name) { m_assigned.insert(name); }
+    // 初值为value的let变量name能否传播
+    bool CanPropagate(Symbol name, Expression value) const {
+        return m_propagate && value != nullptr && m_assigned.count(name) == 0;
+    }
+
+private:
+    bool m_propagate = false;
+    std::set<Symbol> m_assigned;
+    std::vector<std::pair<Symbol, Expression> > m_scope;
 };
 
 // 环境类，用于代码生成过程中的符号管理（变量、参数、属性查找）
+// 整个方法体的代码生成共享同一个Environment（以引用传递），
+// 进入/退出作用域都是O(1)，变量和参数查找通过哈希表完成。
 class Environment {
 public:
     // 构造函数，初始化类节点为空
-    Environment() : m_class_node(nullptr) {}
+    Environment()
+        : m_class_node(nullptr), m_regs(nullptr), m_frame_base(-1),
+          m_max_slots(0), m_saved_regs(nullptr), m_entry_label(-1),
+          m_stack_slots(0) {}
 
-    // 进入一个新的作用域（如进入一个block）
+    // 进入一个新的作用域（如进入一个let或case分支）
     void EnterScope() {
         // 记录新作用域的初始长度（变量数为0）
         m_scope_lengths.push_back(0);
     }
 
-    // 退出当前作用域
+    // 退出当前作用域，撤销该作用域内添加的所有变量
     void ExitScope() {
         // 获取当前作用域增加的变量数量
-        int num_vars_in_scope = m_scope_lengths[m_scope_lengths.size() - 1];
-        // 从变量索引表中移除当前作用域的所有变量
+        int num_vars_in_scope = m_scope_lengths.back();
         for (int i = 0; i < num_vars_in_scope; ++i) {
-            m_var_idx_tab.pop_back();
+            PopVar();
         }
         // 移除记录的作用域长度信息
         m_scope_lengths.pop_back();
@@ -230,73 +559,179 @@ public:
 
     // 查找属性符号，返回其在对象布局中的索引（偏移量）
     int LookUpAttrib(Symbol sym) {
-        // 获取当前类节点的属性索引映射表
-        std::map<Symbol, int> attrib_idx_tab = m_class_node->GetAttribIdxTab();
-        // 如果找到该属性，返回其索引
-        if (attrib_idx_tab.find(sym) != attrib_idx_tab.end()) {
-            return attrib_idx_tab[sym];
-        }
-        // 未找到返回-1
-        return -1;
+        // 直接读取当前类预先计算好的布局，未找到返回-1
+        return m_class_node->GetLayout().AttribSlot(sym);
     }
 
-    // 查找局部变量符号，返回其相对于栈顶的偏移量（反向查找）
-    // 变量表是反向存储的，最后添加的变量在末尾，但栈帧中最新变量在低地址
+    // 查找局部变量符号，返回其栈槽编号，地址由SlotAddr给出
     int LookUpVar(Symbol sym) {
-        // 从变量表末尾向前查找（即从最近添加的变量开始找）
-        for (int idx = m_var_idx_tab.size() - 1; idx >= 0; --idx) {
-            if (m_var_idx_tab[idx] == sym) {
-                // 计算偏移量：总变量数 - 1 - 找到的索引
-                // 因为栈帧中，先压栈的参数/变量在更高地址，后压栈的在更低地址
-                return m_var_idx_tab.size() - 1 - idx;
-            }
+        auto it = m_var_top.find(sym);
+        if (it == m_var_top.end() || m_var_reg[it->second] != -1) {
+            // 未找到或在寄存器中返回-1
+            return -1;
         }
-        // 未找到返回-1
-        return -1;
+        return m_var_slot[it->second];
     }
 
-    // 添加一个局部变量到当前作用域，返回其在变量表中的索引
-    int AddVar(Symbol sym) {
-        // 将变量符号加入变量表末尾
+    // 第slot个栈槽的地址：reg + 4 * offset。
+    // 固定栈帧中相对于$fp，栈槽k在$fp下方m_frame_base + k个字处；
+    // 否则相对于移动的$sp，最后压栈的栈槽在1($sp)处
+    void SlotAddr(int slot, int& reg, int& offset) const {
+        if (m_frame_base != -1) {
+            reg = FP;
+            offset = -(m_frame_base + slot);
+        } else {
+            reg = SP;
+            offset = m_stack_slots - slot;
+        }
+    }
+
+    // 最后添加的栈槽的地址
+    void TopSlotAddr(int& reg, int& offset) const {
+        SlotAddr(m_stack_slots - 1, reg, offset);
+    }
+
+    // 内联的方法体使用调用者的栈帧：栈槽编号接着调用者的栈槽，
+    // 调用者最后添加的shared个栈槽（实参）留给本环境作为变量
+    void ShareFrame(const Environment& caller, int shared) {
+        m_frame_base = caller.m_frame_base;
+        m_stack_slots = caller.m_stack_slots - shared;
+        m_max_slots = m_stack_slots;
+    }
+
+    // 查找放在寄存器中的局部变量，返回寄存器，未找到或在栈上返回-1
+    int LookUpVarReg(Symbol sym) {
+        auto it = m_var_top.find(sym);
+        return it == m_var_top.end() ? -1 : m_var_reg[it->second];
+    }
+
+    // 添加一个局部变量到当前作用域，返回其在变量表中的索引。
+    // reg为-1时变量占一个栈槽，否则放在寄存器reg中
+    int AddVar(Symbol sym, int reg = -1) {
+        int idx = m_var_idx_tab.size();
+        auto it = m_var_top.find(sym);
+        // 记录被遮蔽的同名变量，退出作用域时恢复
+        m_var_shadowed.push_back(it == m_var_top.end() ? -1 : it->second);
+        m_var_top[sym] = idx;
         m_var_idx_tab.push_back(sym);
+        m_var_reg.push_back(reg);
+        m_var_slot.push_back(reg == -1 ? m_stack_slots++ : -1);
+        if (m_stack_slots > m_max_slots) {
+            m_max_slots = m_stack_slots;
+        }
         // 当前作用域的变量数量加1
-        ++m_scope_lengths[m_scope_lengths.size() - 1];
-        // 返回新变量的索引（在变量表中的位置）
-        return m_var_idx_tab.size() - 1;
+        ++m_scope_lengths.back();
+        return idx;
     }
 
-    // （此方法未实现）可能用于添加一个栈障碍？
+    // 在一个新作用域中压入一个匿名的栈槽（保存中间结果或实参），
+    // 使之后的变量偏移量计算正确；调用者负责对应的ExitScope
     int AddObstacle();
 
     // 查找参数符号，返回其相对于栈帧基址的偏移量
     // 参数是按顺序压栈的，第一个参数在栈帧底部（高地址）
     int LookUpParam(Symbol sym) {
-        // 在参数表中顺序查找
-        for (int idx = 0; idx < m_param_idx_tab.size(); ++idx) {
-            if (m_param_idx_tab[idx] == sym) {
-                // 计算偏移量：参数总数 - 1 - 索引
-                // 因为第一个参数（索引0）在离栈帧基址最远的位置（偏移量最大）
-                return m_param_idx_tab.size() - 1 - idx;
-            }
+        auto it = m_param_pos.find(sym);
+        if (it == m_param_pos.end()) {
+            // 未找到返回-1
+            return -1;
         }
-        // 未找到返回-1
-        return -1;
+        // 计算偏移量：参数总数 - 1 - 索引
+        return m_param_idx_tab.size() - 1 - it->second;
+    }
+
+    // 方法的参数个数
+    int NumParams() const {
+        return m_param_idx_tab.size();
+    }
+
+    // 当前的栈槽数；不使用固定栈帧时即方法体压在栈上的字数
+    int StackSlots() const {
+        return m_stack_slots;
     }
 
     // 添加一个参数到参数表
     int AddParam(Symbol sym) {
+        m_param_pos[sym] = m_param_idx_tab.size();
         // 将参数符号加入参数表末尾
         m_param_idx_tab.push_back(sym);
         // 返回新参数的索引
         return m_param_idx_tab.size() - 1;
     }
 
-    // 记录每个作用域开始时，变量表的长度增量
+    // 查找放在寄存器中的参数，返回寄存器，未找到或在栈上返回-1
+    int LookUpParamReg(Symbol sym) {
+        auto it = m_param_reg.find(sym);
+        return it == m_param_reg.end() ? -1 : it->second;
+    }
+
+    // 参数sym在方法序言中装入了寄存器reg
+    void SetParamReg(Symbol sym, int reg) {
+        m_param_reg[sym] = reg;
+    }
+
+    // 寄存器分配给node的kind区间的寄存器，没有分配时返回-1
+    int RegOf(tree_node* node, RegAlloc::Kind kind) {
+        return m_regs ? m_regs->RegOf(node, kind) : -1;
+    }
+
+    // 记录每个作用域中添加的变量数量
     std::vector<int> m_scope_lengths;
-    // 变量符号表，按添加顺序存储所有局部变量（包括不同作用域的）
+    // 变量符号表，按压栈顺序存储所有栈槽（匿名栈槽为No_class）
     std::vector<Symbol> m_var_idx_tab;
+    // 与m_var_idx_tab一一对应：该变量遮蔽的同名变量的索引（-1表示无）
+    std::vector<int> m_var_shadowed;
+    // 与m_var_idx_tab一一对应：变量所在的寄存器（-1表示在栈上）
+    std::vector<int> m_var_reg;
+    // 与m_var_idx_tab一一对应：变量的栈槽编号（-1表示在寄存器中）
+    std::vector<int> m_var_slot;
+    // 变量名 -> 当前可见的（最内层的）变量在m_var_idx_tab中的索引
+    std::unordered_map<Symbol, int> m_var_top;
     // 参数符号表，按顺序存储方法的形参
     std::vector<Symbol> m_param_idx_tab;
+    // 参数名 -> 参数在m_param_idx_tab中的索引
+    std::unordered_map<Symbol, int> m_param_pos;
+    // 参数名 -> 放着该参数的寄存器
+    std::unordered_map<Symbol, int> m_param_reg;
     // 指向当前代码生成所在的类节点的指针
     CgenNode* m_class_node;
+    // 当前方法的寄存器分配结果，不做分配时为空
+    const RegAlloc* m_regs;
+    // 正在生成代码的方法和其中逐层内联的方法，最外层在前；
+    // 已在其中的方法不再内联，所以递归调用总是真正的调用
+    std::vector<method_class*> m_inline_chain;
+    // 固定栈帧（-O，遍"frame"）中栈槽0在$fp下方的字数，-1表示栈槽随
+    // 压栈出栈分配在$sp处
+    int m_frame_base;
+    // 同时存在过的栈槽数的最大值，即固定栈帧的大小（字）
+    int m_max_slots;
+    // 方法序言保存的分配寄存器，尾调用离开栈帧时恢复它们
+    const std::vector<int>* m_saved_regs;
+    // 方法体中处于尾位置的调用（-O，遍"tail"）；内联的方法体中为空
+    std::set<Expression> m_tail_calls;
+    // 方法体开头（序言之后）的标签，调用自身的尾调用跳到这里；-1表示
+    // 还没有用到
+    int m_entry_label;
+
+private:
+    // 弹出最后添加的栈槽，并恢复被它遮蔽的同名变量
+    void PopVar() {
+        Symbol sym = m_var_idx_tab.back();
+        int shadowed = m_var_shadowed.back();
+        if (shadowed == -1) {
+            m_var_top.erase(sym);
+        } else {
+            m_var_top[sym] = shadowed;
+        }
+        if (m_var_reg.back() == -1) {
+            --m_stack_slots;
+        }
+        m_var_idx_tab.pop_back();
+        m_var_shadowed.pop_back();
+        m_var_reg.pop_back();
+        m_var_slot.pop_back();
+    }
+
+    // 当前压在栈上的变量和匿名栈槽的数量
+    int m_stack_slots;
 };
\ No newline at end of file
@@ -0,0 +1,100 @@
+//
+// See copyright.h for copyright notice and limitation of liability
+// and disclaimer of warranty provisions.
+//
+#include "copyright.h"
+
+//////////////////////////////////////////////////////////////////////////
+//
+//  cgen_cache.cc
+//
+//  Hashing and file storage for the class code cache (see cgen_cache.h).
+//  What goes into a key, and how cached text is produced and spliced in,
+//  is decided by CgenClassTable::generate_class_code in cgen.cc.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <fstream>
+#include <sstream>
+#include "cgen_cache.h"
+
+#define CACHE_HEADER "cgen class cache 1"
+
+#define FNV_PRIME 1099511628211ULL
+
+CgenCacheHash::CgenCacheHash()
+    : m_lo(14695981039346656037ULL), m_hi(0x6c62272e07bb0142ULL) {
+}
+
+void CgenCacheHash::Add(const char* data, size_t len) {
+    for (size_t i = 0; i < len; ++i) {
+        unsigned char c = data[i];
+        m_lo = (m_lo ^ c) * FNV_PRIME;
+        m_hi = (m_hi ^ (c ^ 0xa5)) * FNV_PRIME;
+    }
+}
+
+std::string CgenCacheHash::Hex() const {
+    char buf[33];
+    snprintf(buf, sizeof(buf), "%016llx%016llx", m_hi, m_lo);
+    return buf;
+}
+
+static std::string cache_path(const char* dir, const std::string& key) {
+    return std::string(dir) + "/" + key;
+}
+
+bool cgen_cache_load(const char* dir, const std::string& key,
+                     CgenCacheEntry& e) {
+    std::ifstream f(cache_path(dir, key).c_str(), std::ios::binary);
+    if (!f) {
+        return false;
+    }
+
+    std::string header;
+    size_t init_len, methods_len;
+    if (!std::getline(f, header) || header != CACHE_HEADER ||
+        !(f >> e.init_labels >> e.methods_labels >> init_len >> methods_len) ||
+        f.get() != '\n') {
+        return false;
+    }
+
+    e.init_text.resize(init_len);
+    e.methods_text.resize(methods_len);
+    if (!f.read(&e.init_text[0], init_len) ||
+        !f.read(&e.methods_text[0], methods_len) ||
+        f.peek() != EOF) {
+        return false;
+    }
+    return true;
+}
+
+void cgen_cache_store(const char* dir, const std::string& key,
+                      const CgenCacheEntry& e) {
+    if (mkdir(dir, 0777) != 0 && errno != EEXIST) {
+        return;
+    }
+
+    std::string path = cache_path(dir, key);
+    std::ostringstream tmp;
+    tmp << path << ".tmp" << getpid();
+    {
+        std::ofstream f(tmp.str().c_str(), std::ios::binary);
+        f << CACHE_HEADER << "\n"
+          << e.init_labels << " " << e.methods_labels << " "
+          << e.init_text.size() << " " << e.methods_text.size() << "\n"
+          << e.init_text << e.methods_text;
+        if (!f.flush()) {
+            f.close();
+            unlink(tmp.str().c_str());
+            return;
+        }
+    }
+    if (rename(tmp.str().c_str(), path.c_str()) != 0) {
+        unlink(tmp.str().c_str());
+    }
+}
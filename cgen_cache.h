@@ -0,0 +1,99 @@
+//
+// See copyright.h for copyright notice and limitation of liability
+// and disclaimer of warranty provisions.
+//
+#include "copyright.h"
+
+#ifndef _CGEN_CACHE_H_
+#define _CGEN_CACHE_H_
+
+//////////////////////////////////////////////////////////////////////////
+//
+//  cgen_cache.h
+//
+//  An on-disk cache of generated class code, used with -C dir.
+//
+//  Each class is stored under a key that hashes everything its init and
+//  method code depends on: the class's typed AST (line numbers included),
+//  the layout and tag of every class in the program, the code generation
+//  flags and CGEN_CACHE_VERSION.  With -O the key also covers the bodies
+//  the class may inline.  Editing a method body only changes the keys of
+//  its own class and of the classes that inline it; adding, removing or
+//  retyping a feature changes the layouts, so every class misses.
+//
+//  The cached text is relocatable.  Label numbers and references to
+//  int and string constants depend on the rest of the program, so they
+//  are written as markers and resolved when the text is spliced into the
+//  output:
+//
+//     RELOC 'L' n ':'              label n, counted from the class's base
+//     RELOC 'I' len ':' chars      the int constant with these digits
+//     RELOC 'S' len ':' chars      the string constant with these chars
+//
+//  A cache file holds a header line, the label counts and text lengths
+//  of the init and of the methods, then the two texts.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include <stddef.h>
+#include <string>
+
+#define CGEN_CACHE_RELOC '\001'
+
+//
+// The version of the generated code.  Bump it with every change to the
+// code generator (cgen*.cc, the peephole rules, the passes, the runtime
+// interface) that can change the text of a class, so that entries written
+// by an older build are not reused.
+//
+#define CGEN_CACHE_VERSION 1
+
+//
+// A 128-bit FNV-1a hash (two 64-bit lanes with different offset bases),
+// printed as 32 hex digits to name the cache file.
+//
+class CgenCacheHash {
+public:
+    CgenCacheHash();
+    void Add(const char* data, size_t len);
+    void Add(const std::string& s) {
+        Add(s.data(), s.size());
+        Add("", 1); // separator, so "ab"+"c" and "a"+"bc" differ
+    }
+    void Add(long n) {
+        Add(std::to_string(n));
+    }
+    std::string Hex() const;
+
+private:
+    unsigned long long m_lo;
+    unsigned long long m_hi;
+};
+
+//
+// The cached code of one class.  Labels in init_text are numbered from
+// 0, and those in methods_text continue from 0 across all the methods.
+//
+struct CgenCacheEntry {
+    int init_labels = 0;
+    int methods_labels = 0;
+    std::string init_text;
+    std::string methods_text;
+};
+
+//
+// Load the entry stored under key into e.  Returns false if there is no
+// such entry or the file is damaged.
+//
+bool cgen_cache_load(const char* dir, const std::string& key,
+                     CgenCacheEntry& e);
+
+//
+// Store e under key.  The file is written under a temporary name and
+// renamed, so a concurrent or interrupted compile never sees half of it.
+// Failing to write is not an error; the class just misses next time.
+//
+void cgen_cache_store(const char* dir, const std::string& key,
+                      const CgenCacheEntry& e);
+
+#endif
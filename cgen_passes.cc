@@ -0,0 +1,213 @@
+//
+// See copyright.h for copyright notice and limitation of liability
+// and disclaimer of warranty provisions.
+//
+#include "copyright.h"
+
+//////////////////////////////////////////////////////////////////////////
+//
+//  cgen_passes.cc
+//
+//  The pass table, the pass manager and the IR passes described in
+//  cgen_passes.h.  The codegen passes themselves live in cgen.cc, the
+//  peephole optimizer in cgen_peephole.cc.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include <string.h>
+#include <atomic>
+#include "cgen.h"
+#include "cgen_passes.h"
+#include "cgen_peephole.h"
+
+extern int cgen_debug;
+extern int cgen_optimize;
+
+static void sp_merge(MipsFunc& f);
+
+struct CgenPassInfo {
+    const char* name;
+    void (*run)(MipsFunc&);   // NULL for a codegen pass
+    void (*report)(ostream&); // details for the report, or NULL
+};
+
+// In CgenPass order, which is also the order the IR passes run in.
+static const CgenPassInfo pass_table[NUM_CGEN_PASSES] = {
+    { "regalloc", nullptr,  nullptr },
+    { "fold",     nullptr,  nullptr },
+    { "unbox",    nullptr,  nullptr },
+    { "branch",   nullptr,  nullptr },
+    { "case",     nullptr,  nullptr },
+    { "devirt",   nullptr,  nullptr },
+    { "inline",   nullptr,  nullptr },
+    { "barrier",  nullptr,  nullptr },
+    { "frame",    nullptr,  nullptr },
+    { "leaf",     nullptr,  nullptr },
+    { "tail",     nullptr,  nullptr },
+    { "init",     nullptr,  nullptr },
+    { "alloc",    nullptr,  nullptr },
+    { "peephole", peephole, peephole_report },
+    { "sp-merge", sp_merge, nullptr },
+};
+
+static bool pass_off[NUM_CGEN_PASSES];                   // by -P no-name
+static std::atomic<long> pass_removed[NUM_CGEN_PASSES];  // for the report
+
+// Passes turned off on this thread while a codegen pass is measured.
+static thread_local unsigned pass_suppressed = 0;
+
+bool cgen_select_passes(const char* list) {
+    const char* p = list;
+    while (*p) {
+        const char* end = strchr(p, ',');
+        if (end == nullptr) {
+            end = p + strlen(p);
+        }
+        std::string name(p, end);
+        bool off = name.compare(0, 3, "no-") == 0;
+        if (off) {
+            name = name.substr(3);
+        }
+
+        int pass = 0;
+        while (pass < NUM_CGEN_PASSES && name != pass_table[pass].name) {
+            ++pass;
+        }
+        if (pass == NUM_CGEN_PASSES) {
+            cerr << "unknown pass `" << name << "'; the passes are:";
+            for (const CgenPassInfo& info : pass_table) {
+                cerr << " " << info.name;
+            }
+            cerr << endl;
+            return false;
+        }
+        pass_off[pass] = off;
+
+        p = *end ? end + 1 : end;
+    }
+    return true;
+}
+
+bool cgen_pass_enabled(CgenPass pass) {
+    return cgen_optimize && !pass_off[pass] &&
+           !(pass_suppressed & (1u << pass));
+}
+
+bool cgen_passes_measuring() {
+    return pass_suppressed != 0;
+}
+
+std::string cgen_passes_key() {
+    std::string key;
+    for (int pass = 0; pass < NUM_CGEN_PASSES; ++pass) {
+        if (cgen_pass_enabled((CgenPass) pass)) {
+            key += pass_table[pass].name;
+            key += " ";
+        }
+    }
+    return key;
+}
+
+// Labels and comments are not instructions.
+static long count_insts(const MipsFunc& f) {
+    long n = 0;
+    for (const MipsInst& inst : f.insts) {
+        if (inst.op != MIPS_LABEL && inst.op != MIPS_COMMENT) {
+            ++n;
+        }
+    }
+    return n;
+}
+
+static void run_ir_passes(MipsFunc& f, bool count) {
+    for (int pass = 0; pass < NUM_CGEN_PASSES; ++pass) {
+        if (pass_table[pass].run == nullptr ||
+            !cgen_pass_enabled((CgenPass) pass)) {
+            continue;
+        }
+        long before = count ? count_insts(f) : 0;
+        pass_table[pass].run(f);
+        if (count) {
+            pass_removed[pass] += before - count_insts(f);
+        }
+    }
+}
+
+void cgen_generate(MipsFunc& f, const std::function<void(MipsFunc&)>& generate) {
+    generate(f);
+    if (!cgen_optimize) {
+        return;
+    }
+    run_ir_passes(f, cgen_debug);
+    if (!cgen_debug) {
+        return;
+    }
+
+    long size = count_insts(f);
+    for (int pass = 0; pass < NUM_CGEN_PASSES; ++pass) {
+        if (pass_table[pass].run != nullptr ||
+            !cgen_pass_enabled((CgenPass) pass)) {
+            continue;
+        }
+        pass_suppressed |= 1u << pass;
+        MipsFunc without(f.class_name, f.method_name);
+        generate(without);
+        run_ir_passes(without, false);
+        pass_suppressed &= ~(1u << pass);
+        pass_removed[pass] += count_insts(without) - size;
+    }
+}
+
+void cgen_passes_report(ostream& s) {
+    s << "optimization passes:" << endl;
+    for (int pass = 0; pass < NUM_CGEN_PASSES; ++pass) {
+        s << "  " << pass_table[pass].name << ": ";
+        if (cgen_pass_enabled((CgenPass) pass)) {
+            s << "removed " << pass_removed[pass] << " instructions" << endl;
+            if (pass_table[pass].report != nullptr) {
+                pass_table[pass].report(s);
+            }
+        } else {
+            s << "off" << endl;
+        }
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+//  sp-merge
+//
+//  Two adjustments of $sp with only comments between them become one,
+//  and an adjustment by 0 goes away.  This mostly joins the frame pop of
+//  the epilogue and the pop of the arguments.
+//
+//////////////////////////////////////////////////////////////////////////
+
+static bool is_sp_adjust(const MipsInst& inst) {
+    return inst.op == MIPS_ADDIU && inst.rd == SP && inst.rs == SP;
+}
+
+static void sp_merge(MipsFunc& f) {
+    std::vector<MipsInst> out;
+    out.reserve(f.insts.size());
+    int last_adjust = -1;   // in out, if only comments have followed it
+    for (const MipsInst& inst : f.insts) {
+        if (is_sp_adjust(inst) && last_adjust != -1) {
+            out[last_adjust].imm += inst.imm;
+            continue;
+        }
+        if (is_sp_adjust(inst)) {
+            last_adjust = out.size();
+        } else if (inst.op != MIPS_COMMENT) {
+            last_adjust = -1;
+        }
+        out.push_back(inst);
+    }
+
+    f.insts.clear();
+    for (const MipsInst& inst : out) {
+        if (!is_sp_adjust(inst) || inst.imm != 0) {
+            f.insts.push_back(inst);
+        }
+    }
+}
@@ -0,0 +1,94 @@
+//
+// See copyright.h for copyright notice and limitation of liability
+// and disclaimer of warranty provisions.
+//
+#include "copyright.h"
+
+#ifndef _CGEN_PASSES_H_
+#define _CGEN_PASSES_H_
+
+//////////////////////////////////////////////////////////////////////////
+//
+//  cgen_passes.h
+//
+//  The optimizations enabled by -O, and the pass manager that runs them.
+//
+//  There are two kinds of passes.  A codegen pass changes how the AST is
+//  translated: the code generators in cgen.cc ask cgen_pass_enabled and
+//  pick the plain or the optimized translation.  An IR pass rewrites the
+//  instructions of a function (a MipsFunc) after it has been generated;
+//  cgen_generate runs the enabled ones in the order of the pass table.
+//
+//  -P list turns passes on and off: a comma-separated list of pass
+//  names, each turning that pass on, or off when written as no-name.
+//  Every pass is on by default.  Without -O no pass runs.
+//
+//  With -c a report of the instructions each pass removed is printed.
+//  An IR pass is measured by counting the instructions before and after
+//  it.  A codegen pass is measured by generating every function once more
+//  without it, so the report costs one more code generation per pass.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include <functional>
+#include <string>
+#include "cool-io.h"
+
+class MipsFunc;
+
+enum CgenPass {
+    PASS_REGALLOC,  // codegen: locals and temporaries in $s1-$s6 (-r turns it off)
+    PASS_FOLD,      // codegen: constant folding and propagation
+    PASS_UNBOX,     // codegen: Int arithmetic on unboxed values
+    PASS_BRANCH,    // codegen: if/while branch on the comparison itself
+    PASS_CASE,      // codegen: case tests tag ranges, or uses a jump table
+    PASS_DEVIRT,    // codegen: direct calls to methods no subclass overrides
+    PASS_INLINE,    // codegen: small methods expanded at known call sites
+    PASS_BARRIER,   // codegen: write barriers only where they may be needed
+    PASS_FRAME,     // codegen: locals and temporaries in a fixed $fp-relative frame
+    PASS_LEAF,      // codegen: no $ra/$fp spill in functions that make no call
+    PASS_TAIL,      // codegen: tail calls leave the frame, self-recursion jumps
+    PASS_INIT,      // codegen: flat class inits without default stores
+    PASS_ALLOC,     // codegen: new of a known class bumps $gp inline
+    PASS_PEEPHOLE,  // IR: windowed peephole rules, see cgen_peephole.h
+    PASS_SP_MERGE,  // IR: merge adjacent adjustments of $sp
+    NUM_CGEN_PASSES
+};
+
+//
+// Apply a -P list.  Returns false, after naming the bad entry and the
+// known passes on cerr, if the list names an unknown pass.
+//
+bool cgen_select_passes(const char* list);
+
+//
+// Is the pass to be run?  Codegen passes ask this while generating code;
+// the answer may differ between threads while the report is measured.
+//
+bool cgen_pass_enabled(CgenPass pass);
+
+//
+// The names of the passes that run, for the class code cache key.
+//
+std::string cgen_passes_key();
+
+//
+// Generate f by calling generate(f), then run the enabled IR passes on
+// it.  generate may be called again on scratch functions to measure the
+// codegen passes for the report.
+//
+void cgen_generate(MipsFunc& f, const std::function<void(MipsFunc&)>& generate);
+
+//
+// Is the function being generated only to measure a codegen pass for
+// the report?  IR passes keep their own statistics out of such runs.
+//
+bool cgen_passes_measuring();
+
+//
+// Print the number of instructions each pass removed, and the details
+// some passes add.
+//
+void cgen_passes_report(ostream& s);
+
+#endif
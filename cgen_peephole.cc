@@ -0,0 +1,743 @@
+//
+// See copyright.h for copyright notice and limitation of liability
+// and disclaimer of warranty provisions.
+//
+#include "copyright.h"
+
+//////////////////////////////////////////////////////////////////////////
+//
+//  cgen_peephole.cc
+//
+//  The peephole optimizer described in cgen_peephole.h: the function
+//  being rewritten with its liveness (class Peephole), the rules, and
+//  the rule table that drives them.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <atomic>
+#include <unordered_map>
+#include "cgen.h"
+#include "cgen_passes.h"
+#include "cgen_peephole.h"
+
+#define PEEPHOLE_WINDOW     4   // instructions a rule may look past its first
+#define PEEPHOLE_MAX_SWEEPS 10
+
+typedef unsigned RegSet;        // bit r is register r
+#define REG_BIT(r)  (1u << (r))
+#define ALL_REGS    (~0u)
+
+static bool is_real(const MipsInst& i) {
+    return i.op != MIPS_LABEL && i.op != MIPS_COMMENT;
+}
+
+static bool is_branch(const MipsInst& i) {
+    switch (i.op) {
+    case MIPS_BEQZ: case MIPS_BEQ: case MIPS_BNE: case MIPS_BLEQ:
+    case MIPS_BLT: case MIPS_BGT: case MIPS_BGE: case MIPS_BLTI:
+    case MIPS_BGTI: case MIPS_BLEI: case MIPS_BGEI: case MIPS_B:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// A call, return or jump through a table: it reads every register as far
+// as liveness goes.
+static bool is_call(const MipsInst& i) {
+    return i.op == MIPS_JAL || i.op == MIPS_JALR || i.op == MIPS_RET ||
+           i.op == MIPS_JR;
+}
+
+// Control does not fall through to the next instruction.
+static bool is_jump(const MipsInst& i) {
+    return i.op == MIPS_B || i.op == MIPS_RET || i.op == MIPS_JR;
+}
+
+static RegSet uses(const MipsInst& i) {
+    switch (i.op) {
+    case MIPS_LW: case MIPS_MOVE: case MIPS_NEG: case MIPS_ADDIU:
+    case MIPS_SLL:
+        return REG_BIT(i.rs);
+    case MIPS_SW: case MIPS_BEQ: case MIPS_BNE: case MIPS_BLEQ:
+    case MIPS_BLT: case MIPS_BGT: case MIPS_BGE:
+        return REG_BIT(i.rd) | REG_BIT(i.rs);
+    case MIPS_ADD: case MIPS_ADDU: case MIPS_DIV: case MIPS_MUL:
+    case MIPS_SUB:
+        return REG_BIT(i.rs) | REG_BIT(i.rt);
+    case MIPS_BEQZ: case MIPS_BLTI: case MIPS_BGTI: case MIPS_BLEI:
+    case MIPS_BGEI:
+        return REG_BIT(i.rd);
+    case MIPS_JAL: case MIPS_JALR: case MIPS_RET: case MIPS_JR:
+        return ALL_REGS;
+    default:
+        return 0;
+    }
+}
+
+// Only instructions that write rd; a call writes registers too, but
+// leaving them out only makes more registers live.
+static RegSet defs(const MipsInst& i) {
+    switch (i.op) {
+    case MIPS_LW: case MIPS_LI: case MIPS_LA: case MIPS_MOVE: case MIPS_NEG:
+    case MIPS_ADD: case MIPS_ADDU: case MIPS_ADDIU: case MIPS_DIV:
+    case MIPS_MUL: case MIPS_SUB: case MIPS_SLL:
+        return REG_BIT(i.rd);
+    default:
+        return 0;
+    }
+}
+
+// Make i read register `to' where it reads `from'.
+static void replace_uses(MipsInst& i, int from, int to) {
+    switch (i.op) {
+    case MIPS_LW: case MIPS_MOVE: case MIPS_NEG: case MIPS_ADDIU:
+    case MIPS_SLL:
+        i.rs = i.rs == from ? to : i.rs;
+        break;
+    case MIPS_SW: case MIPS_BEQ: case MIPS_BNE: case MIPS_BLEQ:
+    case MIPS_BLT: case MIPS_BGT: case MIPS_BGE:
+        i.rd = i.rd == from ? to : i.rd;
+        i.rs = i.rs == from ? to : i.rs;
+        break;
+    case MIPS_ADD: case MIPS_ADDU: case MIPS_DIV: case MIPS_MUL:
+    case MIPS_SUB:
+        i.rs = i.rs == from ? to : i.rs;
+        i.rt = i.rt == from ? to : i.rt;
+        break;
+    case MIPS_BEQZ: case MIPS_BLTI: case MIPS_BGTI: case MIPS_BLEI:
+    case MIPS_BGEI:
+        i.rd = i.rd == from ? to : i.rd;
+        break;
+    default:
+        break;
+    }
+}
+
+//
+// One sweep over a function.  Instructions are removed by marking them
+// and inserted by queueing them; Finish applies both, so indices and
+// the liveness stay valid during the sweep.  The rest of the sweep does
+// not see the queued instructions, so Next and Prev stop at them.  The liveness is that of
+// the function at the start of the sweep.  A rewrite never makes a
+// register live outside its own window, so it stays a safe
+// over-approximation everywhere a later rule in the sweep looks.
+//
+class Peephole {
+public:
+    explicit Peephole(MipsFunc& f);
+
+    std::vector<MipsInst>& insts;
+
+    // Registers live right after insts[i].
+    RegSet LiveOut(int i) const;
+    // Registers live where label l is defined; all if l is not.
+    RegSet LiveAtLabel(int l) const;
+
+    // The next instruction after i, comments and removed ones skipped;
+    // it may be a label.  -1 at the end, or if something is queued to be
+    // inserted in between.
+    int Next(int i) const;
+    // The same backwards.
+    int Prev(int i) const;
+    // The first real instruction at label l, or -1.
+    int Target(int l) const;
+    // Is label l defined between i and the next real instruction?
+    bool LabelFollows(int i, int l) const;
+
+    void Remove(int i);
+    void Retarget(int i, int l);
+    void InsertAfter(int i, const MipsInst& inst);
+    // A label right after insts[i], made if there is none.
+    int LabelAfter(int i);
+    int LabelRefs(int l) const;
+
+    // Apply the removals and insertions.
+    void Finish();
+
+private:
+    MipsFunc& m_func;
+    std::vector<RegSet> m_live_in;
+    std::vector<bool> m_removed;
+    std::vector<bool> m_insert_after;   // something queued after insts[i]
+    std::vector<std::pair<int, MipsInst> > m_inserted;
+    std::unordered_map<int, int> m_label_pos;
+    std::unordered_map<int, int> m_label_refs;
+    std::unordered_map<int, int> m_made_labels;   // by instruction
+};
+
+Peephole::Peephole(MipsFunc& f)
+    : insts(f.insts), m_func(f), m_live_in(f.insts.size() + 1, 0),
+      m_removed(f.insts.size(), false),
+      m_insert_after(f.insts.size(), false) {
+    int n = insts.size();
+    for (int i = 0; i < n; ++i) {
+        if (insts[i].op == MIPS_LABEL) {
+            m_label_pos[insts[i].label] = i;
+        } else if (is_branch(insts[i])) {
+            ++m_label_refs[insts[i].label];
+        }
+    }
+    for (const MipsJumpTable& table : f.jump_tables) {
+        for (int target : table.targets) {
+            ++m_label_refs[target];
+        }
+    }
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int i = n - 1; i >= 0; --i) {
+            const MipsInst& inst = insts[i];
+            RegSet live = uses(inst) | (LiveOut(i) & ~defs(inst));
+            if (live != m_live_in[i]) {
+                m_live_in[i] = live;
+                changed = true;
+            }
+        }
+    }
+}
+
+RegSet Peephole::LiveOut(int i) const {
+    const MipsInst& inst = insts[i];
+    RegSet live = is_jump(inst) ? 0 : m_live_in[i + 1];
+    if (is_branch(inst)) {
+        live |= LiveAtLabel(inst.label);
+    }
+    return live;
+}
+
+RegSet Peephole::LiveAtLabel(int l) const {
+    auto it = m_label_pos.find(l);
+    return it == m_label_pos.end() ? ALL_REGS : m_live_in[it->second];
+}
+
+int Peephole::Next(int i) const {
+    for (; i + 1 < (int) insts.size() && !m_insert_after[i]; ++i) {
+        if (!m_removed[i + 1] && insts[i + 1].op != MIPS_COMMENT) {
+            return i + 1;
+        }
+    }
+    return -1;
+}
+
+int Peephole::Prev(int i) const {
+    for (--i; i >= 0 && !m_insert_after[i]; --i) {
+        if (!m_removed[i] && insts[i].op != MIPS_COMMENT) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int Peephole::Target(int l) const {
+    auto it = m_label_pos.find(l);
+    if (it == m_label_pos.end() || m_removed[it->second]) {
+        return -1;
+    }
+    int i = it->second;
+    while (i != -1 && insts[i].op == MIPS_LABEL) {
+        i = Next(i);
+    }
+    return i;
+}
+
+bool Peephole::LabelFollows(int i, int l) const {
+    for (i = Next(i); i != -1 && insts[i].op == MIPS_LABEL; i = Next(i)) {
+        if (insts[i].label == l) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Peephole::Remove(int i) {
+    if (is_branch(insts[i])) {
+        --m_label_refs[insts[i].label];
+    }
+    m_removed[i] = true;
+}
+
+void Peephole::Retarget(int i, int l) {
+    --m_label_refs[insts[i].label];
+    ++m_label_refs[l];
+    insts[i].label = l;
+}
+
+void Peephole::InsertAfter(int i, const MipsInst& inst) {
+    if (is_branch(inst)) {
+        ++m_label_refs[inst.label];
+    }
+    m_inserted.push_back(std::make_pair(i, inst));
+    m_insert_after[i] = true;
+}
+
+//
+// A label made after i goes before anything else queued there, so that
+// it still marks where the code falls through from insts[i].
+//
+int Peephole::LabelAfter(int i) {
+    int next = Next(i);
+    if (next != -1 && insts[next].op == MIPS_LABEL) {
+        return insts[next].label;
+    }
+    auto it = m_made_labels.find(i);
+    if (it != m_made_labels.end()) {
+        return it->second;
+    }
+    MipsInst label;
+    label.op = MIPS_LABEL;
+    label.label = m_func.NewLabel();
+    InsertAfter(i, label);
+    m_made_labels[i] = label.label;
+    return label.label;
+}
+
+int Peephole::LabelRefs(int l) const {
+    auto it = m_label_refs.find(l);
+    return it == m_label_refs.end() ? 0 : it->second;
+}
+
+void Peephole::Finish() {
+    std::stable_sort(m_inserted.begin(), m_inserted.end(),
+                     [](const std::pair<int, MipsInst>& a,
+                        const std::pair<int, MipsInst>& b) {
+                         if (a.first != b.first) {
+                             return a.first < b.first;
+                         }
+                         return a.second.op == MIPS_LABEL &&
+                                b.second.op != MIPS_LABEL;
+                     });
+    std::vector<MipsInst> out;
+    out.reserve(insts.size() + m_inserted.size());
+    auto ins = m_inserted.begin();
+    for (int i = 0; i < (int) insts.size(); ++i) {
+        if (!m_removed[i]) {
+            out.push_back(insts[i]);
+        }
+        for (; ins != m_inserted.end() && ins->first == i; ++ins) {
+            out.push_back(ins->second);
+        }
+    }
+    insts.swap(out);
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+//  The rules
+//
+//  A rule gets the sweep and the index of a real instruction or label.
+//  If its pattern matches there it rewrites it and returns the index of
+//  the last instruction of its window, otherwise -1.
+//
+//////////////////////////////////////////////////////////////////////////
+
+typedef int (*PeepholeRule)(Peephole& p, int i);
+
+//
+// move r r
+//
+static int self_move(Peephole& p, int i) {
+    const MipsInst& inst = p.insts[i];
+    if (inst.op != MIPS_MOVE || inst.rd != inst.rs) {
+        return -1;
+    }
+    p.Remove(i);
+    return i;
+}
+
+//
+// A write to a register that is dead afterwards.  Only instructions
+// that cannot trap are dropped: add, sub, neg and div stay.
+//
+static int dead_write(Peephole& p, int i) {
+    const MipsInst& inst = p.insts[i];
+    switch (inst.op) {
+    case MIPS_LI: case MIPS_LA: case MIPS_MOVE: case MIPS_ADDU:
+    case MIPS_ADDIU: case MIPS_SLL: case MIPS_MUL:
+        break;
+    default:
+        return -1;
+    }
+    if (p.LiveOut(i) & REG_BIT(inst.rd)) {
+        return -1;
+    }
+    p.Remove(i);
+    return i;
+}
+
+//
+//     op  a ...           =>    op  b ...
+//     move b a                  (a dead after the move)
+//
+// As in "lw $a0 12($a0); move $t1 $a0" before $a0 is reloaded.
+//
+static int def_move(Peephole& p, int i) {
+    MipsInst& inst = p.insts[i];
+    if (!defs(inst)) {
+        return -1;
+    }
+    int j = p.Next(i);
+    if (j == -1) {
+        return -1;
+    }
+    const MipsInst& move = p.insts[j];
+    if (move.op != MIPS_MOVE || move.rs != inst.rd || move.rd == inst.rd ||
+        (p.LiveOut(j) & REG_BIT(inst.rd))) {
+        return -1;
+    }
+    inst.rd = move.rd;
+    p.Remove(j);
+    return j;
+}
+
+//
+//     move d s            =>    ...
+//     ...                       op ... s ...
+//     op ... d ...              (d dead after op, or written by it)
+//
+// As in "move $a0 $s1; lw $a0 12($a0)" and "move $t2 $a0; lw $t1 12($t1);
+// lw $t2 12($t2)".  The instructions in between may not touch d or
+// write s.
+//
+static int copy_forward(Peephole& p, int i) {
+    const MipsInst& move = p.insts[i];
+    if (move.op != MIPS_MOVE || move.rd == move.rs) {
+        return -1;
+    }
+    RegSet d = REG_BIT(move.rd);
+    RegSet s = REG_BIT(move.rs);
+    int j = i;
+    for (int k = 0; k < PEEPHOLE_WINDOW; ++k) {
+        j = p.Next(j);
+        if (j == -1 || !is_real(p.insts[j]) || is_call(p.insts[j])) {
+            return -1;
+        }
+        MipsInst& inst = p.insts[j];
+        if (uses(inst) & d) {
+            if (!(defs(inst) & d) && (p.LiveOut(j) & d)) {
+                return -1;
+            }
+            replace_uses(inst, move.rd, move.rs);
+            p.Remove(i);
+            return j;
+        }
+        if ((defs(inst) & (d | s)) || is_branch(inst)) {
+            return -1;
+        }
+    }
+    return -1;
+}
+
+//
+//     sw    r 0($sp)      =>    move d r
+//     addiu $sp $sp -4          ...
+//     ...
+//     addiu $sp $sp 4
+//     lw    d 0($sp)
+//
+// A push popped again after a few instructions that do not touch $sp
+// and do not call, so nothing else can see the stack slot.
+//
+static int push_pop(Peephole& p, int i) {
+    MipsInst& push = p.insts[i];
+    if (push.op != MIPS_SW || push.rs != SP || push.imm != 0) {
+        return -1;
+    }
+    int j = p.Next(i);
+    if (j == -1 || p.insts[j].op != MIPS_ADDIU || p.insts[j].rd != SP ||
+        p.insts[j].rs != SP || p.insts[j].imm != -4) {
+        return -1;
+    }
+
+    std::vector<int> middle;
+    int k = j;
+    for (;;) {
+        k = p.Next(k);
+        if (k == -1 || !is_real(p.insts[k]) || is_call(p.insts[k]) ||
+            is_branch(p.insts[k])) {
+            return -1;
+        }
+        const MipsInst& inst = p.insts[k];
+        if (inst.op == MIPS_ADDIU && inst.rd == SP && inst.rs == SP &&
+            inst.imm == 4) {
+            break;
+        }
+        if (((uses(inst) | defs(inst)) & REG_BIT(SP)) ||
+            middle.size() == PEEPHOLE_WINDOW) {
+            return -1;
+        }
+        middle.push_back(k);
+    }
+    int m = p.Next(k);
+    if (m == -1 || p.insts[m].op != MIPS_LW || p.insts[m].rs != SP ||
+        p.insts[m].imm != 0) {
+        return -1;
+    }
+
+    int r = push.rd;
+    int d = p.insts[m].rd;
+    for (int x : middle) {
+        RegSet touched = d == r ? defs(p.insts[x])
+                                : uses(p.insts[x]) | defs(p.insts[x]);
+        if (touched & REG_BIT(d)) {
+            return -1;
+        }
+    }
+
+    if (d == r) {
+        p.Remove(i);
+    } else {
+        MipsInst move;
+        move.op = MIPS_MOVE;
+        move.rd = d;
+        move.rs = r;
+        push = move;
+    }
+    p.Remove(j);
+    p.Remove(k);
+    p.Remove(m);
+    return m;
+}
+
+//
+// A branch to a label whose first instruction is "b l2" goes to l2.
+//
+static int branch_chain(Peephole& p, int i) {
+    const MipsInst& inst = p.insts[i];
+    if (!is_branch(inst)) {
+        return -1;
+    }
+    int t = p.Target(inst.label);
+    if (t == -1 || p.insts[t].op != MIPS_B || p.insts[t].label == inst.label) {
+        return -1;
+    }
+    p.Retarget(i, p.insts[t].label);
+    return i;
+}
+
+//
+// A branch to the label right after it.
+//
+static int branch_next(Peephole& p, int i) {
+    const MipsInst& inst = p.insts[i];
+    if (!is_branch(inst) || !p.LabelFollows(i, inst.label)) {
+        return -1;
+    }
+    p.Remove(i);
+    return i;
+}
+
+static MipsOp inverse_branch(MipsOp op) {
+    switch (op) {
+    case MIPS_BEQ:  return MIPS_BNE;
+    case MIPS_BNE:  return MIPS_BEQ;
+    case MIPS_BLT:  return MIPS_BGE;
+    case MIPS_BGE:  return MIPS_BLT;
+    case MIPS_BLEQ: return MIPS_BGT;
+    case MIPS_BGT:  return MIPS_BLEQ;
+    case MIPS_BLTI: return MIPS_BGEI;
+    case MIPS_BGEI: return MIPS_BLTI;
+    case MIPS_BGTI: return MIPS_BLEI;
+    case MIPS_BLEI: return MIPS_BGTI;
+    default:        return MIPS_B;   // none
+    }
+}
+
+//
+//     bxx  ... l1         =>    b!xx ... l2
+//     b    l2                   l1:
+//     l1:
+//
+static int invert_branch(Peephole& p, int i) {
+    MipsInst& inst = p.insts[i];
+    MipsOp inverse = inverse_branch((MipsOp) inst.op);
+    if (inverse == MIPS_B) {
+        return -1;
+    }
+    int j = p.Next(i);
+    if (j == -1 || p.insts[j].op != MIPS_B || !p.LabelFollows(j, inst.label)) {
+        return -1;
+    }
+    int l2 = p.insts[j].label;
+    p.Remove(j);
+    p.Retarget(i, l2);
+    inst.op = inverse;
+    return j;
+}
+
+//
+// Code after "b" or "jr" that no label leads to.
+//
+static int unreachable(Peephole& p, int i) {
+    if (!is_jump(p.insts[i])) {
+        return -1;
+    }
+    int last = -1;
+    for (int j = p.Next(i); j != -1 && is_real(p.insts[j]); j = p.Next(j)) {
+        p.Remove(j);
+        last = j;
+    }
+    return last;
+}
+
+static int unused_label(Peephole& p, int i) {
+    const MipsInst& inst = p.insts[i];
+    if (inst.op != MIPS_LABEL || p.LabelRefs(inst.label) != 0) {
+        return -1;
+    }
+    p.Remove(i);
+    return i;
+}
+
+//
+// Is the code at i "lw r 12($a0)" and a branch on r being zero, the test
+// of a Bool in cond and loop?  Gives the register and the label the test
+// branches to when the Bool is (or is not) false.
+//
+static bool bool_test(Peephole& p, int i, int& reg, int& test_end,
+                      int& on_false, int& on_true) {
+    if (i == -1) {
+        return false;
+    }
+    const MipsInst& load = p.insts[i];
+    if (load.op != MIPS_LW || load.rs != ACC ||
+        load.imm != DEFAULT_OBJFIELDS * WORD_SIZE) {
+        return false;
+    }
+    int j = p.Next(i);
+    if (j == -1) {
+        return false;
+    }
+    const MipsInst& branch = p.insts[j];
+    bool on_zero = branch.op == MIPS_BEQZ ||
+                   (branch.op == MIPS_BEQ && branch.rs == ZERO);
+    bool on_nonzero = branch.op == MIPS_BNE && branch.rs == ZERO;
+    if ((!on_zero && !on_nonzero) || branch.rd != load.rd) {
+        return false;
+    }
+    reg = load.rd;
+    test_end = j;
+    on_false = on_zero ? branch.label : -1;
+    on_true = on_nonzero ? branch.label : -1;
+    return true;
+}
+
+//
+// The Bool produced by a comparison, "not" or isvoid is a constant on
+// each path out of it:
+//
+//     la  $a0 bool_const1
+//     blt $t1 $t2 l
+//     la  $a0 bool_const0
+//  l: lw  $t1 12($a0)
+//     beq $t1 $zero false
+//
+// On each of those paths the test at l is decided, so the branch goes
+// where the test would go, and the path falling into l gets a branch of
+// its own.  The loads of the constants are left to dead_write.
+//
+static int known_bool(Peephole& p, int i) {
+    const MipsInst& inst = p.insts[i];
+    int la = -1;
+    int test = -1;
+    bool branch = is_branch(inst);
+    if (branch) {
+        la = p.Prev(i);
+        test = p.Target(inst.label);
+    } else if (inst.op == MIPS_LA) {
+        la = i;
+        test = p.Next(i);
+        while (test != -1 && p.insts[test].op == MIPS_LABEL) {
+            test = p.Next(test);
+        }
+    }
+    if (la == -1 || p.insts[la].op != MIPS_LA || p.insts[la].rd != ACC ||
+        p.insts[la].addr != ADDR_BOOL) {
+        return -1;
+    }
+
+    int reg, test_end, on_false, on_true;
+    if (!bool_test(p, test, reg, test_end, on_false, on_true)) {
+        return -1;
+    }
+    bool value = p.insts[la].imm != 0;
+    int taken = value ? on_true : on_false;
+    // The skipped load must not matter where the path goes; LiveOut of
+    // the test over-approximates its fall-through side.
+    RegSet live = taken != -1 ? p.LiveAtLabel(taken) : p.LiveOut(test_end);
+    if (live & REG_BIT(reg)) {
+        return -1;
+    }
+    int target = taken != -1 ? taken : p.LabelAfter(test_end);
+
+    if (branch) {
+        p.Retarget(i, target);
+    } else {
+        MipsInst b;
+        b.op = MIPS_B;
+        b.label = target;
+        p.InsertAfter(i, b);
+    }
+    return i;
+}
+
+struct PeepholeRuleInfo {
+    const char* name;
+    PeepholeRule apply;
+};
+
+// Tried in this order at every instruction.
+static const PeepholeRuleInfo rule_table[] = {
+    { "self-move",     self_move },
+    { "dead-write",    dead_write },
+    { "push-pop",      push_pop },
+    { "def-move",      def_move },
+    { "copy-forward",  copy_forward },
+    { "known-bool",    known_bool },
+    { "branch-chain",  branch_chain },
+    { "branch-next",   branch_next },
+    { "invert-branch", invert_branch },
+    { "unreachable",   unreachable },
+    { "unused-label",  unused_label },
+};
+
+#define NUM_RULES ((int) (sizeof(rule_table) / sizeof(rule_table[0])))
+
+static std::atomic<long> rule_fired[NUM_RULES];
+
+void peephole(MipsFunc& f) {
+    bool count = !cgen_passes_measuring();
+    for (int sweep = 0; sweep < PEEPHOLE_MAX_SWEEPS; ++sweep) {
+        Peephole p(f);
+        bool changed = false;
+        for (int i = 0; i < (int) f.insts.size(); ++i) {
+            if (f.insts[i].op == MIPS_COMMENT) {
+                continue;
+            }
+            for (int rule = 0; rule < NUM_RULES; ++rule) {
+                int end = rule_table[rule].apply(p, i);
+                if (end != -1) {
+                    if (count) {
+                        ++rule_fired[rule];
+                    }
+                    changed = true;
+                    i = end;
+                    break;
+                }
+            }
+        }
+        p.Finish();
+        if (!changed) {
+            break;
+        }
+    }
+}
+
+void peephole_report(ostream& s) {
+    for (int rule = 0; rule < NUM_RULES; ++rule) {
+        s << "    " << rule_table[rule].name << ": fired "
+          << rule_fired[rule] << " times" << endl;
+    }
+}
@@ -0,0 +1,50 @@
+//
+// See copyright.h for copyright notice and limitation of liability
+// and disclaimer of warranty provisions.
+//
+#include "copyright.h"
+
+#ifndef _CGEN_PEEPHOLE_H_
+#define _CGEN_PEEPHOLE_H_
+
+//////////////////////////////////////////////////////////////////////////
+//
+//  cgen_peephole.h
+//
+//  The IR pass "peephole" (see cgen_passes.h): a windowed peephole
+//  optimizer over the instructions of one function.
+//
+//  The pass sweeps the function from top to bottom and, at every
+//  instruction, tries the rules of a rule table in order.  A rule looks
+//  at a short window starting there, rewrites it if its pattern matches
+//  and tells where its window ended; the sweep goes on after that.
+//  Sweeps repeat until no rule fires, so the rewrites of one rule can
+//  expose patterns for another.
+//
+//  Windows never extend over a label, so what a rule sees is straight
+//  line code.  What happens after the window is known from a register
+//  liveness analysis of the whole function, computed at the start of
+//  each sweep; calls and returns count as reading every register, so
+//  the analysis needs nothing from the runtime's conventions.
+//
+//  To add a rule, write a function with the PeepholeRule signature and
+//  add it to the table in cgen_peephole.cc.  The -c report lists how
+//  often each rule fired.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "cool-io.h"
+
+class MipsFunc;
+
+//
+// Run the peephole optimizer on f.
+//
+void peephole(MipsFunc& f);
+
+//
+// Print the number of times each rule fired.
+//
+void peephole_report(ostream& s);
+
+#endif
@@ -3,9 +3,12 @@
 #include <string.h>
 #include "stringtab.h"
 
-static int ascii = 0;
-
-void ascii_mode(ostream& str)
+//
+// ascii is true while an .ascii directive is open.  It is kept by the
+// caller rather than in a static so that strings can be emitted from
+// several threads at once.
+//
+static void ascii_mode(ostream& str, int& ascii)
 {
   if (!ascii) 
     {
@@ -14,7 +17,7 @@ void ascii_mode(ostream& str)
     } 
 }
 
-void byte_mode(ostream& str)
+static void byte_mode(ostream& str, int& ascii)
 {
   if (ascii) 
     {
@@ -25,42 +28,42 @@ void byte_mode(ostream& str)
 
 void emit_string_constant(ostream& str, char* s)
 {
-  ascii = 0;
+  int ascii = 0;
 
   while (*s) {
     switch (*s) {
     case '\n':
-      ascii_mode(str);
+      ascii_mode(str, ascii);
       str << "\\n";
       break;
     case '\t':
-      ascii_mode(str);
+      ascii_mode(str, ascii);
       str << "\\t";
       break;
     case '\\':
-      byte_mode(str);
+      byte_mode(str, ascii);
       str << "\t.byte\t" << (int) ((unsigned char) '\\') << endl;
       break;
     case '"' :
-      ascii_mode(str);
+      ascii_mode(str, ascii);
       str << "\\\"";
       break;
     default:
       if (*s >= ' ' && ((unsigned char) *s) < 128) 
 	{
-	  ascii_mode(str);
+	  ascii_mode(str, ascii);
 	  str << *s;
 	}
       else 
 	{
-	  byte_mode(str);
+	  byte_mode(str, ascii);
 	  str << "\t.byte\t" << (int) ((unsigned char) *s) << endl;
 	}
       break;
     }
     s++;
   }
-  byte_mode(str);
+  byte_mode(str, ascii);
   str << "\t.byte\t0\t" << endl;
 }
 
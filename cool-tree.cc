@@ -436,77 +436,77 @@ void object_class::dump(ostream& stream, int n)
 // interfaces used by Bison
 Classes nil_Classes()
 {
-   return new nil_node<Class_>();
+   return ast_arena_new<nil_node<Class_> >();
 }
 
 Classes single_Classes(Class_ e)
 {
-   return new single_list_node<Class_>(e);
+   return ast_arena_new<single_list_node<Class_> >(e);
 }
 
 Classes append_Classes(Classes p1, Classes p2)
 {
-   return new append_node<Class_>(p1, p2);
+   return ast_arena_new<append_node<Class_> >(p1, p2);
 }
 
 Features nil_Features()
 {
-   return new nil_node<Feature>();
+   return ast_arena_new<nil_node<Feature> >();
 }
 
 Features single_Features(Feature e)
 {
-   return new single_list_node<Feature>(e);
+   return ast_arena_new<single_list_node<Feature> >(e);
 }
 
 Features append_Features(Features p1, Features p2)
 {
-   return new append_node<Feature>(p1, p2);
+   return ast_arena_new<append_node<Feature> >(p1, p2);
 }
 
 Formals nil_Formals()
 {
-   return new nil_node<Formal>();
+   return ast_arena_new<nil_node<Formal> >();
 }
 
 Formals single_Formals(Formal e)
 {
-   return new single_list_node<Formal>(e);
+   return ast_arena_new<single_list_node<Formal> >(e);
 }
 
 Formals append_Formals(Formals p1, Formals p2)
 {
-   return new append_node<Formal>(p1, p2);
+   return ast_arena_new<append_node<Formal> >(p1, p2);
 }
 
 Expressions nil_Expressions()
 {
-   return new nil_node<Expression>();
+   return ast_arena_new<nil_node<Expression> >();
 }
 
 Expressions single_Expressions(Expression e)
 {
-   return new single_list_node<Expression>(e);
+   return ast_arena_new<single_list_node<Expression> >(e);
 }
 
 Expressions append_Expressions(Expressions p1, Expressions p2)
 {
-   return new append_node<Expression>(p1, p2);
+   return ast_arena_new<append_node<Expression> >(p1, p2);
 }
 
 Cases nil_Cases()
 {
-   return new nil_node<Case>();
+   return ast_arena_new<nil_node<Case> >();
 }
 
 Cases single_Cases(Case e)
 {
-   return new single_list_node<Case>(e);
+   return ast_arena_new<single_list_node<Case> >(e);
 }
 
 Cases append_Cases(Cases p1, Cases p2)
 {
-   return new append_node<Case>(p1, p2);
+   return ast_arena_new<append_node<Case> >(p1, p2);
 }
 
 Program program(Classes classes)
@@ -201,7 +201,8 @@ public:
    Feature copy_Feature();
    void dump(ostream& stream, int n);
    bool IsMethod() { return true; } // 重写，表明此特征是方法
-   void code(ostream& stream, CgenNode* class_node); // 代码生成函数
+   void code(MipsFunc& s, CgenNode* class_node); // 代码生成函数
+   void alloc_regs(RegAlloc& ra); // 为形参和方法体做寄存器分配
    int GetArgNum() { // 计算方法的参数数量
       int ret = 0;
       for (int i = formals->first(); formals->more(i); i = formals->next(i)) {
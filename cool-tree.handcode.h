@@ -11,6 +11,7 @@
 #include "tree.h"        // 包含树结构的基本定义
 #include "cool.h"        // 包含Cool语言的基本定义
 #include "stringtab.h"   // 包含字符串表处理功能
+#include "ast-arena.h"   // AST节点的arena分配器
 
 // 定义当前行号全局变量，用于词法分析/语法分析时记录行号
 #define yylineno curr_lineno;
@@ -18,6 +19,20 @@ extern int yylineno;
 
 // 前向声明Environment类，用于代码生成时的环境管理
 class Environment;
+// 前向声明MipsFunc类，表达式代码生成时向其中追加指令
+class MipsFunc;
+// 前向声明RegAlloc类，生成方法代码之前的寄存器分配（见cgen.h）
+class RegAlloc;
+// 前向声明ConstFolder类，代码生成之前的常量折叠（见cgen.h）
+class ConstFolder;
+// 前向声明AstWriter类，用于把AST写成二进制格式（见ast-binary.h）
+class AstWriter;
+
+// 各phylum类的内存分配宏：节点从AST arena中分配（见ast-arena.h），
+// 不单独释放，编译结束时由ast_arena_release统一释放
+#define AST_ARENA_EXTRAS                                             \
+static void *operator new(size_t size) { return ast_arena_alloc(size); } \
+static void operator delete(void *) { }
 
 // Boolean类型的辅助函数
 inline Boolean copy_Boolean(Boolean b) {return b; }           // 复制Boolean值
@@ -67,65 +82,133 @@ typedef Cases_class *Cases;                  // case分支列表指针
 
 // Program类的额外方法声明宏
 #define Program_EXTRAS                          \
+AST_ARENA_EXTRAS                             /* 节点在AST arena中分配 */ \
 virtual void cgen(ostream&) = 0;		/* 纯虚函数：生成代码 */ \
-virtual void dump_with_types(ostream&, int) = 0; /* 纯虚函数：带类型信息输出 */
+virtual void dump_with_types(ostream&, int) = 0; /* 纯虚函数：带类型信息输出 */ \
+virtual void write_binary(AstWriter&) = 0;     /* 纯虚函数：输出二进制AST */
 
 // program类的具体方法声明宏
 #define program_EXTRAS                          \
 void cgen(ostream&);     			/* 生成代码的具体实现 */ \
-void dump_with_types(ostream&, int);            /* 带类型信息输出的具体实现 */
+void dump_with_types(ostream&, int);            /* 带类型信息输出的具体实现 */ \
+void write_binary(AstWriter&);                 /* 输出二进制AST的具体实现 */
 
 // Class__类的额外方法声明宏
 #define Class__EXTRAS                   \
+AST_ARENA_EXTRAS                             /* 节点在AST arena中分配 */ \
 virtual Symbol get_name() = 0;  	/* 纯虚函数：获取类名 */ \
 virtual Symbol get_parent() = 0;    	/* 纯虚函数：获取父类名 */ \
 virtual Symbol get_filename() = 0;      /* 纯虚函数：获取文件名 */ \
-virtual void dump_with_types(ostream&,int) = 0; /* 纯虚函数：带类型信息输出 */
+virtual void dump_with_types(ostream&,int) = 0; /* 纯虚函数：带类型信息输出 */ \
+virtual void write_binary(AstWriter&) = 0;     /* 纯虚函数：输出二进制AST */
 
 // class__类的具体方法声明宏
 #define class__EXTRAS                                  \
 Symbol get_name()   { return name; }		       /* 获取类名实现 */ \
 Symbol get_parent() { return parent; }     	       /* 获取父类名实现 */ \
 Symbol get_filename() { return filename; }             /* 获取文件名实现 */ \
-void dump_with_types(ostream&,int);                    /* 带类型信息输出实现 */
+void dump_with_types(ostream&,int);                    /* 带类型信息输出实现 */ \
+void write_binary(AstWriter&);                 /* 输出二进制AST的具体实现 */
 
 // Feature类的额外方法声明宏
 #define Feature_EXTRAS                                        \
-virtual void dump_with_types(ostream&,int) = 0; /* 纯虚函数：带类型信息输出 */
+AST_ARENA_EXTRAS                             /* 节点在AST arena中分配 */ \
+virtual void dump_with_types(ostream&,int) = 0; /* 纯虚函数：带类型信息输出 */ \
+virtual void write_binary(AstWriter&) = 0;     /* 纯虚函数：输出二进制AST */
 
 // Feature类的共享方法声明宏
 #define Feature_SHARED_EXTRAS                                       \
-void dump_with_types(ostream&,int);    /* 带类型信息输出的具体实现 */
+void dump_with_types(ostream&,int);    /* 带类型信息输出的具体实现 */ \
+void write_binary(AstWriter&);                 /* 输出二进制AST的具体实现 */
 
 // Formal类的额外方法声明宏
 #define Formal_EXTRAS                              \
-virtual void dump_with_types(ostream&,int) = 0; /* 纯虚函数：带类型信息输出 */
+AST_ARENA_EXTRAS                             /* 节点在AST arena中分配 */ \
+virtual void dump_with_types(ostream&,int) = 0; /* 纯虚函数：带类型信息输出 */ \
+virtual void write_binary(AstWriter&) = 0;     /* 纯虚函数：输出二进制AST */
 
 // formal类的具体方法声明宏
 #define formal_EXTRAS                           \
-void dump_with_types(ostream&,int); /* 带类型信息输出的具体实现 */
+void dump_with_types(ostream&,int); /* 带类型信息输出的具体实现 */ \
+void write_binary(AstWriter&);                 /* 输出二进制AST的具体实现 */
 
 // Case类的额外方法声明宏
 #define Case_EXTRAS                             \
-virtual void dump_with_types(ostream& ,int) = 0; /* 纯虚函数：带类型信息输出 */
+AST_ARENA_EXTRAS                             /* 节点在AST arena中分配 */ \
+virtual void dump_with_types(ostream& ,int) = 0; /* 纯虚函数：带类型信息输出 */ \
+virtual void write_binary(AstWriter&) = 0;     /* 纯虚函数：输出二进制AST */
 
 // branch类的具体方法声明宏
 #define branch_EXTRAS                                   \
-void dump_with_types(ostream& ,int); /* 带类型信息输出的具体实现 */
+void dump_with_types(ostream& ,int); /* 带类型信息输出的具体实现 */ \
+void write_binary(AstWriter&);                 /* 输出二进制AST的具体实现 */
 
 // Expression类的额外成员和方法声明宏
 #define Expression_EXTRAS                    \
+AST_ARENA_EXTRAS                             /* 节点在AST arena中分配 */ \
 Symbol type;                                 /* 表达式类型符号 */ \
+Expression folded;                           /* 常量折叠（-O，遍"fold"）后代替它生成代码的表达式，没有为NULL */ \
 Symbol get_type() { return type; }           /* 获取表达式类型 */ \
 Expression set_type(Symbol s) { type = s; return this; } /* 设置表达式类型 */ \
-virtual void code(ostream&, Environment) = 0; /* 纯虚函数：生成表达式代码 */ \
+virtual void code(MipsFunc&, Environment&) = 0; /* 纯虚函数：生成表达式代码 */ \
+virtual void code_unboxed(MipsFunc&, Environment&); /* Int表达式：结果为未装箱的整数，放在ACC中 */ \
+virtual void code_branch(MipsFunc&, Environment&, bool, int); /* Bool表达式：值为sense时跳到label，否则顺序执行 */ \
+virtual bool MayCollect() { return true; }   /* 求值时是否可能触发垃圾回收（保守） */ \
+virtual bool IsLeaf() { return false; }      /* 求值时只用到ACC，无调用、无副作用 */ \
+virtual void alloc_regs(RegAlloc&) = 0;      /* 纯虚函数：按code()的求值顺序记录寄存器分配区间 */ \
+virtual void alloc_regs_unboxed(RegAlloc&); /* 同上，对应code_unboxed() */ \
+virtual void alloc_regs_branch(RegAlloc&);  /* 同上，对应code_branch() */ \
+virtual void fold_constants(ConstFolder&) = 0; /* 纯虚函数：先折叠子表达式，再折叠自身 */ \
+virtual int Size() = 0;                      /* 纯虚函数：表达式树的节点数（内联的大小阈值） */ \
 virtual void dump_with_types(ostream&,int) = 0;  /* 纯虚函数：带类型信息输出 */ \
+virtual void write_binary(AstWriter&) = 0;     /* 纯虚函数：输出二进制AST */ \
 void dump_type(ostream&, int);               /* 输出类型信息 */ \
-Expression_class() { type = (Symbol) NULL; }  /* 构造函数：初始化类型为NULL */
+Expression_class() { type = (Symbol) NULL; folded = NULL; }  /* 构造函数：初始化类型为NULL */
 
 // Expression类的共享方法声明宏
 #define Expression_SHARED_EXTRAS           \
-void code(ostream&, Environment); 			   /* 生成表达式代码的具体实现 */ \
-void dump_with_types(ostream&,int); /* 带类型信息输出的具体实现 */
+void code(MipsFunc&, Environment&); 			   /* 生成表达式代码的具体实现 */ \
+void alloc_regs(RegAlloc&);                     /* 记录寄存器分配区间的具体实现 */ \
+void fold_constants(ConstFolder&);              /* 常量折叠的具体实现 */ \
+int Size();                                     /* 节点数的具体实现 */ \
+void dump_with_types(ostream&,int); /* 带类型信息输出的具体实现 */ \
+void write_binary(AstWriter&);                 /* 输出二进制AST的具体实现 */
+
+// 整数运算节点：可直接计算未装箱的结果
+#define Arith_EXTRAS                                        \
+void code_unboxed(MipsFunc&, Environment&);  /* 计算未装箱的结果 */ \
+void alloc_regs_unboxed(RegAlloc&);          /* 对应code_unboxed的寄存器分配区间 */ \
+bool MayCollect();                           /* 操作数是否可能触发垃圾回收 */
+
+#define plus_EXTRAS   Arith_EXTRAS
+#define sub_EXTRAS    Arith_EXTRAS
+#define mul_EXTRAS    Arith_EXTRAS
+#define divide_EXTRAS Arith_EXTRAS
+#define neg_EXTRAS    Arith_EXTRAS
+
+// 比较、not和isvoid：if/while的条件直接按比较结果跳转，不构造Bool对象
+#define Branch_EXTRAS                                       \
+void code_branch(MipsFunc&, Environment&, bool, int); /* 按比较结果跳转 */
+
+#define lt_EXTRAS     Branch_EXTRAS
+#define leq_EXTRAS    Branch_EXTRAS
+#define eq_EXTRAS     Branch_EXTRAS
+#define isvoid_EXTRAS Branch_EXTRAS
+#define comp_EXTRAS                                         \
+Branch_EXTRAS                                               \
+void alloc_regs_branch(RegAlloc&);           /* 对应code_branch的寄存器分配区间 */
+
+// 常量和变量：求值时不分配内存
+#define int_const_EXTRAS                                    \
+void code_unboxed(MipsFunc&, Environment&);  /* 直接装入整数值 */ \
+bool MayCollect() { return false; }                                 \
+bool IsLeaf() { return true; }
+
+#define bool_const_EXTRAS   bool MayCollect() { return false; }
+#define string_const_EXTRAS bool MayCollect() { return false; }
+#define no_expr_EXTRAS      bool MayCollect() { return false; }
+#define object_EXTRAS                                       \
+bool MayCollect() { return false; }  /* 读变量不经过写屏障 */     \
+bool IsLeaf() { return true; }       /* 读变量只需一条load */
 
 #endif
\ No newline at end of file
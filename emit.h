@@ -64,23 +64,32 @@
 //
 // register names
 //
-#define ZERO "$zero"		// Zero register 
-#define ACC  "$a0"		// Accumulator 
-#define A1   "$a1"		// For arguments to prim funcs 
-#define SELF "$s0"		// Ptr to self (callee saves) 
-#define T1   "$t1"		// Temporary 1 
-#define T2   "$t2"		// Temporary 2 
-#define T3   "$t3"		// Temporary 3 
-#define SP   "$sp"		// Stack pointer 
-#define FP   "$fp"		// Frame pointer 
-#define RA   "$ra"		// Return address 
+// Registers are MIPS register numbers; instructions are kept in memory
+// with these numbers and the printer in cgen.cc turns them back into
+// "$a0", "$s0", etc.
+//
+#define ZERO 0		// Zero register 
+#define ACC  4		// Accumulator 
+#define A1   5		// For arguments to prim funcs 
+#define SELF 16		// Ptr to self (callee saves) 
+#define T1   9		// Temporary 1 
+#define T2   10		// Temporary 2 
+#define T3   11		// Temporary 3 
+#define SP   29		// Stack pointer 
+#define FP   30		// Frame pointer 
+#define RA   31		// Return address 
+#define S1   17		// First register of the allocator (callee saves)
+#define NUM_ALLOC_REGS 6	// $s1-$s6; the runtime keeps the heap limit in $s7
+#define HEAP_LIMIT 23	// $s7: end of the heap the runtime has allocated
+#define HEAP_PTR   28	// $gp: where the runtime allocates the next object
 
 //
 // Opcodes
 //
 #define JALR  "\tjalr\t"  
 #define JAL   "\tjal\t"                 
-#define RET   "\tjr\t"RA"\t"
+#define RET   "\tjr\t$ra\t"
+#define JR    "\tjr\t"
 
 #define SW    "\tsw\t"
 #define LW    "\tlw\t"
@@ -104,5 +113,6 @@
 #define BLEQ     "\tble\t"
 #define BLT      "\tblt\t"
 #define BGT      "\tbgt\t"
+#define BGE      "\tbge\t"
 
 
@@ -30,7 +30,12 @@ extern int cool_yydebug;        // for the parser
        bool disable_reg_alloc;  // Don't do register allocation
 
        int cgen_optimize;       // optimize switch for code generator 
+       int cgen_jobs;           // number of threads generating class code
+       int cgen_inline_size;    // largest method body (in nodes) to inline
        char *out_filename;      // file name for generated code
+       char *ast_binary_filename; // file name for a binary copy of the AST
+       char *cgen_cache_dir;    // directory of the class code cache
+       char *cgen_passes;       // passes turned on or off with -P
        Memmgr cgen_Memmgr = GC_NOGC;      // enable/disable garbage collection
        Memmgr_Test cgen_Memmgr_Test = GC_NORMAL;  // normal/test GC
        Memmgr_Debug cgen_Memmgr_Debug = GC_QUICK; // check heap frequently
@@ -51,9 +56,11 @@ void handle_flags(int argc, char *argv[]) {
   cgen_debug = 0;
   cgen_optimize = 0;
   disable_reg_alloc = 0;
+  cgen_jobs = 1;
+  cgen_inline_size = 12;
   
 
-  while ((c = getopt(argc, argv, "lpscvrOo:gtT")) != -1) {
+  while ((c = getopt(argc, argv, "lpscvrOo:gtTj:b:C:P:i:")) != -1) {
     switch (c) {
 #ifdef DEBUG
     case 'l':
@@ -96,9 +103,26 @@ void handle_flags(int argc, char *argv[]) {
     case 'o':  // set the name of the output file
       out_filename = optarg;
       break;
+    case 'b':  // write the AST in binary form to this file instead of code
+      ast_binary_filename = optarg;
+      break;
+    case 'C':  // reuse unchanged classes' code from this cache directory
+      cgen_cache_dir = optarg;
+      break;
     case 'O':  // enable optimization
       cgen_optimize = 1;
       break;
+    case 'P':  // turn optimization passes on or off (see cgen_passes.h)
+      cgen_passes = optarg;
+      break;
+    case 'j':  // generate class code on this many threads
+      cgen_jobs = atoi(optarg);
+      if (cgen_jobs < 1)
+        cgen_jobs = 1;
+      break;
+    case 'i':  // inline methods whose bodies have at most this many nodes
+      cgen_inline_size = atoi(optarg);
+      break;
     case '?':
       unknownopt = 1;
       break;
@@ -111,9 +135,9 @@ void handle_flags(int argc, char *argv[]) {
   if (unknownopt) {
       cerr << "usage: " << argv[0] << 
 #ifdef DEBUG
-	  " [-lvpscOgtTr -o outname] [input-files]\n";
+	  " [-lvpscOgtTr -j jobs -i size -o outname -b astname -C cachedir -P passes] [input-files]\n";
 #else
-      " [-OgtT -o outname] [input-files]\n";
+      " [-OgtT -j jobs -i size -o outname -b astname -C cachedir -P passes] [input-files]\n";
 #endif
       exit(1);
   }
@@ -5,6 +5,7 @@
 #include "copyright.h"
 
 #include <assert.h>
+#include <mutex>
 #include "stringtab_functions.h"
 #include "stringtab.h"
 
@@ -18,8 +19,33 @@ template class StringTable<IdEntry>;
 template class StringTable<StringEntry>;
 template class StringTable<IntEntry>;
 
+//
+// Entries are never freed, so their strings are carved out of large
+// chunks instead of making one heap allocation per symbol.
+//
+#define ARENA_CHUNK 65536
+
+static std::mutex arena_lock;   // the arena is shared by all three tables
+
+static char *arena_alloc(int size)
+{
+  static char *arena_ptr = NULL;
+  static int arena_left = 0;
+  std::lock_guard<std::mutex> guard(arena_lock);
+
+  if (size > arena_left) {
+    int chunk = size > ARENA_CHUNK ? size : ARENA_CHUNK;
+    arena_ptr = new char [chunk];
+    arena_left = chunk;
+  }
+  char *p = arena_ptr;
+  arena_ptr += size;
+  arena_left -= size;
+  return p;
+}
+
 Entry::Entry(char *s, int l, int i) : len(l), index(i) {
-  str = new char [len+1];
+  str = arena_alloc(len+1);
   strncpy(str, s, len);
   str[len] = '\0';
 }
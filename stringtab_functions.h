@@ -0,0 +1,179 @@
+//
+// See copyright.h for copyright notice and limitation of liability
+// and disclaimer of warranty provisions.
+//
+#include "copyright.h"
+
+//
+// Template member functions of StringTable.  Included once, from
+// stringtab.cc, where the three tables are explicitly instantiated.
+//
+#include <stdio.h>
+#include "cool-io.h"
+#include "stringtab.h"
+
+#define MAXSIZE 1000000
+#define min(a,b) (a > b ? b : a)
+
+//
+// FNV-1a over the first len characters of s.
+//
+template <class Elem>
+unsigned StringTable<Elem>::hash_string(char *s, int len)
+{
+  unsigned h = 2166136261u;
+  for (int i = 0; i < len; i++) {
+    h ^= (unsigned char) s[i];
+    h *= 16777619u;
+  }
+  return h;
+}
+
+//
+// Probe the hash index for an entry equal to the first len chars of s.
+//
+template <class Elem>
+Elem *StringTable<Elem>::find(char *s, int len, unsigned h)
+{
+  if (buckets.empty())
+    return NULL;
+
+  unsigned mask = buckets.size() - 1;
+  for (unsigned i = h & mask; buckets[i]; i = (i + 1) & mask)
+    if (hashes[i] == h && buckets[i]->equal_string(s,len))
+      return buckets[i];
+  return NULL;
+}
+
+template <class Elem>
+void StringTable<Elem>::insert(Elem *e, unsigned h)
+{
+  unsigned mask = buckets.size() - 1;
+  unsigned i = h & mask;
+  while (buckets[i])
+    i = (i + 1) & mask;
+  buckets[i] = e;
+  hashes[i] = h;
+}
+
+//
+// Double the hash index (or create it) and reinsert every entry.  The
+// table is kept at most half full so probe sequences stay short.
+//
+template <class Elem>
+void StringTable<Elem>::grow()
+{
+  std::vector<Elem *> old_buckets;
+  std::vector<unsigned> old_hashes;
+  old_buckets.swap(buckets);
+  old_hashes.swap(hashes);
+
+  size_t size = old_buckets.empty() ? 1024 : 2 * old_buckets.size();
+  buckets.assign(size, (Elem *) NULL);
+  hashes.assign(size, 0);
+  for (size_t i = 0; i < old_buckets.size(); i++)
+    if (old_buckets[i])
+      insert(old_buckets[i], old_hashes[i]);
+}
+
+//
+// Returns an element of the string table with a string equal
+// to the first maxchars characters of s.  A new entry is made
+// only if no such element already exists.
+//
+template <class Elem>
+Elem *StringTable<Elem>::add_string(char *s, int maxchars)
+{
+  int len = min((int) strlen(s),maxchars);
+  unsigned h = hash_string(s,len);
+  std::lock_guard<std::mutex> guard(lock);
+  Elem *e = find(s,len,h);
+  if (e)
+    return e;
+
+  if (2 * (size_t) (index + 1) > buckets.size())
+    grow();
+
+  e = new Elem(s,len,index++);
+  insert(e,h);
+  by_index.push_back(e);
+  tbl = new List<Elem>(e, tbl);
+  return e;
+}
+
+//
+// Add a string to the string table using a default limit on its length.
+//
+template <class Elem>
+Elem *StringTable<Elem>::add_string(char *s)
+{
+  return add_string(s,MAXSIZE);
+}
+
+//
+// Add the string representation of an integer to the string table.
+//
+template <class Elem>
+Elem *StringTable<Elem>::add_int(int i)
+{
+  char buf[20];
+  snprintf(buf, 20, "%d", i);
+  return add_string(buf);
+}
+
+//
+// The iterator: indices run over 0 .. index-1.
+//
+template <class Elem>
+int StringTable<Elem>::first()
+{
+  return 0;
+}
+
+template <class Elem>
+int StringTable<Elem>::more(int i)
+{
+  return i < index;
+}
+
+template <class Elem>
+int StringTable<Elem>::next(int i)
+{
+  assert(i < index);
+  return i+1;
+}
+
+//
+// Return the entry with the given index.
+//
+template <class Elem>
+Elem *StringTable<Elem>::lookup(int ind)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  assert(ind >= 0 && ind < index);   // fail if the index is out of range
+  return by_index[ind];
+}
+
+//
+// Return the entry for the null terminated string s.
+//
+template <class Elem>
+Elem *StringTable<Elem>::lookup_string(char *s)
+{
+  int len = strlen(s);
+  unsigned h = hash_string(s,len);
+  std::lock_guard<std::mutex> guard(lock);
+  Elem *e = find(s,len,h);
+  assert(e);     // fail if string is not found
+  return e;
+}
+
+//
+// Print the entire table, newest entry first.
+//
+template <class Elem>
+void StringTable<Elem>::print()
+{
+  for (List<Elem> *l = tbl; l; l = l->tl())
+    l->hd()->print(cerr);
+}
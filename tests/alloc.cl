@@ -0,0 +1,64 @@
+(*
+ *  Inline allocation (pass "alloc"): new of a small class bumps the
+ *  heap pointer in place and calls the collector only past the heap
+ *  limit.  Covers enough allocation to cross the limit, objects of 13
+ *  attributes (16 words, the largest allocated inline) and 14 (copied
+ *  through Object.copy), Int results boxed into Object attributes, and
+ *  the prototype values a fresh copy must start with.
+ *)
+
+class Cell {
+  v : Int;
+  next : Cell;
+  init(x : Int, n : Cell) : Cell { { v <- x; next <- n; self; } };
+  v() : Int { v };
+  next() : Cell { next };
+};
+
+class Wide13 {
+  a1 : Int <- 1; a2 : Int; a3 : Int; a4 : Int; a5 : Int; a6 : Int; a7 : Int;
+  a8 : Int; a9 : Int; a10 : Int; a11 : Int; a12 : Int; a13 : Int <- 13;
+  sum() : Int { a1 + a2 + a13 };
+  bump() : SELF_TYPE { { a2 <- a2 + 1; self; } };
+};
+
+class Wide14 inherits Wide13 {
+  a14 : Int <- 14;
+  sum() : Int { a1 + a2 + a13 + a14 };
+};
+
+class Box {
+  o : Object;
+  put(x : Object) : Box { { o <- x; self; } };
+  get() : Int { case o of i : Int => i; x : Object => 0; esac };
+};
+
+class Main inherits IO {
+  main() : Object {
+    let i : Int <- 0, s : Int <- 0, keep : Cell, nil : Cell, b : Box <- new Box,
+        w : Wide13, x : Wide13 in {
+      -- about 1.6MB of small objects and boxed Ints, past the 1MB heap limit
+      while i < 15000 loop {
+        (new Cell).init(i, nil);
+        w <- new Wide13;
+        b.put(i * 2);
+        s <- s + b.get();
+        if i - i / 500 * 500 = 0 then keep <- (new Cell).init(i, keep) else 0 fi;
+        i <- i + 1;
+      } pool;
+      out_int(s); out_string("\n");
+      s <- 0;
+      while not isvoid keep loop { s <- s + keep.v(); keep <- keep.next(); } pool;
+      out_int(s); out_string("\n");
+      i <- 0;
+      while i < 200 loop {
+        w <- (new Wide13).bump();
+        x <- (new Wide14).bump().bump();
+        i <- i + 1;
+      } pool;
+      out_int(w.sum()); out_string(" "); out_int(x.sum()); out_string("\n");
+      out_string((new String).concat("s")); out_int((new Int) + 1);
+      out_string(if new Bool then "T\n" else "F\n" fi);
+    }
+  };
+};
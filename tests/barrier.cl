@@ -0,0 +1,65 @@
+(*
+ *  Write barriers (-g; pass "barrier" leaves out the ones not needed).
+ *  Long-lived objects get pointers to young ones while a lot of garbage
+ *  is allocated, so with -g the collector runs and must find those
+ *  pointers.  Constant, Bool and void stores need no barrier; inits that
+ *  allocate before a store keep theirs.
+ *)
+
+class Node {
+  val : Int;
+  name : String;
+  flag : Bool;
+  next : Node;
+  set(v : Int, n : Node) : Node { { val <- v; next <- n; self; } };
+  val() : Int { val };
+  next() : Node { next };
+  name() : String { name };
+  rename(s : String) : Node { { name <- s; self; } };
+  clear() : Node { { next <- next; flag <- val < 0; name <- "c"; val <- 0; next <- let n : Node in n; self; } };
+};
+
+(* the second initializer allocates, so the store of young must keep its barrier *)
+class Holder {
+  first : Node <- new Node;
+  junk : String <- "x".concat("y");
+  young : Node <- (new Node).set(42, first);
+  young() : Node { young };
+};
+
+class Main inherits IO {
+  keep : Node;
+  holder : Holder <- new Holder;
+
+  garbage(n : Int) : Int {
+    let i : Int <- 0, s : String <- "" in {
+      while i < n loop { s <- "g".concat(i.type_name()); i <- i + 1; } pool;
+      i;
+    }
+  };
+
+  sum(n : Node) : Int {
+    let s : Int <- 0 in { while not isvoid n loop { s <- s + n.val(); n <- n.next(); } pool; s; }
+  };
+
+  main() : Object {{
+    let i : Int <- 0 in
+      while i < 100 loop { keep <- (new Node).set(i, keep); i <- i + 1; } pool;
+    garbage(2000);
+    -- old nodes now point at young ones
+    let n : Node <- keep, i : Int <- 0 in
+      while not isvoid n loop {
+        n.rename("n".concat(i.type_name()));
+        if i - (i / 10) * 10 = 0 then n.set(n.val() + 1000, (new Node).set(1, n.next())) else 0 fi;
+        garbage(20);
+        n <- n.next();
+        i <- i + 1;
+      } pool;
+    garbage(2000);
+    out_int(sum(keep)); out_string("\n");
+    out_string(keep.name()); out_string(keep.next().name()); out_string("\n");
+    out_int(holder.young().val() + holder.young().next().val()); out_string("\n");
+    out_int(sum(keep.next().next().clear())); out_string("\n");
+    out_int(sum(keep)); out_string("\n");
+  }};
+};
@@ -0,0 +1,55 @@
+(*
+ *  Conditions that branch on the comparison itself (pass "branch"): <,
+ *  <=, = on Int, Bool, String and objects, not, isvoid, and Bools that
+ *  are plain values.  A while condition moves after the body, so one
+ *  with side effects must still run once per test.
+ *)
+
+class A { x : Int; };
+
+class Main inherits IO {
+  a : A;
+  b : A <- new A;
+  t : Bool <- true;
+  f : Bool;
+  s : String <- "hi";
+  calls : Int;
+  tick(k : Int) : Int { { calls <- calls + 1; k; } };
+  check(c : Bool, name : String) : Object {
+    if c then out_string(name.concat(" yes\n")) else out_string(name.concat(" no\n")) fi
+  };
+  main() : Object {
+    let i : Int <- 0, n : Int <- 5, sum : Int <- 0 in {
+      while i < n loop { sum <- sum + i; i <- i + 1; } pool;
+      out_int(sum); out_string("\n");
+      i <- 0;
+      while i <= n loop i <- i + 2 pool;
+      out_int(i); out_string("\n");
+      while not (i = 0) loop i <- i - 1 pool;
+      out_int(i); out_string("\n");
+      if isvoid a then out_string("a void\n") else out_string("a set\n") fi;
+      if not isvoid b then out_string("b set\n") else out_string("b void\n") fi;
+      if a = b then out_string("a=b\n") else out_string("a/=b\n") fi;
+      if b = b then out_string("b=b\n") else out_string("b/=b\n") fi;
+      if t = f then out_string("t=f\n") else out_string("t/=f\n") fi;
+      if not (t = not f) then out_string("bad\n") else out_string("good\n") fi;
+      if s = "hi" then out_string("s=hi\n") else out_string("s/=hi\n") fi;
+      if not (s = "ho") then out_string("s/=ho\n") else out_string("s=ho\n") fi;
+      if not not (3 < 4) then out_string("3<4\n") else out_string("bad\n") fi;
+      if 4 <= 3 then out_string("bad\n") else out_string("4>3\n") fi;
+      if n <= 5 then out_string("n<=5\n") else out_string("bad\n") fi;
+      if n < 5 then out_string("bad\n") else out_string("n>=5\n") fi;
+      check(t, "t"); check(f, "f");
+      while f loop out_string("never\n") pool;
+      let k : Int <- 3 in while 0 < k loop { out_int(k); k <- k - 1; } pool;
+      out_string("\n");
+      if (1 + 2) = 3 then out_string("3=3\n") else out_string("bad\n") fi;
+      if new A = new A then out_string("bad\n") else out_string("new/=new\n") fi;
+      if 5 = tick(5) then out_string("5=5\n") else out_string("bad\n") fi;
+      i <- 0;
+      while tick(i) < 4 loop i <- i + 1 pool;
+      out_int(calls); out_string("\n");
+      check(n < 5, "n<5"); check(i <= n, "i<=n"); check(not isvoid self, "self");
+    }
+  };
+};
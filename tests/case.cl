@@ -0,0 +1,77 @@
+(*
+ *  case by tag ranges (pass "case"; tags are numbered in preorder).
+ *  Branches are tested most specific first, whatever order they are
+ *  written in.  Classes declared out of order, subtrees of several
+ *  depths and the basic classes are covered.  A case with many branches
+ *  uses a jump table.
+ *)
+
+class A { };
+class B inherits A { };
+class Z { };
+class C inherits A { };
+class D inherits B { };
+class E inherits C { };
+class F inherits Z { };
+class G inherits D { };
+class H inherits E { };
+class Sub inherits Main { };
+class Main inherits IO {
+  whoami() : String {
+    case self of
+      m : Main => m.type_name();
+      o : Object => "Object";
+    esac
+  };
+  (* the bound variable has the branch type *)
+  bound(x : Object) : Int {
+    case x of
+      i : Int => i * 2;
+      s : String => s.length();
+      a : A => 100;
+    esac
+  };
+  name(x : Object) : String {
+    case x of
+      a : A => "A";
+      d : D => "D";
+      e : E => "E";
+      o : Object => "Object";
+    esac
+  };
+  many(x : Object) : String {
+    case x of
+      a : A => "A";
+      b : B => "B";
+      c : C => "C";
+      d : D => "D";
+      z : Z => "Z";
+      g : G => "G";
+      i : Int => "Int";
+      s : String => "String";
+    esac
+  };
+  basic(x : Object) : String {
+    case x of
+      i : Int => "Int";
+      b : Bool => "Bool";
+      s : String => "String";
+      io : IO => "IO";
+    esac
+  };
+  show(x : Object) : Object {
+    out_string(name(x).concat(" ").concat(many(x)).concat("\n"))
+  };
+  main() : Object {
+    let objs : Object in {
+      show(new A); show(new B); show(new C); show(new D); show(new E);
+      show(new F); show(new G); show(new H); show(new Z); show(3); show("s");
+      out_string(basic(1)); out_string(basic(true)); out_string(basic("x"));
+      out_string(basic(self)); out_string("\n");
+      out_string(name(new Main)); out_string("\n");
+      out_string(whoami()); out_string(" ");
+      out_string((new Sub).whoami()); out_string("\n");
+      out_int(bound(7) + bound("four") + bound(new G)); out_string("\n");
+    }
+  };
+};
@@ -0,0 +1,45 @@
+(*
+ *  Direct calls to methods no subclass overrides (pass "devirt").
+ *  Calls on self, on SELF_TYPE results and through a variable of a
+ *  parent type must still reach the override; static dispatch always
+ *  calls the named class's method, even on self.
+ *)
+
+class A inherits IO {
+  f() : String { "A.f" };
+  g() : String { "A.g" };
+  h() : String { f().concat(g()) };
+  me() : SELF_TYPE { self };
+  twin() : SELF_TYPE { new SELF_TYPE };
+};
+
+class B inherits A {
+  f() : String { "B.f" };
+  up() : String { self@A.f().concat(f()) };
+};
+
+class C inherits B {
+  g() : String { "C.g" };
+};
+
+(* overrides a method of a basic class *)
+class Loud inherits IO {
+  out_string(s : String) : SELF_TYPE { { self@IO.out_string(s.concat("!")); self; } };
+};
+
+class Main inherits IO {
+  main() : Object {
+    let a : A <- new A, b : B <- new B, c : C <- new C, x : A <- c, io : IO <- new Loud in {
+      out_string(a.h()); out_string("\n");
+      out_string(b.h()); out_string("\n");
+      out_string(c.h()); out_string("\n");
+      out_string(x.f()); out_string(x.g()); out_string("\n");
+      out_string(b.g()); out_string(c@A.f()); out_string(c@B.g()); out_string("\n");
+      out_string(c.me().g()); out_string(x.me().g()); out_string(x.twin().h()); out_string("\n");
+      out_string(c.up()); out_string(b.up()); out_string("\n");
+      out_string(c.type_name()); out_string(c.copy().type_name()); out_string(x.twin().type_name());
+      out_string("\n");
+      io.out_string("loud"); out_string("\n");
+    }
+  };
+};
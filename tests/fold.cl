@@ -0,0 +1,56 @@
+(*
+ *  Constant folding and propagation (pass "fold").  Covers arithmetic,
+ *  comparisons, not, isvoid of new (only folded when the init has no
+ *  side effects), String methods on constants, let variables that are
+ *  never assigned, and the cases that must not fold: overflow, division
+ *  by zero in a branch that never runs, and let variables that are
+ *  assigned or shadowed.
+ *)
+
+class Noisy {
+  x : Int <- { (new IO).out_string("noisy init\n"); 3; };
+};
+
+class Quiet inherits IO {
+  y : Int <- 4 * 5;
+  s : String <- "q";
+};
+
+class Main inherits IO {
+  a : Int <- 2 + 3 * 4;
+  w : String <- "ab".concat("cd");
+
+  main() : Object {
+    let k : Int <- 10, d : Bool <- false, e : Int, t : String <- "hello",
+        m : Int <- 1, big : Int <- 2147483647 in {
+      out_int(a); out_string("\n");
+      out_int(2 * 60 * 60); out_string("\n");
+      out_int(k * 7 - 3 / 2); out_string("\n");
+      out_int(~(k + 5)); out_string("\n");
+      if d then out_string("debug\n") else out_string("nodebug\n") fi;
+      if not d then out_string("not d\n") else 0 fi;
+      out_int(e); out_string("\n");
+      out_string(t.concat(" world").substr(2, 6)); out_string("\n");
+      out_int(t.length()); out_string("\n");
+      out_string(w); out_string("\n");
+      if k < 11 then out_string("lt\n") else out_string("ge\n") fi;
+      if k <= 9 then out_string("le\n") else out_string("gt\n") fi;
+      if k = 10 then out_string("eq\n") else out_string("ne\n") fi;
+      if t = "hello" then out_string("seq\n") else out_string("sne\n") fi;
+      if isvoid new Noisy then out_string("void\n") else out_string("notvoid\n") fi;
+      if isvoid new Quiet then out_string("void\n") else out_string("notvoid\n") fi;
+      if isvoid self then out_string("void\n") else out_string("notvoid\n") fi;
+      out_int(big + 1); out_string("\n");
+      out_int(big * big); out_string("\n");
+      m <- m + 1;
+      out_int(m); out_string("\n");
+      let i : Int <- 0, n : Int <- 3 in {
+        while i < n loop i <- i + 1 pool;
+        out_int(i + n); out_string("\n");
+      };
+      let k : Int <- k * k in { out_int(k); out_string("\n"); };
+      out_int(k); out_string("\n");
+      if false then out_int(k / 0) else 0 fi;
+    }
+  };
+};
@@ -0,0 +1,46 @@
+(*
+ *  Fixed $fp-relative frames (pass "frame"): let and case variables and
+ *  temporaries get slots that are reused by sibling scopes, while the
+ *  actuals of calls are still pushed below the frame.  Run also with -r
+ *  so that every value lives in a slot.
+ *)
+
+class Main inherits IO {
+  add4(a : Int, b : Int, c : Int, d : Int) : Int { a * 1000 + b * 100 + c * 10 + d };
+
+  scopes(n : Int) : Int {
+    let total : Int <- 0 in {
+      let a : Int <- n + 1, b : Int <- n + 2 in total <- total + a * b;
+      let c : Int <- n + 3 in
+        let d : Int <- c * 2, e : Int <- d + c in total <- total + e;
+      let f : Int <- n in {
+        while 0 < f loop
+          let g : Int <- f * f in { total <- total + g; f <- f - 1; }
+        pool;
+      };
+      total;
+    }
+  };
+
+  (* temporaries and lets inside the actuals of calls *)
+  args(n : Int) : Int {
+    add4(let x : Int <- n + 1 in x,
+         n + add4(1, 2, 3, let y : Int <- n in y * 2) - add4(1, 2, 3, n * 2),
+         case n of i : Int => i; esac,
+         (let z : Int <- 3 in z) + (let z : Int <- 4 in z) - 6)
+  };
+
+  deep(n : Int) : Int {
+    if n = 0 then 0 else
+      let a : Int <- n, b : Int <- n * 2 in
+        a + b + (let c : Int <- deep(n - 1) in c + a - b + b)
+    fi
+  };
+
+  main() : Object {{
+    out_int(scopes(4)); out_string("\n");
+    out_int(args(5)); out_string("\n");
+    out_int(deep(20)); out_string("\n");
+    out_int(add4(scopes(1), args(1), deep(3), let q : Int <- 7 in q)); out_string("\n");
+  }};
+};
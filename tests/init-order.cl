@@ -0,0 +1,48 @@
+(*
+ *  Explicit initializers to the default value (0, "", false) must still be
+ *  stored: an earlier initializer may have set the attribute through a
+ *  method call or an assignment.  Output must not depend on -O.
+ *)
+
+class A inherits IO {
+  x : Int <- { y <- 5; 1; };
+  y : Int <- 0;
+  s : String <- { t <- "set"; "a"; };
+  t : String <- "";
+  b : Bool <- { c <- true; false; };
+  c : Bool <- false;
+
+  show() : Object {
+    {
+      out_int(x);
+      out_int(y);
+      out_string(s);
+      out_string(t);
+      out_string(if c then "T" else "F" fi);
+      out_string("\n");
+    }
+  };
+};
+
+class B inherits A {
+  z : Int <- 0;
+};
+
+class D inherits IO {
+  p : Int <- set();
+  q : Int <- 0;
+
+  set() : Int { { q <- 9; 1; } };
+
+  show() : Object { { out_int(p); out_int(q); out_string("\n"); } };
+};
+
+class Main {
+  main() : Object {
+    {
+      (new A).show();
+      (new B).show();
+      (new D).show();
+    }
+  };
+};
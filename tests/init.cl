@@ -0,0 +1,68 @@
+(*
+ *  Object initialization (pass "init"): constructors flattened through
+ *  the inheritance chain, initializers equal to the default value
+ *  dropped, and new skipping init methods that have nothing left.
+ *  Covers deep chains, classes with no initializers at all, new
+ *  SELF_TYPE, attributes without initializers, dispatch from an
+ *  initializer to an override, and initializers whose side effects must
+ *  run in order from the root class down.
+ *)
+
+class A inherits IO {
+  a : Int <- 0;
+  s : String <- "";
+  b : Bool <- false;
+  t : String <- "at";
+  k : Int <- who();
+  o : Object <- 0;
+  who() : Int { 1 };
+  show() : Object { { out_int(a); out_string(s); out_string(t); out_int(k);
+    out_string(if b then "T" else "F" fi);
+    out_string(case o of i : Int => "int"; x : Object => "obj"; esac); out_string("\n"); } };
+  me() : SELF_TYPE { new SELF_TYPE };
+};
+class B inherits A {
+  c : Int <- 5;
+  d : B;
+  who() : Int { 2 };
+};
+class C inherits B {
+  e : Bool;
+  f : Int <- { out_string("init C\n"); k + c; };
+  who() : Int { 3 };
+  show() : Object { { self@A.show(); out_int(f); out_string("\n"); } };
+};
+class D inherits C { };
+class E { x : Int; y : String; z : Bool; w : Int <- 0; };
+class Log inherits IO {
+  n : Int;
+  step(s : String) : Int { { n <- n + 1; out_string(s); out_int(n); out_string(" "); n; } };
+};
+class P {
+  log : Log;
+  set(l : Log) : SELF_TYPE { { log <- l; self; } };
+};
+class Q inherits P {
+  -- reads log before any initializer of Q has set it
+  q : Int <- if isvoid log then 0 else 1 fi;
+  u : Int;
+  v : Int <- u + 4;
+};
+class R inherits Q {
+  r1 : Log <- new Log;
+  r2 : Int <- r1.step("r");
+  r3 : Int <- r1.step("r");
+  show() : Object { { r1.step("q"); r1.step(if q = 0 then "ok" else "bad" fi);
+    r1.step("v"); r1.out_int(v); r1.out_string("\n"); } };
+};
+class Main inherits IO {
+  main() : Object {
+    let e : E <- new E, i : Int <- 0 in {
+      (new A).show(); (new B).show(); (new C).show(); (new D).show();
+      (new D).me().show();
+      while i < 100 loop { e <- new E; i <- i + 1; } pool;
+      if isvoid e then out_string("void\n") else out_string("E ok\n") fi;
+      (new R).show();
+    }
+  };
+};
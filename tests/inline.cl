@@ -0,0 +1,67 @@
+(*
+ *  Inlining small methods at call sites with a known target (pass
+ *  "inline").  In an inlined body self is the receiver, the formals are
+ *  the actuals and may shadow attributes.  Recursive and mutually
+ *  recursive methods stay calls, and inlined bodies nest.
+ *)
+
+class Point {
+  x : Int;
+  y : Int;
+  get_x() : Int { x };
+  get_y() : Int { y };
+  set_x(v : Int) : SELF_TYPE { { x <- v; self; } };
+  set_y(v : Int) : SELF_TYPE { { y <- v; self; } };
+  init(a : Int, b : Int) : Point { { x <- a; y <- b; self; } };
+  norm() : Int { get_x() * get_x() + get_y() * get_y() };
+  swap() : Point { let t : Int <- x in { x <- y; y <- t; self; } };
+  bump(x : Int) : Int { { x <- x + 1; x; } };
+  fact(n : Int) : Int { if n = 0 then 1 else n * fact(n - 1) fi };
+  even(n : Int) : Bool { if n = 0 then true else odd(n - 1) fi };
+  odd(n : Int) : Bool { if n = 0 then false else even(n - 1) fi };
+  diff(a : Int, b : Int) : Int { a - b };
+  me() : Point { self };
+  same_x(o : Point) : Bool { o.get_x() = get_x() };
+  sign(o : Object) : Int { case o of i : Int => if i < 0 then ~1 else 1 fi; p : Point => 0; esac };
+};
+
+class Point3 inherits Point {
+  z : Int;
+  get_z() : Int { z };
+  set_z(v : Int) : Point3 { { z <- v; self; } };
+};
+
+class Main inherits IO {
+  p : Point <- new Point;
+  q : Point3 <- new Point3;
+  nothing : Point;
+  x : Int <- 100;
+
+  show(s : String, n : Int) : Object { { out_string(s); out_int(n); out_string("\n"); } };
+
+  main() : Object {
+    let a : Int <- 3, v : Int <- 4 in {
+      p.init(a, v);
+      show("norm ", p.norm());
+      show("x ", p.get_x());
+      p.swap();
+      show("swapped x ", p.get_x());
+      show("bump ", p.bump(x));
+      show("x still ", x);
+      show("fact ", p.fact(5));
+      if p.even(10) then show("even ", 1) else show("even ", 0) fi;
+      show("diff ", p.diff(10, 3));
+      show("diff static ", p@Point.diff(v, a));
+      q.set_x(7).set_y(8);
+      q.set_z(9);
+      show("q ", q.get_x() + q.get_y() * 10 + q.get_z() * 100);
+      show("q norm ", q.norm());
+      show("nested ", p.diff(p.get_x(), q.diff(q.get_y(), p.get_y())));
+      if p.me() = p then show("me ", 1) else show("me ", 0) fi;
+      if p.same_x(q) then show("same ", 1) else show("same ", 0) fi;
+      if q.same_x(q.me()) then show("same self ", 1) else show("same self ", 0) fi;
+      show("sign ", p.sign(~5) + p.sign(p) * 10 + p.sign(5) * 100);
+      show("is void ", if isvoid nothing then 1 else 0 fi);
+    }
+  };
+};
@@ -0,0 +1,42 @@
+(*
+ *  Leaf functions (pass "leaf"): methods and inits that make no call
+ *  skip the $ra/$fp spill, address their slots from $sp and keep self in
+ *  $t4.  Leaves read and write attributes, return self, and are called
+ *  while the caller keeps values in registers.  Run also without
+ *  inlining, so the leaves are really called.
+ *)
+
+class P {
+  x : Int <- 3;
+  y : Int <- 4;
+  flag : Bool <- true;
+  getx() : Int { x };
+  setx(v : Int) : P { { x <- v; self; } };
+  swap() : SELF_TYPE { let t : Int <- x in { x <- y; y <- t; self; } };
+  pick(a : Int, b : Int, c : Bool) : Int {
+    let u : Int <- a, v : Int <- b, w : Int <- y in
+      if c then (if u < v then v else u fi) else (if w <= v then w else x fi) fi
+  };
+  same(o : Object, p : Object) : Bool { o = p };
+  isv(o : Object) : Bool { isvoid o };
+  me() : Object { self };
+};
+
+class Main inherits IO {
+  p : P <- new P;
+
+  main() : Object {
+    let i : Int <- 0, s : Int <- 0, q : P <- new P in {
+      while i < 50 loop {
+        s <- s + p.getx() + p.pick(i, 25, i < 30) + p.pick(i, 7, false);
+        if p.same(p, p) then s <- s + 1 else s <- s - 100 fi;
+        if p.isv(p) then s <- s - 1000 else s <- s + 2 fi;
+        if p.same(p.me(), q) then s <- s - 100 else s <- s + 3 fi;
+        i <- i + 1;
+      } pool;
+      out_int(s); out_string("\n");
+      out_int(q.setx(10).getx() + q.swap().getx() * 100 + q.getx()); out_string("\n");
+      out_int(p.getx() + q.swap().swap().getx()); out_string("\n");
+    }
+  };
+};
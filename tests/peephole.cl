@@ -0,0 +1,53 @@
+(*
+ *  Peephole rules (pass "peephole"): pushes popped right away, moves
+ *  feeding loads, Bools materialized from comparisons and then tested,
+ *  branches to branches, branches to the next instruction and code
+ *  after unconditional jumps.  The values must come out the same.
+ *)
+
+class Cell {
+  v : Int;
+  next : Cell;
+  init(x : Int, n : Cell) : Cell { { v <- x; next <- n; self; } };
+  v() : Int { v };
+  next() : Cell { next };
+};
+
+class Main inherits IO {
+  list : Cell;
+
+  (* comparisons kept as values, then tested *)
+  flags(a : Int, b : Int) : Int {
+    let lt : Bool <- a < b, le : Bool <- a <= b, ne : Bool <- not (a = b) in
+      (if lt then 1 else 0 fi) + (if le then 10 else 0 fi) + (if ne then 100 else 0 fi)
+  };
+
+  (* nested conditions give branches to branches *)
+  grade(n : Int) : String {
+    if n < 50 then "F" else
+    if n < 60 then "D" else
+    if n < 70 then "C" else
+    if n < 80 then "B" else "A" fi fi fi fi
+  };
+
+  sum(c : Cell) : Int {
+    let s : Int <- 0 in {
+      while not isvoid c loop { s <- s + c.v() * (if c.v() < 3 then 1 else 2 fi); c <- c.next(); } pool;
+      s;
+    }
+  };
+
+  main() : Object {{
+    out_int(flags(1, 2)); out_string(" ");
+    out_int(flags(2, 2)); out_string(" ");
+    out_int(flags(3, 2)); out_string("\n");
+    let i : Int <- 40 in
+      while i < 90 loop { out_string(grade(i)); i <- i + 7; } pool;
+    out_string("\n");
+    let i : Int <- 0 in
+      while i < 6 loop { list <- (new Cell).init(i, list); i <- i + 1; } pool;
+    out_int(sum(list)); out_string("\n");
+    out_int((1 + flags(0, 1)) * (flags(5, 4) + sum(list))); out_string("\n");
+    if not (isvoid list) then out_string("list\n") else abort() fi;
+  }};
+};
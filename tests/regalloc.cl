@@ -0,0 +1,54 @@
+(*
+ *  Register allocation (pass "regalloc", off with -r and with -g):
+ *  more live values than $s1-$s6 so some spill, values live across
+ *  calls (the callee saves the registers it uses), formals, case
+ *  variables, shadowing lets and recursion.
+ *)
+
+class Main inherits IO {
+  fib(n : Int) : Int {
+    if n < 2 then n else
+      let a : Int <- fib(n - 1), b : Int <- fib(n - 2) in a + b
+    fi
+  };
+
+  (* eight lets live across the loop and a call *)
+  deep(x : Int, y : Int) : Int {
+    let a : Int <- x + 1, b : Int <- a + y, c : Int <- b * 2, d : Int <- c - a,
+        e : Int <- d + b, f : Int <- e + c, g : Int <- f + d, h : Int <- g + e in
+      let i : Int <- 0 in {
+        while i < 10 loop {
+          i <- i + 1;
+          x <- x + (a + (b + (c + (d + (e + (f + (g + (h + i))))))));
+        } pool;
+        (if x < 0 then fib(3) else fib(x - x + 10) fi) + x + a + h;
+      }
+  };
+
+  shadow(x : Int) : Int {
+    let x : Int <- x * 2 in
+      let y : Int <- x + 1 in
+        let x : Int <- y * 10 in x + y    -- 10 * (2x + 1) + 2x + 1
+  };
+
+  sel(o : Object) : Int {
+    case o of
+      i : Int => i + fib(5) + i;
+      s : String => s.length() + s.length();
+      o : Object => 0;
+    esac
+  };
+
+  (* formals stay intact across calls that use the same registers *)
+  mix(p : Int, q : Int, r : Int) : Int {
+    let t : Int <- deep(p, q) in t - deep(p, q) + shadow(r) + p * q * r
+  };
+
+  main() : Object {{
+    out_int(fib(15)); out_string("\n");
+    out_int(deep(3, 4)); out_string("\n");
+    out_int(shadow(4)); out_string("\n");
+    out_int(sel(7) + sel("abc") + sel(self)); out_string("\n");
+    out_int(mix(2, 3, 5)); out_string("\n");
+  }};
+};
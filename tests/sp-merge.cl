@@ -0,0 +1,35 @@
+(*
+ *  Stack pointer adjustments (pass "sp-merge" of the pass manager):
+ *  argument pops right after calls, frame pops in epilogues and pops of
+ *  let and case slots are merged.  Every value must still be read from
+ *  the right slot afterwards.
+ *)
+
+class Acc {
+  sum : Int;
+  add3(a : Int, b : Int, c : Int) : Acc { { sum <- sum + a * 100 + b * 10 + c; self; } };
+  add1(a : Int) : Acc { add3(0, 0, a) };
+  sum() : Int { sum };
+};
+
+class Main inherits IO {
+  pick(a : Int, b : Int, c : Int, d : Int) : Int {
+    let x : Int <- a + b in
+      let y : Int <- c + d in
+        case x - y of
+          n : Int => let z : Int <- n * 2 in z + x * y;
+        esac
+  };
+
+  main() : Object {
+    let acc : Acc <- new Acc in {
+      out_int(acc.add3(1, 2, 3).add1(4).add3(5, 6, 7).add1(8).sum()); out_string("\n");
+      out_int(pick(1, 2, 3, 4) + pick(pick(4, 3, 2, 1), 0, 0, pick(0, 0, 0, 0)));
+      out_string("\n");
+      let i : Int <- 0 in {
+        while i < 20 loop { acc.add3(i, i, i).add1(pick(i, 1, 1, 1)); i <- i + 1; } pool;
+        out_int(acc.sum()); out_string("\n");
+      };
+    }
+  };
+};
@@ -0,0 +1,80 @@
+(*
+ *  Tail calls (pass "tail"): a call whose value is the method's value
+ *  leaves the frame first, and a call of the method itself on self
+ *  jumps back to its start.  Calls in a let initializer, in the
+ *  expression a case examines, in a condition or as an operand are not
+ *  tail calls and must return to their caller.  The depths stay small
+ *  enough for the stack without -O.
+ *)
+
+class List {
+  isNil() : Bool { true };
+  head() : Int { { abort(); 0; } };
+  tail() : List { { abort(); self; } };
+  cons(i : Int) : List { (new Cons).init(i, self) };
+  sum_acc(acc : Int) : Int { acc };
+  len_acc(n : Int) : Int { n };
+};
+class Cons inherits List {
+  car : Int;
+  cdr : List;
+  isNil() : Bool { false };
+  head() : Int { car };
+  tail() : List { cdr };
+  init(i : Int, rest : List) : List { { car <- i; cdr <- rest; self; } };
+  sum_acc(acc : Int) : Int { cdr.sum_acc(acc + car) };
+  len_acc(n : Int) : Int { let k : Int <- n + 1 in cdr.len_acc(k) };
+};
+class Counter {
+  count(n : Int, acc : Int) : Int {
+    if n = 0 then acc else count(n - 1, acc + 1) fi
+  };
+  down(n : Int) : Int {
+    let m : Int <- n - 1 in
+      case m of
+        z : Int => if z < 0 then 0 else self.down(z) fi;
+      esac
+  };
+  ping(n : Int) : Int { if n = 0 then 7 else pong(n - 1, 1, 2) fi };
+  pong(n : Int, a : Int, b : Int) : Int { if n = 0 then a + b else ping(n - 1) fi };
+  fold3(n : Int, a : Int, b : Int) : Int {
+    if n = 0 then a * 1000 + b else fold3(n - 1, b, a) fi
+  };
+  sub(c : Counter, n : Int) : Int { if n = 0 then 5 else c.sub(self, n - 1) fi };
+  st(n : Int) : Int { if n = 0 then 3 else self@Counter.st(n - 1) fi };
+  (* not tail calls *)
+  in_let(n : Int) : Int {
+    if n = 0 then 0 else let x : Int <- in_let(n - 1) in x + 2 fi
+  };
+  in_case(n : Int) : Int {
+    if n = 0 then 0 else
+      case in_case(n - 1) of
+        x : Int => x + 3;
+      esac
+    fi
+  };
+  in_cond(n : Int) : Int {
+    if n = 0 then 0 else if in_cond(n - 1) < 0 then ~1 else in_cond(n - 1) + 1 fi fi
+  };
+  operand(n : Int) : Int { if n = 0 then 0 else 1 + operand(n - 1) fi };
+  (* the last call of the block is a tail call, the first is not *)
+  twice(n : Int) : Int { if n = 0 then 11 else { operand(3); twice(n - 1); } fi };
+};
+class Main inherits IO {
+  main() : Object {
+    let l : List <- new List, c : Counter <- new Counter, i : Int <- 0 in {
+      while i < 300 loop { l <- l.cons(i); i <- i + 1; } pool;
+      out_int(l.sum_acc(0)); out_string("\n");
+      out_int(l.len_acc(0)); out_string("\n");
+      out_int(c.count(5000, 0)); out_string("\n");
+      out_int(c.down(5000)); out_string("\n");
+      out_int(c.ping(5001)); out_string("\n");
+      out_int(c.fold3(5001, 1, 2)); out_string("\n");
+      out_int(c.sub(new Counter, 5000)); out_string("\n");
+      out_int(c.st(5000)); out_string("\n");
+      out_int(c.in_let(100) + c.in_case(100) + c.operand(100)); out_string("\n");
+      out_int(c.in_cond(10)); out_string("\n");
+      out_int(c.twice(1000)); out_string("\n");
+    }
+  };
+};
@@ -0,0 +1,55 @@
+(*
+ *  Unboxed Int arithmetic (pass "unbox"): intermediate results stay raw
+ *  and are boxed only where they escape -- into an attribute, an
+ *  argument, a return value, or an Object.  Calls that allocate in the
+ *  middle of an expression must not lose a raw operand.
+ *)
+
+class Counter {
+  n : Int;
+  bump(k : Int) : Int { { n <- n + k * 2 - 1; n; } };
+  get() : Int { n };
+};
+
+class Main inherits IO {
+  total : Int;
+  c : Counter <- new Counter;
+
+  id(x : Int) : Int { x };
+
+  (* allocates a String and an Int while the caller holds a raw operand *)
+  noisy(x : Int) : Int { { ("pad").concat("ding"); x + 0; } };
+
+  show(o : Object) : Object {
+    case o of
+      i : Int => { out_string("Int "); out_int(i); out_string("\n"); };
+      s : String => { out_string("String "); out_string(s); out_string("\n"); };
+      x : Object => out_string("Object\n");
+    esac
+  };
+
+  main() : Object {
+    let a : Int <- 7, b : Int <- 3, big : Int <- 2147483647, o : Object in {
+      out_int(a + b * (a - b) - ~b); out_string("\n");             -- 22
+      out_int(a / b); out_int(~a / b); out_int(a / ~b); out_string("\n");
+      out_int(big + 1); out_string("\n");                           -- wraps
+      out_int(big * 2 + 2); out_string("\n");
+
+      total <- a * a + b;                                           -- attribute
+      out_int(total); out_string("\n");
+      out_int(id(a * b + 1) + id(a - b)); out_string("\n");         -- arguments
+      out_int(c.bump(a + b) + c.bump(1) + c.get()); out_string("\n");
+
+      o <- a * 10 + b;                                              -- as Object
+      show(o);
+      show(a - b * 5);
+      out_string(if o = o then "same\n" else "differ\n" fi);
+
+      out_int(a * 1000 + noisy(b * 100) + noisy(a) * b); out_string("\n");
+      let i : Int <- 0, s : Int <- 0 in {
+        while i < 50 loop { s <- s + i * i - noisy(i); i <- i + 1; } pool;
+        out_int(s); out_string("\n");
+      };
+    }
+  };
+};